@@ -0,0 +1,44 @@
+#ifndef _AOT_H_
+#define _AOT_H_
+
+#include <stddef.h>
+
+#include "vm.h"
+
+/* Generated by c8aot */
+extern const char aot_rom_name[];
+extern const unsigned char aot_rom[];
+extern const size_t aot_rom_size;
+extern const int aot_rom_profile; /* CHIP8_PROFILE_XXX it was compiled for */
+
+/*!
+ * \brief Execute the compiled ROM
+ * Execute up to budget instructions, falling back to the interpreter for the
+ * code the compiler could not find or which was modified at runtime.
+ *
+ * \param chip8 an initialized chip8 with the ROM loaded
+ * \param budget the number of instructions to execute
+ *
+ * \return the number of instructions executed, less than budget on error
+ */
+unsigned long aot_run(chip8_t *chip8, unsigned long budget);
+
+/* Provided by the runtime */
+
+/* non zero for the address where the compiled code is outdated */
+extern unsigned char aot_dirty[0x1000];
+
+/*!
+ * \brief Mark a range of memory as written
+ * The compiled instructions overlapping it won't be used anymore.
+ */
+void aot_mark(uint16_t addr, unsigned len);
+
+/*!
+ * \brief Execute the instruction at chip8->pc with the interpreter
+ *
+ * \return 0 if everything goes well, -1 otherwise
+ */
+int aot_fallback(chip8_t *chip8);
+
+#endif /* _AOT_H_ */
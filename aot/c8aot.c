@@ -0,0 +1,410 @@
+/*
+ * Ahead of time compiler: translate a chip8 ROM into C code.
+ *
+ * The control flow is followed from 0x200 (jumps, calls, skips and the BNNN
+ * jump tables we can guess) and every reachable instruction is emitted as a
+ * block calling the handler of include/vm_ops.h with a constant opcode.
+ * The generated aot_run() is linked with runtime.c which falls back to the
+ * interpreter for everything the analysis could not resolve.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vm.h"
+
+#define MEM_SIZE 0x1000
+#define ROM_START 0x200
+#define ROM_MAX (0xEA0 - ROM_START) /* same limit as chip8_load_game */
+#define JUMP_TABLE_MAX 128
+
+static unsigned char memory[MEM_SIZE];
+static size_t rom_size;
+static int profile = CHIP8_PROFILE_DEFAULT;
+static const char *const profile_names[CHIP8_PROFILE_COUNT] = CHIP8_PROFILE_NAMES;
+
+static unsigned char reachable[MEM_SIZE];
+static unsigned char labeled[MEM_SIZE]; /* target of a direct goto */
+
+static uint16_t worklist[MEM_SIZE];
+static size_t worklist_len;
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: %s [-o output.c] [-q profile] game_file\n", __FILE__);
+	exit(1);
+}
+
+static uint16_t opcode_at(uint16_t addr)
+{
+	return (uint16_t)(memory[addr] << 8 | memory[addr + 1]);
+}
+
+static int in_rom(unsigned addr)
+{
+	return addr >= ROM_START && addr + 1 < ROM_START + rom_size;
+}
+
+static void push(unsigned addr)
+{
+	if (!in_rom(addr) || reachable[addr])
+		return;
+	reachable[addr] = 1;
+	worklist[worklist_len++] = (uint16_t)addr;
+}
+
+/* Name of the handler in vm_ops.h, NULL for an unknown opcode */
+static const char *handler_name(uint16_t op)
+{
+	if (op == 0x00EE)
+		return "00EE";
+	if (op == 0x00E0)
+		return "00E0";
+
+	switch (op & 0xF000)
+	{
+		case 0x0000: return "0NNN";
+		case 0x1000: return "1NNN";
+		case 0x2000: return "2NNN";
+		case 0x3000: return "3XNN";
+		case 0x4000: return "4XNN";
+		case 0x5000: return (op & 0xF) == 0 ? "5XY0" : NULL;
+		case 0x6000: return "6XNN";
+		case 0x7000: return "7XNN";
+		case 0x8000:
+			switch (op & 0xF)
+			{
+				case 0x0: return "8XY0";
+				case 0x1: return "8XY1";
+				case 0x2: return "8XY2";
+				case 0x3: return "8XY3";
+				case 0x4: return "8XY4";
+				case 0x5: return "8XY5";
+				case 0x6: return "8XY6";
+				case 0x7: return "8XY7";
+				case 0xE: return "8XYE";
+			}
+			return NULL;
+		case 0x9000: return (op & 0xF) == 0 ? "9XY0" : NULL;
+		case 0xA000: return "ANNN";
+		case 0xB000: return "BNNN";
+		case 0xC000: return "CXNN";
+		case 0xD000: return "DXYN";
+		case 0xE000:
+			if ((op & 0xFF) == 0x9E)
+				return "EX9E";
+			if ((op & 0xFF) == 0xA1)
+				return "EXA1";
+			return NULL;
+		case 0xF000:
+			switch (op & 0xFF)
+			{
+				case 0x07: return "FX07";
+				case 0x0A: return "FX0A";
+				case 0x15: return "FX15";
+				case 0x18: return "FX18";
+				case 0x1E: return "FX1E";
+				case 0x29: return "FX29";
+				case 0x33: return "FX33";
+				case 0x55: return "FX55";
+				case 0x65: return "FX65";
+			}
+			return NULL;
+	}
+	return NULL;
+}
+
+static int is_skip(uint16_t op)
+{
+	switch (op & 0xF000)
+	{
+		case 0x3000:
+		case 0x4000:
+		case 0x5000:
+		case 0x9000:
+		case 0xE000:
+			return 1;
+	}
+	return 0;
+}
+
+/* BNNN jump to NNN + V0, we guess the table is made of consecutive jumps */
+static void push_jump_table(uint16_t base)
+{
+	push(base);
+	for (unsigned i = 0; i < JUMP_TABLE_MAX; i++)
+	{
+		unsigned addr = base + 2 * i;
+		if (!in_rom(addr))
+			break;
+
+		uint16_t op = opcode_at((uint16_t)addr);
+		if ((op & 0xF000) != 0x1000 && (op & 0xF000) != 0x2000)
+			break;
+		push(addr);
+	}
+}
+
+static void analyse(void)
+{
+	push(ROM_START);
+
+	while (worklist_len > 0)
+	{
+		uint16_t addr = worklist[--worklist_len];
+		uint16_t op = opcode_at(addr);
+
+		if (handler_name(op) == NULL)
+			continue; // probably data, the interpreter will decide
+		if (op == 0x00EE)
+			continue; // return address already pushed by the 2NNN
+
+		switch (op & 0xF000)
+		{
+			case 0x1000:
+				push(op & 0x0FFF);
+				continue;
+			case 0x2000:
+				push(op & 0x0FFF);
+				break;
+			case 0xB000:
+				push_jump_table(op & 0x0FFF);
+				continue;
+		}
+
+		push(addr + 2u);
+		if (is_skip(op))
+			push(addr + 4u);
+	}
+}
+
+/* How the control leaves a block */
+enum next {
+	NEXT_DISPATCH, /* target known at runtime only */
+	NEXT_STATIC,   /* always continue at *target */
+	NEXT_SKIP,     /* continue at addr + 2 or addr + 4 */
+};
+
+static enum next block_next(uint16_t addr, uint16_t op, unsigned *target)
+{
+	if (op == 0x00EE
+			|| (op & 0xF000) == 0xB000
+			|| (op & 0xF0FF) == 0xF00A
+			|| (op & 0xF0FF) == 0xF033  // the writes to the memory
+			|| (op & 0xF0FF) == 0xF055) // may change the code
+		return NEXT_DISPATCH;
+	if (is_skip(op))
+		return NEXT_SKIP;
+
+	if ((op & 0xF000) == 0x1000 || (op & 0xF000) == 0x2000)
+		*target = op & 0x0FFF;
+	else
+		*target = addr + 2u;
+	return NEXT_STATIC;
+}
+
+static int compiled(unsigned addr)
+{
+	return in_rom(addr) && reachable[addr] && handler_name(opcode_at((uint16_t)addr));
+}
+
+/* Only emit the labels used by a goto */
+static void find_labels(void)
+{
+	for (unsigned addr = ROM_START; addr < ROM_START + rom_size; addr++)
+	{
+		unsigned target;
+
+		if (!compiled(addr))
+			continue;
+		switch (block_next((uint16_t)addr, opcode_at((uint16_t)addr), &target))
+		{
+			case NEXT_STATIC:
+				labeled[target] = (unsigned char)compiled(target);
+				break;
+			case NEXT_SKIP:
+				labeled[addr + 2] = (unsigned char)compiled(addr + 2);
+				labeled[addr + 4] = (unsigned char)compiled(addr + 4);
+				break;
+			case NEXT_DISPATCH:
+				break;
+		}
+	}
+}
+
+/* Emit the transfer to the block at addr, through the dispatcher if unknown */
+static void emit_goto(FILE *out, unsigned addr)
+{
+	if (labeled[addr])
+		fprintf(out, "\t\tgoto L_%03X;\n", addr);
+	else
+		fprintf(out, "\t\tgoto dispatch;\n");
+}
+
+static void emit_block(FILE *out, uint16_t addr)
+{
+	uint16_t op = opcode_at(addr);
+	const char *name = handler_name(op);
+	unsigned target;
+
+	fprintf(out, "\tcase 0x%03X:\n", addr);
+	if (labeled[addr])
+		fprintf(out, "\tL_%03X:\n", addr);
+
+	if (name == NULL)
+	{
+		fprintf(out, "\t\tgoto fallback; /* unknown opcode 0x%04X */\n", op);
+		return;
+	}
+
+	fprintf(out, "\t\tif (n == budget)\n\t\t\treturn n;\n");
+	fprintf(out, "\t\tif (aot_dirty[0x%03X])\n\t\t\tgoto fallback;\n", addr);
+
+	if ((op & 0xF0FF) == 0xF033)
+		fprintf(out, "\t\taot_mark(chip8->I, 3);\n");
+	if ((op & 0xF0FF) == 0xF055)
+		fprintf(out, "\t\taot_mark(chip8->I, %u);\n", ((op & 0x0F00) >> 8) + 1);
+
+	fprintf(out, "\t\tchip8->opcode = 0x%04X;\n", op);
+	fprintf(out, "\t\tchip8_opcode_%s(chip8);\n", name);
+	fprintf(out, "\t\tchip8_timers_tick(chip8);\n");
+	fprintf(out, "\t\tn++;\n");
+	// may overflow the stack or access the memory past its end
+	if (op == 0x00EE || (op & 0xF000) == 0x2000 || (op & 0xF000) == 0xD000
+			|| (op & 0xF0FF) == 0xF033 || (op & 0xF0FF) == 0xF055 || (op & 0xF0FF) == 0xF065)
+		fprintf(out, "\t\tif (chip8->halted)\n\t\t\treturn n;\n");
+
+	switch (block_next(addr, op, &target))
+	{
+		case NEXT_DISPATCH:
+			fprintf(out, "\t\tgoto dispatch;\n");
+			break;
+		case NEXT_STATIC:
+			emit_goto(out, target);
+			break;
+		case NEXT_SKIP:
+			fprintf(out, "\t\tif (chip8->pc == 0x%03X)\n\t", addr + 2);
+			emit_goto(out, addr + 2u);
+			emit_goto(out, addr + 4u);
+			break;
+	}
+}
+
+/* Write str as a C string literal, also safe in a comment: no star-slash */
+static void emit_string(FILE *out, const char *str)
+{
+	fputc('"', out);
+	for (const unsigned char *c = (const unsigned char *)str; *c != '\0'; c++)
+	{
+		if (*c == '"' || *c == '\\')
+			fprintf(out, "\\%c", *c);
+		else if (*c < 0x20 || *c >= 0x7F || (*c == '/' && c > (const unsigned char *)str && c[-1] == '*'))
+			fprintf(out, "\\%03o", *c);
+		else
+			fputc(*c, out);
+	}
+	fputc('"', out);
+}
+
+static void emit(FILE *out, const char *rom_name)
+{
+	size_t blocks = 0;
+
+	for (unsigned addr = ROM_START; addr < ROM_START + rom_size; addr++)
+		blocks += reachable[addr];
+
+	fprintf(out, "/* Generated by c8aot from ");
+	emit_string(out, rom_name);
+	fprintf(out, ", do not edit */\n\n");
+	fprintf(out, "#include \"vm.h\"\n\n");
+	// specialize the handlers for the quirks of the ROM
+	fprintf(out, "#define CHIP8_PROFILE %d /* %s */\n", profile, profile_names[profile]);
+	fprintf(out, "#include \"vm_ops.h\"\n#include \"aot.h\"\n\n");
+	fprintf(out, "const int aot_rom_profile = CHIP8_PROFILE;\n");
+	fprintf(out, "const char aot_rom_name[] = ");
+	emit_string(out, rom_name);
+	fprintf(out, ";\n");
+	fprintf(out, "const size_t aot_rom_size = %zu;\n", rom_size);
+	fprintf(out, "const unsigned char aot_rom[] = {");
+	for (size_t i = 0; i < rom_size; i++)
+		fprintf(out, "%s0x%02X,", i % 12 ? " " : "\n\t", memory[ROM_START + i]);
+	fprintf(out, "\n};\n\n");
+
+	fprintf(out, "/* %zu reachable instructions */\n", blocks);
+	fprintf(out, "unsigned long aot_run(chip8_t *chip8, unsigned long budget)\n{\n");
+	fprintf(out, "\tunsigned long n = 0;\n\n");
+	fprintf(out, "dispatch:\n");
+	fprintf(out, "\tif (n == budget)\n\t\treturn n;\n");
+	fprintf(out, "\tswitch (chip8->pc)\n\t{\n");
+
+	for (unsigned addr = ROM_START; addr < ROM_START + rom_size; addr++)
+		if (reachable[addr])
+			emit_block(out, (uint16_t)addr);
+
+	fprintf(out, "\tdefault:\n\t\tgoto fallback;\n\t}\n\n");
+	fprintf(out, "fallback:\n");
+	fprintf(out, "\tif (aot_fallback(chip8))\n\t\treturn n;\n");
+	fprintf(out, "\tn++;\n\tgoto dispatch;\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *output = NULL;
+	FILE *fd, *out = stdout;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "o:q:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'o':
+				output = optarg;
+				break;
+			case 'q':
+				for (profile = CHIP8_PROFILE_COUNT - 1; profile >= 0; profile--)
+					if (strcmp(profile_names[profile], optarg) == 0)
+						break;
+				if (profile < 0)
+					usage();
+				break;
+			default:
+				usage();
+		}
+	}
+	if (optind + 1 != argc)
+		usage();
+
+	fd = fopen(argv[optind], "rb");
+	if (fd == NULL)
+	{
+		perror("Failed to open file: ");
+		return 1;
+	}
+	rom_size = fread(memory + ROM_START, 1, ROM_MAX, fd);
+	fclose(fd);
+
+	analyse();
+	find_labels();
+
+	if (output != NULL && (out = fopen(output, "w")) == NULL)
+	{
+		perror("Failed to open output: ");
+		return 1;
+	}
+
+	// use the file name without directory nor extension as the ROM name
+	char *name = strrchr(argv[optind], '/');
+	name = strdup(name ? name + 1 : argv[optind]);
+	if (strchr(name, '.'))
+		*strchr(name, '.') = '\0';
+
+	emit(out, name);
+
+	free(name);
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Runtime of the ahead of time compiled ROMs: same main loop as main/main.c
+ * but the instructions are executed by aot_run() and the ROM is embedded in
+ * the executable.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "vm.h"
+#include "window.h"
+#include "pacer.h"
+#include "aot.h"
+
+unsigned char aot_dirty[0x1000];
+
+void aot_mark(uint16_t addr, unsigned len)
+{
+	// the instruction starting just before addr is modified too
+	unsigned start = addr > 0 ? addr - 1u : 0;
+
+	for (unsigned a = start; a < addr + len && a < sizeof(aot_dirty); a++)
+		aot_dirty[a] = 1;
+}
+
+int aot_fallback(chip8_t *chip8)
+{
+	uint16_t opcode = (uint16_t)(chip8_read(chip8, chip8->pc) << 8 | chip8_read(chip8, chip8->pc + 1u));
+
+	if ((opcode & 0xF0FF) == 0xF033)
+		aot_mark(chip8->I, 3);
+	else if ((opcode & 0xF0FF) == 0xF055)
+		aot_mark(chip8->I, ((opcode & 0x0F00) >> 8) + 1u);
+
+	return chip8_emulate_cycle(chip8);
+}
+
+static void handle_vm_events(chip8_t *chip8)
+{
+	chip8_event_t event;
+
+	while (chip8_poll_event(chip8, &event) == 0)
+	{
+		if (event.type == CHIP8_EVENT_SOUND_START || event.type == CHIP8_EVENT_SOUND_STOP)
+			window_sound(chip8->window, event.type == CHIP8_EVENT_SOUND_START);
+		else
+			fprintf(stderr, "%s at 0x%03X (opcode 0x%04X)\n",
+					chip8_event_name(event.type), event.pc, event.opcode);
+	}
+}
+
+int main(void)
+{
+	chip8_t *chip8 = chip8_init();
+	int turbo = 0;
+
+	if (chip8 == NULL)
+	{
+		perror("Failed to create the chip8: ");
+		return 1;
+	}
+	// before the window takes the terminal
+	if (chip8_set_profile(chip8, aot_rom_profile) < 0
+			|| chip8_load_rom(chip8, aot_rom, aot_rom_size) < 0)
+	{
+		fprintf(stderr, "Failed to load %s\n", aot_rom_name);
+		return 1;
+	}
+	chip8->window = create_window(64, 32);
+	window_status(chip8->window, aot_rom_name);
+
+	pacer_t pacer;
+	pacer_init(&pacer, CHIP8_FRAME_RATE, PACER_DROP);
+
+	while(1)
+	{
+		unsigned long n = aot_run(chip8, CHIP8_CYCLES_PER_FRAME);
+		handle_vm_events(chip8);
+		if (n != CHIP8_CYCLES_PER_FRAME || chip8->halted)
+			break;
+
+		update_window(chip8->window, chip8->gfx);
+
+		int event = handle_event(chip8->key);
+		if (event & WINDOW_EVENT_QUIT)
+			break;
+		if (event & WINDOW_EVENT_TURBO)
+		{
+			turbo = !turbo;
+			pacer_reset(&pacer);
+		}
+
+		if (!turbo)
+			pacer_wait(&pacer);
+	}
+
+	destroy_window(chip8->window);
+	chip8_free(chip8);
+
+	return 0;
+}
@@ -21,6 +21,7 @@ WARNINGS := -Wall -Wextra -pedantic -Wshadow -Wpointer-arith -Wcast-align \
             -Wredundant-decls -Wnested-externs -Winline -Wno-long-long \
             -Wconversion -Wstrict-prototypes
 CFLAGS ?=
-CFLAGS += -g -std=gnu99 $(WARNINGS)
+CFLAGS += -g -std=gnu99 -pthread $(WARNINGS)
 
 LDFLAGS ?=
+LDFLAGS += -pthread
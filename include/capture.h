@@ -0,0 +1,117 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Recording of the emulated frames.
+ *
+ * The file starts with a CAPTURE_HEADER_SIZE bytes header: CAPTURE_MAGIC,
+ * the version, the width, the height and the frame rate on one byte each,
+ * then the key frame interval on two bytes.
+ * It is followed by one record per frame: the type (CAPTURE_KEYFRAME or
+ * CAPTURE_DELTA) on one byte, the frame number on four bytes and the length
+ * of the data on two bytes, then the data. All the integers are big endian.
+ * The data of a key frame are the pixels packed in bits (most significant
+ * bit first), the data of a delta are the packed pixels xored with the ones
+ * of the previous record. Both are compressed with rle_encode_bytes.
+ * The frame numbers jump when frames were dropped by capture_frame.
+ */
+#define CAPTURE_MAGIC "C8RP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE 10
+#define CAPTURE_RECORD_SIZE 7
+/* a key frame every 10 seconds, to seek into long recordings */
+#define CAPTURE_KEYFRAME_INTERVAL 600
+/* frames waiting for the writer thread, must be a power of two */
+#define CAPTURE_QUEUE 1024
+/* largest screen supported */
+#define CAPTURE_MAX_PIXELS (64 * 32)
+
+enum capture_record_e {
+	CAPTURE_KEYFRAME = 1,
+	CAPTURE_DELTA,
+};
+
+typedef struct capture_s capture_t;
+
+typedef struct capture_reader_s {
+	FILE *file;
+	int width;
+	int height;
+	int rate; /* frames per second */
+	unsigned keyframe_interval;
+	unsigned char bits[CAPTURE_MAX_PIXELS / 8]; /* the last frame read */
+} capture_reader_t;
+
+/*!
+ * \brief Start a recording
+ * The frames are written by a new thread.
+ *
+ * \param path the file to create
+ * \param width width of the screen
+ * \param height height of the screen
+ * \param rate frames per second, written in the header
+ *
+ * \return the new capture, NULL on error
+ */
+capture_t *capture_open(const char *path, int width, int height, int rate);
+
+/*!
+ * \brief Record a frame, never blocks
+ *
+ * \param capture an open capture
+ * \param gfx the pixels, width pixels per row
+ *
+ * \return 0 if everything goes well, -1 if the frame was dropped because
+ * the writer thread is late
+ */
+int capture_frame(capture_t *capture, const unsigned char *gfx);
+
+/*!
+ * \brief Number of frames dropped by capture_frame
+ *
+ * \param capture an open capture
+ */
+unsigned long capture_dropped(const capture_t *capture);
+
+/*!
+ * \brief Write the queued frames and close the recording
+ *
+ * \param capture an open capture
+ *
+ * \return 0 if everything goes well, -1 if the file could not be written
+ */
+int capture_close(capture_t *capture);
+
+/*!
+ * \brief Open a recording to read it
+ *
+ * \param reader the reader to initialize
+ * \param path the recording
+ *
+ * \return 0 if everything goes well, -1 otherwise
+ */
+int capture_reader_open(capture_reader_t *reader, const char *path);
+
+/*!
+ * \brief Read the next frame of a recording
+ *
+ * \param reader an open reader
+ * \param gfx where the pixels are written (0 or 1), width pixels per row
+ * \param frame where the frame number is stored
+ *
+ * \return 1 if a frame was read, 0 at the end of the recording, -1 if it is
+ * invalid
+ */
+int capture_reader_next(capture_reader_t *reader, unsigned char *gfx, uint32_t *frame);
+
+/*!
+ * \brief Close a reader
+ *
+ * \param reader an open reader
+ */
+void capture_reader_close(capture_reader_t *reader);
+
+#endif /* _CAPTURE_H_ */
@@ -0,0 +1,163 @@
+#ifndef _DEBUG_H_
+#define _DEBUG_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vm.h"
+
+/*
+ * Debugger of the chip8.
+ * When a debugger is attached the chip8 runs an instrumented copy of the
+ * interpreters (src/vm_debug.c) which executes one instruction at a time and
+ * calls chip8_debug_before and chip8_debug_after around each of them. The
+ * normal interpreters do not know anything about the debugger.
+ */
+
+/* Why the execution stopped */
+typedef enum chip8_debug_stop_e {
+	CHIP8_DEBUG_RUNNING = 0,
+	CHIP8_DEBUG_BREAKPOINT, /* before the instruction at a breakpoint */
+	CHIP8_DEBUG_WATCHPOINT, /* after a write to a watched address */
+	CHIP8_DEBUG_CONDITION,  /* after a register matched a condition */
+	CHIP8_DEBUG_STEP,       /* after the requested number of instructions */
+	CHIP8_DEBUG_INTERRUPT,  /* requested by chip8_debug_interrupt */
+} chip8_debug_stop_t;
+
+/* Registers of the conditions: V0 to VF are 0x0 to 0xF */
+#define CHIP8_REG_I     0x10
+#define CHIP8_REG_DT    0x11 /* delay timer */
+#define CHIP8_REG_ST    0x12 /* sound timer */
+#define CHIP8_REG_SP    0x13
+#define CHIP8_REG_COUNT 0x14
+
+typedef enum chip8_cond_e {
+	CHIP8_COND_CHANGE, /* the register changes */
+	CHIP8_COND_EQUAL,  /* the register becomes equal to the value */
+} chip8_cond_t;
+
+#define CHIP8_DEBUG_CONDITIONS 16
+/* largest write of an instruction: FX55 with X = F */
+#define CHIP8_DEBUG_MAX_WRITE 16
+
+typedef struct chip8_debug_s {
+	unsigned char breakpoints[0x1000]; /* non zero at the addresses to stop at */
+	unsigned char watchpoints[0x1000]; /* non zero at the watched addresses */
+	struct {
+		unsigned char used;
+		unsigned char reg; /* CHIP8_REG_XXX */
+		unsigned char type; /* chip8_cond_t */
+		uint16_t value;
+	} conditions[CHIP8_DEBUG_CONDITIONS];
+
+	unsigned long steps; /* instructions to execute before stopping, 0 to run */
+	int resume; /* do not stop at the breakpoint of the next instruction */
+	int interrupt; /* written asynchronously, see chip8_debug_interrupt */
+	chip8_debug_stop_t stop;
+	uint16_t stop_pc; /* address of the instruction which stopped */
+	uint16_t stop_info; /* watched address, or condition index */
+
+	/* state before the current instruction */
+	uint16_t regs[CHIP8_REG_COUNT];
+	uint16_t write_start; /* memory written by the instruction */
+	uint16_t write_len; /* 0 if it does not write a watched address */
+	unsigned char write_old[CHIP8_DEBUG_MAX_WRITE];
+
+	char last[128]; /* last command of chip8_debug_repl, repeated by an empty line */
+} chip8_debug_t;
+
+/*!
+ * \brief Attach a debugger, the chip8 switches to the instrumented interpreters
+ *
+ * \param chip8 an initialized chip8
+ *
+ * \return the debugger, NULL on error
+ */
+chip8_debug_t *chip8_debug_attach(chip8_t *chip8);
+
+/*!
+ * \brief Detach the debugger, the chip8 goes back to the fast interpreters
+ *
+ * \param chip8 an initialized chip8
+ */
+void chip8_debug_detach(chip8_t *chip8);
+
+/*!
+ * \brief Value of a register
+ *
+ * \param chip8 an initialized chip8
+ * \param reg one of CHIP8_REG_XXX, or 0x0 to 0xF for V0 to VF
+ */
+uint16_t chip8_debug_reg(const chip8_t *chip8, unsigned reg);
+
+/*!
+ * \brief Find a register by its name: V0 to VF, I, DT, ST or SP
+ *
+ * \return the register, -1 if no register has this name
+ */
+int chip8_debug_reg_by_name(const char *name);
+
+/*!
+ * \brief Add a condition on a register
+ *
+ * \param chip8 a chip8 with a debugger
+ * \param reg the register
+ * \param type what to test
+ * \param value for CHIP8_COND_EQUAL
+ *
+ * \return the index of the condition, -1 if there are too many conditions
+ */
+int chip8_debug_condition(chip8_t *chip8, unsigned reg, chip8_cond_t type, uint16_t value);
+
+/*!
+ * \brief Resume the execution
+ *
+ * \param chip8 a chip8 with a debugger
+ * \param steps number of instructions to execute before stopping, 0 to run
+ * until a breakpoint, a watchpoint or a condition
+ */
+void chip8_debug_continue(chip8_t *chip8, unsigned long steps);
+
+/*!
+ * \brief Stop before the next instruction, can be called from a signal handler
+ *
+ * \param chip8 a chip8, nothing is done once the debugger is detached
+ */
+void chip8_debug_interrupt(chip8_t *chip8);
+
+/*!
+ * \brief Why the chip8 stopped
+ *
+ * \param chip8 an initialized chip8
+ *
+ * \return CHIP8_DEBUG_RUNNING if it is running or without debugger
+ */
+chip8_debug_stop_t chip8_debug_stopped(const chip8_t *chip8);
+
+/*!
+ * \brief Interactive debugger, run until the user resumes the execution
+ * Type h for the list of the commands.
+ *
+ * \param chip8 a stopped chip8
+ * \param in where the commands are read
+ * \param out where the results are written
+ *
+ * \return 0 when the execution resumes, -1 when the user wants to quit
+ */
+int chip8_debug_repl(chip8_t *chip8, FILE *in, FILE *out);
+
+/*!
+ * \brief Called by the instrumented interpreters before each instruction
+ *
+ * \return non zero to stop without executing the instruction
+ */
+int chip8_debug_before(chip8_t *chip8);
+
+/*!
+ * \brief Called by the instrumented interpreters after each instruction
+ *
+ * \return non zero to stop
+ */
+int chip8_debug_after(chip8_t *chip8);
+
+#endif /* _DEBUG_H_ */
@@ -0,0 +1,17 @@
+#ifndef _DISASM_H_
+#define _DISASM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ * \brief Write the assembly of an instruction, with the usual mnemonics
+ * e.g. "LD V1, 0x2A" for 0x612A
+ *
+ * \param opcode the instruction
+ * \param buf where the text is written
+ * \param size size of buf
+ */
+void chip8_disassemble(uint16_t opcode, char *buf, size_t size);
+
+#endif /* _DISASM_H_ */
@@ -0,0 +1,31 @@
+#ifndef _FNV_H_
+#define _FNV_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * 64 bits FNV-1a, the hash of the states, of the frames (src/gfx/NULL) and of
+ * the games of a pack (include/rompack.h). A hash starts from FNV_OFFSET and
+ * is continued with each byte.
+ */
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+/* Add a byte to hash */
+static inline uint64_t fnv_byte(uint64_t hash, unsigned char byte)
+{
+	return (hash ^ byte) * FNV_PRIME;
+}
+
+/* Add size bytes to hash */
+static inline uint64_t fnv_bytes(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = data;
+
+	for (size_t i = 0; i < size; i++)
+		hash = fnv_byte(hash, bytes[i]);
+	return hash;
+}
+
+#endif /* _FNV_H_ */
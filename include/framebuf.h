@@ -0,0 +1,123 @@
+#ifndef _FRAMEBUF_H_
+#define _FRAMEBUF_H_
+
+#include <stdint.h>
+
+/*
+ * Export of the screen to other processes through a shared memory page,
+ * /dev/shm/c8frame.NAME, so they use the frames in place: no copy and no
+ * socket.
+ * The page holds two slots of pixels: frame n is written in slot n % 2 while
+ * the readers use the previous one. seq is the number of the last frame
+ * published. Each slot has its own sequence, 0 while it is written, so a
+ * reader which took too long to use a frame (two more frames were
+ * published) finds out with framebuf_valid.
+ * The readers sleep on seq with a futex, the writer only calls the kernel
+ * to wake them when a reader is waiting.
+ */
+#define FRAMEBUF_DIR "/dev/shm"
+#define FRAMEBUF_PREFIX "c8frame."
+#define FRAMEBUF_MAGIC "C8FB"
+#define FRAMEBUF_VERSION 1
+/* longest name given to framebuf_open */
+#define FRAMEBUF_NAME 32
+
+typedef struct framebuf_slot_s {
+	uint32_t seq;   /* frame held, 0 while it is written */
+	uint32_t pad;
+	uint64_t frame; /* number of the emulated frame, see main */
+	uint64_t time;  /* CLOCK_MONOTONIC when it was published, in ns */
+} framebuf_slot_t;
+
+typedef struct framebuf_page_s {
+	char magic[4]; /* written last, the page is ready */
+	uint32_t version;
+	uint32_t pid; /* of the writer */
+	char name[FRAMEBUF_NAME];
+	uint16_t width;
+	uint16_t height;
+	uint32_t seq;     /* last frame published, 0 for none, futex of the readers */
+	uint32_t waiters; /* readers sleeping on seq */
+	framebuf_slot_t slots[2];
+	unsigned char pixels[]; /* the two slots, width * height bytes each, 0 or 1 */
+} framebuf_page_t;
+
+/* A frame in the page, valid until framebuf_valid says otherwise */
+typedef struct framebuf_frame_s {
+	uint32_t seq;
+	uint64_t frame;
+	uint64_t time;
+	const unsigned char *pixels; /* in the page, width * height bytes */
+} framebuf_frame_t;
+
+/*!
+ * \brief Create a page to publish the frames
+ *
+ * \param name identifies the page for the readers, without '/'
+ * \param width width of the screen
+ * \param height height of the screen
+ *
+ * \return the page, NULL on error
+ */
+framebuf_page_t *framebuf_open(const char *name, int width, int height);
+
+/*!
+ * \brief Publish a frame, never blocks
+ *
+ * \param page a page created by framebuf_open
+ * \param gfx the pixels, width pixels per row, any non zero byte is lit
+ * \param frame the number of the frame in the emulation
+ */
+void framebuf_publish(framebuf_page_t *page, const unsigned char *gfx, uint64_t frame);
+
+/*!
+ * \brief Remove a page created by framebuf_open, NULL is ignored
+ */
+void framebuf_close(framebuf_page_t *page);
+
+/*!
+ * \brief Map the page of a writer to read its frames
+ *
+ * \param name the name given to framebuf_open
+ *
+ * \return the page, NULL if there is no such page
+ */
+framebuf_page_t *framebuf_attach(const char *name);
+
+/*!
+ * \brief Unmap a page mapped by framebuf_attach
+ */
+void framebuf_detach(framebuf_page_t *page);
+
+/*!
+ * \brief Wait until a frame after seq is published
+ *
+ * \param page a page mapped by framebuf_attach
+ * \param seq the last frame seen, 0 for none
+ * \param timeout_ms the longest wait, -1 for no limit
+ *
+ * \return 0 if a new frame is there, -1 on timeout or signal
+ */
+int framebuf_wait(framebuf_page_t *page, uint32_t seq, int timeout_ms);
+
+/*!
+ * \brief Get the last frame published, without copying it
+ *
+ * \param page a page mapped by framebuf_attach
+ * \param frame filled with the frame
+ *
+ * \return 0 if everything goes well, -1 if no frame was published yet
+ */
+int framebuf_acquire(const framebuf_page_t *page, framebuf_frame_t *frame);
+
+/*!
+ * \brief Check that the pixels of a frame were not overwritten while in use
+ *
+ * \param page a page mapped by framebuf_attach
+ * \param frame a frame given by framebuf_acquire
+ *
+ * \return 1 if the pixels are still the ones of the frame, 0 otherwise
+ */
+int framebuf_valid(const framebuf_page_t *page, const framebuf_frame_t *frame);
+
+#endif /* _FRAMEBUF_H_ */
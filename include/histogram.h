@@ -0,0 +1,68 @@
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Log-linear histogram of durations in nanoseconds: each power of two is
+ * split in HISTOGRAM_SUB_BUCKETS buckets, so the relative error of the
+ * percentiles is below 1 / HISTOGRAM_SUB_BUCKETS whatever the magnitude.
+ */
+#define HISTOGRAM_SUB_BITS    3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS     (64 * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct histogram_s {
+	uint64_t count; /* number of values recorded */
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+/*!
+ * \brief Forget all the values of a histogram
+ *
+ * \param hist the histogram to reset
+ */
+void histogram_reset(histogram_t *hist);
+
+/*!
+ * \brief Record a value
+ *
+ * \param hist an initialized histogram
+ * \param value the value, in nanoseconds
+ */
+void histogram_add(histogram_t *hist, uint64_t value);
+
+/*!
+ * \brief Estimate a percentile
+ *
+ * \param hist an initialized histogram
+ * \param percent between 0 and 100
+ *
+ * \return the upper bound of the bucket holding the percentile, 0 if empty
+ */
+uint64_t histogram_percentile(const histogram_t *hist, double percent);
+
+/*!
+ * \brief Print a one line summary: count, min, mean, percentiles and max
+ *
+ * \param hist an initialized histogram
+ * \param file where to print
+ * \param name printed at the beginning of the line
+ */
+void histogram_print(const histogram_t *hist, FILE *file, const char *name);
+
+/*!
+ * \brief Write the non empty buckets, one per line: name, largest value of
+ * the bucket and number of values, to be processed by other tools
+ *
+ * \param hist an initialized histogram
+ * \param file where to write
+ * \param name written at the beginning of each line
+ */
+void histogram_export(const histogram_t *hist, FILE *file, const char *name);
+
+#endif /* _HISTOGRAM_H_ */
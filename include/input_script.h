@@ -0,0 +1,59 @@
+#ifndef _INPUT_SCRIPT_H_
+#define _INPUT_SCRIPT_H_
+
+#include <stdio.h>
+
+/*
+ * Scripted input, one event per line:
+ *   FRAME press KEY     the key (hexadecimal digit) is held from FRAME
+ *   FRAME release KEY
+ *   FRAME tap KEY       held during FRAME only
+ *   FRAME turbo         toggle the turbo mode
+ *   FRAME quit
+ * The frames must be in increasing order, the empty lines and the lines
+ * starting with # are ignored.
+ */
+typedef struct input_script_s {
+	FILE *file;
+	unsigned long line; /* number of the line read last, for the errors */
+	unsigned char tapped[16]; /* keys to release on the next frame */
+
+	/* next event, not applied yet */
+	int pending;
+	unsigned long frame;
+	char action[16];
+	int key;
+} input_script_t;
+
+/*!
+ * \brief Open a script
+ *
+ * \param script the script to initialize
+ * \param path the script file
+ *
+ * \return 0 if everything goes well, -1 otherwise
+ */
+int input_script_open(input_script_t *script, const char *path);
+
+/*!
+ * \brief Apply the events of a frame
+ * The frames must be given in increasing order, the events of the skipped
+ * frames are applied too.
+ *
+ * \param script an open script
+ * \param frame the frame
+ * \param keys the 16 keys of the chip8, updated
+ *
+ * \return the WINDOW_EVENT_XXX flags of the events, -1 if the script is
+ * invalid
+ */
+int input_script_step(input_script_t *script, unsigned long frame, unsigned char *keys);
+
+/*!
+ * \brief Close a script
+ *
+ * \param script an open script
+ */
+void input_script_close(input_script_t *script);
+
+#endif /* _INPUT_SCRIPT_H_ */
@@ -0,0 +1,97 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vm.h"
+#include "histogram.h"
+
+/*
+ * Input to display latency.
+ * Each change of a key seen after handle_event gets a tag, stored in
+ * chip8->key_tag. The chip8 carries the tags itself: EX9E, EXA1 and FX0A
+ * copy the tag of the key they read to read_tag, then the next DXYN or 00E0
+ * changing the screen copies read_tag to draw_tag. The host timestamps the
+ * tags when they move, and the latency of a key change is complete when a
+ * screen holding draw_tag is presented by update_window.
+ * The changes are consumed in order: reading a key also consumes the older
+ * changes of the other keys.
+ */
+
+/* key changes followed at once, the older ones are forgotten */
+#define LATENCY_PENDING 64
+
+/* Timestamps of a key change, in ns */
+typedef struct latency_pending_s {
+	uint64_t input; /* when the change was seen */
+	uint64_t read;  /* end of the frame which read it */
+	uint64_t draw;  /* end of the frame which drew the result */
+} latency_pending_t;
+
+typedef struct latency_s {
+	unsigned char keys[16]; /* chip8->key at the last latency_input */
+	uint32_t tag;       /* of the last key change */
+	uint32_t read;      /* last chip8->read_tag seen */
+	uint32_t drawn;     /* last chip8->draw_tag seen */
+	uint32_t presented; /* last tag shown on the screen */
+	latency_pending_t pending[LATENCY_PENDING]; /* indexed by tag % LATENCY_PENDING */
+	/* changes forgotten before being shown: never read by the program, or
+	 * too many changes at once */
+	uint64_t lost;
+
+	histogram_t input_read;   /* waiting for the chip8 to read the key */
+	histogram_t read_draw;    /* the game reacting to the key */
+	histogram_t draw_present; /* waiting for update_window */
+	histogram_t total;        /* from the key change to the screen */
+} latency_t;
+
+/*!
+ * \brief Initialize the latency statistics
+ *
+ * \param latency the statistics to initialize
+ */
+void latency_init(latency_t *latency);
+
+/*!
+ * \brief Tag the keys changed by handle_event
+ *
+ * \param latency initialized statistics
+ * \param chip8 the chip8, just after handle_event filled its keys
+ */
+void latency_input(latency_t *latency, chip8_t *chip8);
+
+/*!
+ * \brief Timestamp the tags the chip8 moved during the last frame
+ *
+ * \param latency initialized statistics
+ * \param chip8 the chip8, just after emulating a frame
+ */
+void latency_emulated(latency_t *latency, const chip8_t *chip8);
+
+/*!
+ * \brief Record the latency of the changes drawn on the screen
+ *
+ * \param latency initialized statistics
+ */
+void latency_presented(latency_t *latency);
+
+/*!
+ * \brief Print a summary of the latencies
+ *
+ * \param latency initialized statistics
+ * \param file where to print
+ * \param backend name of the window backend, the latency depends on it
+ */
+void latency_report(const latency_t *latency, FILE *file, const char *backend);
+
+/*!
+ * \brief Write the whole histograms, see histogram_export
+ *
+ * \param latency initialized statistics
+ * \param file where to write
+ * \param backend name of the window backend, the latency depends on it
+ */
+void latency_export(const latency_t *latency, FILE *file, const char *backend);
+
+#endif /* _LATENCY_H_ */
@@ -0,0 +1,102 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdint.h>
+
+/*
+ * Live counters of a running emulator, published in a small shared memory
+ * page, /dev/shm/c8metrics.PID, and shown by tools/c8top.
+ * The emulator counts in its own metrics_counters_t and copies them to the
+ * page with metrics_publish a few times per second, so reading the page
+ * never slows the emulation down. The copies are protected by a seqlock:
+ * the sequence is odd while the writer copies, and a reader retries when
+ * the sequence was odd or changed during its own copy.
+ * The page is removed by metrics_close, the page of a crashed emulator stays
+ * until its pid is reused.
+ */
+#define METRICS_DIR "/dev/shm"
+#define METRICS_PREFIX "c8metrics."
+#define METRICS_MAGIC "C8MT"
+#define METRICS_VERSION 1
+/* how often the emulators publish, in ns */
+#define METRICS_PERIOD 100000000ULL
+
+/* metrics_counters_t.flags */
+#define METRICS_TURBO  0x1 /* not limited to the real speed */
+#define METRICS_HALTED 0x2 /* the chip8 stopped after an error */
+#define METRICS_DEBUG  0x4 /* stopped in the debugger */
+
+typedef struct metrics_counters_s {
+	uint64_t start; /* CLOCK_MONOTONIC when the emulation started, in ns */
+	uint64_t now;   /* when the counters were published */
+	uint64_t cycles;    /* instructions emulated */
+	uint64_t frames;    /* frames emulated */
+	uint64_t presented; /* frames drawn by update_window */
+	uint64_t dropped;   /* frames skipped because the emulator was late */
+	uint64_t vm_ns;     /* time spent emulating */
+	uint64_t update_ns; /* time spent in update_window */
+	uint64_t event_ns;  /* time spent in handle_event */
+	uint32_t speed; /* emulation speed in thousandths of the real speed */
+	uint32_t flags; /* METRICS_XXX */
+} metrics_counters_t;
+
+/* The shared page, the counters are only read through metrics_read */
+typedef struct metrics_page_s {
+	char magic[4]; /* written last, the page is ready */
+	uint32_t version;
+	uint32_t pid;
+	uint32_t seq; /* seqlock of the counters */
+	char game[64];
+	char backend[16];
+	metrics_counters_t counters;
+} metrics_page_t;
+
+/*!
+ * \brief Create the page of this process
+ *
+ * \param game name of the game, truncated to fit
+ * \param backend name of the window backend
+ *
+ * \return the page, NULL on error
+ */
+metrics_page_t *metrics_open(const char *game, const char *backend);
+
+/*!
+ * \brief Copy the counters to the page, never blocks
+ *
+ * \param page the page of this process, NULL is ignored
+ * \param counters the current counters
+ */
+void metrics_publish(metrics_page_t *page, const metrics_counters_t *counters);
+
+/*!
+ * \brief Remove the page of this process, NULL is ignored
+ */
+void metrics_close(metrics_page_t *page);
+
+/*!
+ * \brief Map the page of another process, read only
+ *
+ * \param name the name of the page in METRICS_DIR
+ *
+ * \return the page, NULL if it is not a valid page
+ */
+const metrics_page_t *metrics_map(const char *name);
+
+/*!
+ * \brief Unmap a page mapped by metrics_map
+ */
+void metrics_unmap(const metrics_page_t *page);
+
+/*!
+ * \brief Get a consistent copy of the counters of a page
+ *
+ * \param page a mapped page
+ * \param counters filled with the counters
+ *
+ * \return 0 if everything goes well, -1 if the writer never finished its
+ * copy (it died while writing)
+ */
+int metrics_read(const metrics_page_t *page, metrics_counters_t *counters);
+
+#endif /* _METRICS_H_ */
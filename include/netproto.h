@@ -0,0 +1,123 @@
+#ifndef _NETPROTO_H_
+#define _NETPROTO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Binary protocol of the NET backend (src/gfx/NET) and of its clients.
+ * Every message is a NETPROTO_HEADER_SIZE bytes header followed by length
+ * bytes of payload, all the integers are big endian.
+ *
+ * A FRAME payload is a list of rows: the y coordinate on one byte followed
+ * by the pixels of the row encoded with rle_encode (see include/rle.h). A
+ * key frame holds all the rows, the other frames only the rows changed since
+ * the previous frame, possibly none: every frame is sent so the sequence
+ * numbers only jump when the server skipped frames for a late viewer.
+ *
+ * The multi-session server (server/) streams the same messages, once the
+ * client has created a session or attached to one: the first message of a
+ * client must be a CREATE or an ATTACH, answered by a SESSION followed by the
+ * HELLO, or by an ERROR.
+ */
+#define NETPROTO_VERSION 1
+#define NETPROTO_HEADER_SIZE 8
+/* used when CHIP8_NET is not set, nobody authenticates: local only */
+#define NETPROTO_DEFAULT_ADDR "tcp:localhost:8008"
+
+typedef enum netproto_type_e {
+	/* server -> client */
+	NETPROTO_HELLO = 1, /* version, width, height: one byte each */
+	NETPROTO_FRAME,     /* rows of pixels, seq is the frame number */
+	NETPROTO_STATUS,    /* status line, not nul terminated */
+	NETPROTO_SOUND,     /* one byte: the buzzer is on */
+	NETPROTO_SESSION,   /* seq is the number of the session of the client */
+	NETPROTO_ERROR,     /* reason, not nul terminated, then the server hangs up */
+	/* client -> server */
+	NETPROTO_KEY = 0x80, /* key, pressed: one byte each */
+	NETPROTO_TURBO,      /* toggle the turbo mode */
+	NETPROTO_QUIT,       /* stop the emulator, or the session on the server */
+	NETPROTO_CREATE,     /* new session: the CHIP8_PROFILE_XXX on one byte, then the ROM */
+	NETPROTO_ATTACH,     /* join the session numbered seq */
+} netproto_type_t;
+
+/* flags of a FRAME */
+#define NETPROTO_KEYFRAME 0x1 /* all the rows are present */
+
+typedef struct netproto_header_s {
+	uint8_t type; /* netproto_type_t */
+	uint8_t flags;
+	uint16_t length; /* of the payload */
+	uint32_t seq;
+} netproto_header_t;
+
+/* largest FRAME payload for a width x height screen */
+#define NETPROTO_FRAME_SIZE(width, height) ((height) * (1 + (width)))
+
+/*!
+ * \brief Serialize a header
+ *
+ * \param buf where to write, at least NETPROTO_HEADER_SIZE bytes
+ * \param hdr the header
+ */
+void netproto_write_header(unsigned char *buf, const netproto_header_t *hdr);
+
+/*!
+ * \brief Parse the header of the first message of a buffer
+ *
+ * \param buf the received bytes
+ * \param len number of bytes in buf
+ * \param hdr where the header is stored
+ *
+ * \return the size of the whole message if it is complete, 0 otherwise
+ */
+size_t netproto_read_header(const unsigned char *buf, size_t len, netproto_header_t *hdr);
+
+/*!
+ * \brief Encode the rows of a frame into a FRAME payload
+ *
+ * \param prev the previously sent pixels, NULL for a key frame
+ * \param cur the pixels to send, width pixels per row
+ * \param width width of the screen
+ * \param height height of the screen
+ * \param out where the payload is written, NETPROTO_FRAME_SIZE bytes
+ *
+ * \return the size of the payload
+ */
+size_t netproto_encode_frame(const unsigned char *prev, const unsigned char *cur,
+		int width, int height, unsigned char *out);
+
+/*!
+ * \brief Apply a FRAME payload to the pixels
+ *
+ * \param payload the payload of a FRAME message
+ * \param len the size of the payload
+ * \param gfx the pixels to update, width pixels per row
+ * \param width width of the screen
+ * \param height height of the screen
+ *
+ * \return 0 if everything goes well, -1 if the payload is invalid
+ */
+int netproto_decode_frame(const unsigned char *payload, size_t len,
+		unsigned char *gfx, int width, int height);
+
+/*!
+ * \brief Open a listening socket
+ *
+ * \param addr "unix:PATH", "tcp:PORT" or "tcp:HOST:PORT", the port alone
+ * listens on localhost, "tcp:*:PORT" on all the interfaces
+ *
+ * \return the socket, -1 on error
+ */
+int netproto_listen(const char *addr);
+
+/*!
+ * \brief Connect to a server
+ *
+ * \param addr same format as netproto_listen
+ *
+ * \return the socket, -1 on error
+ */
+int netproto_connect(const char *addr);
+
+#endif /* _NETPROTO_H_ */
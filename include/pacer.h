@@ -0,0 +1,87 @@
+#ifndef _PACER_H_
+#define _PACER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "histogram.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+
+/* never spin longer than this before a deadline */
+#define PACER_MAX_SPIN_NS 1000000ULL
+/* never catch up more frames than this at once */
+#define PACER_MAX_CATCH_UP 4
+
+/* What to do with the frames whose deadline is already over */
+typedef enum pacer_policy_e {
+	PACER_DROP,     /* skip them, the emulation slows down */
+	PACER_CATCH_UP, /* emulate them without drawing, up to PACER_MAX_CATCH_UP */
+} pacer_policy_t;
+
+/*
+ * Paces a loop at a fixed rate on absolute CLOCK_MONOTONIC deadlines, so the
+ * error of one sleep is not added to the next ones.
+ * The pacer sleeps with clock_nanosleep until just before the deadline, then
+ * spins for the end: the spin duration follows the oversleep measured on the
+ * previous frames, which keeps it well below a millisecond.
+ */
+typedef struct pacer_s {
+	uint64_t period;   /* duration of a frame in ns */
+	uint64_t deadline; /* end of the current frame */
+	uint64_t last;     /* when the previous pacer_wait returned */
+	uint64_t spin;     /* spin before the deadline */
+	pacer_policy_t policy;
+
+	uint64_t frames;  /* number of pacer_wait */
+	uint64_t missed;  /* deadlines already over when pacer_wait was called */
+	uint64_t dropped; /* frames skipped */
+
+	histogram_t frame_time; /* between two pacer_wait returns */
+	histogram_t oversleep;  /* how late clock_nanosleep wakes up */
+	histogram_t late;       /* how late the missed deadlines were reached */
+} pacer_t;
+
+/*!
+ * \brief Get the current time
+ *
+ * \return CLOCK_MONOTONIC, in nanoseconds
+ */
+uint64_t pacer_now(void);
+
+/*!
+ * \brief Initialize a pacer, the first deadline is one period from now
+ *
+ * \param pacer the pacer to initialize
+ * \param rate number of frames per second
+ * \param policy what to do of the late frames
+ */
+void pacer_init(pacer_t *pacer, unsigned rate, pacer_policy_t policy);
+
+/*!
+ * \brief Restart the deadlines from now, e.g. after a pause
+ * The statistics are kept.
+ *
+ * \param pacer an initialized pacer
+ */
+void pacer_reset(pacer_t *pacer);
+
+/*!
+ * \brief Wait for the end of the current frame
+ *
+ * \param pacer an initialized pacer
+ *
+ * \return the number of frames to emulate before the next call: 1, or more
+ * when catching up missed deadlines
+ */
+unsigned pacer_wait(pacer_t *pacer);
+
+/*!
+ * \brief Print the timing statistics
+ *
+ * \param pacer an initialized pacer
+ * \param file where to print
+ */
+void pacer_report(const pacer_t *pacer, FILE *file);
+
+#endif /* _PACER_H_ */
@@ -0,0 +1,166 @@
+#ifndef _RING_H_
+#define _RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Lock-free single producer / single consumer ring of fixed size elements.
+ * The producer only writes head and the consumer only writes tail, so the
+ * two sides can run in different threads without any lock.
+ */
+typedef struct ring_s {
+	uint32_t head; /* next slot written by the producer */
+	char pad_head[60]; /* keep head and tail on their own cache line */
+	uint32_t tail; /* next slot read by the consumer */
+	char pad_tail[60];
+
+	uint32_t mask; /* number of slots - 1 */
+	uint32_t elem_size;
+	unsigned char *buf;
+} ring_t;
+
+/*!
+ * \brief Initialize a ring
+ *
+ * \param ring the ring to initialize
+ * \param elem_size size of one element in bytes
+ * \param count number of elements, must be a power of two
+ *
+ * \return 0 if everything goes well, -1 otherwise
+ */
+int ring_init(ring_t *ring, size_t elem_size, size_t count);
+
+/*!
+ * \brief Free the memory of a ring
+ *
+ * \param ring an initialized ring
+ */
+void ring_destroy(ring_t *ring);
+
+/*!
+ * \brief Forget all the elements of a ring
+ * Only safe when neither the producer nor the consumer are running.
+ */
+static inline void ring_reset(ring_t *ring)
+{
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+/*!
+ * \brief Number of elements waiting in the ring
+ */
+static inline uint32_t ring_count(const ring_t *ring)
+{
+	return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)
+		- __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/*!
+ * \brief Get the slot of the next element to push, producer side
+ * Fill the slot then call ring_commit to publish it.
+ *
+ * \return the slot, NULL if the ring is full
+ */
+static inline void *ring_reserve(ring_t *ring)
+{
+	uint32_t head = ring->head;
+
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask)
+		return NULL;
+	return ring->buf + (size_t)(head & ring->mask) * ring->elem_size;
+}
+
+/*!
+ * \brief Publish the slot returned by ring_reserve, producer side
+ */
+static inline void ring_commit(ring_t *ring)
+{
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/*!
+ * \brief Get the oldest element, consumer side
+ * Call ring_release once done with it.
+ *
+ * \return the element, NULL if the ring is empty
+ */
+static inline void *ring_peek(ring_t *ring)
+{
+	uint32_t tail = ring->tail;
+
+	if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+		return NULL;
+	return ring->buf + (size_t)(tail & ring->mask) * ring->elem_size;
+}
+
+/*!
+ * \brief Free the slot returned by ring_peek, consumer side
+ */
+static inline void ring_release(ring_t *ring)
+{
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+/*!
+ * \brief Get the oldest elements stored contiguously, consumer side
+ * Call ring_release_many once done with them.
+ *
+ * \param ring the ring
+ * \param count where the number of elements is stored, 0 if it is empty
+ *
+ * \return the first element
+ */
+static inline void *ring_peek_many(ring_t *ring, uint32_t *count)
+{
+	uint32_t tail = ring->tail;
+	uint32_t available = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+	uint32_t contiguous = ring->mask + 1 - (tail & ring->mask);
+
+	*count = available < contiguous ? available : contiguous;
+	return ring->buf + (size_t)(tail & ring->mask) * ring->elem_size;
+}
+
+/*!
+ * \brief Free the count slots returned by ring_peek_many, consumer side
+ */
+static inline void ring_release_many(ring_t *ring, uint32_t count)
+{
+	__atomic_store_n(&ring->tail, ring->tail + count, __ATOMIC_RELEASE);
+}
+
+/*!
+ * \brief Copy an element into the ring, producer side
+ *
+ * \return 0 if everything goes well, -1 if the ring is full
+ */
+static inline int ring_push(ring_t *ring, const void *elem)
+{
+	void *slot = ring_reserve(ring);
+
+	if (slot == NULL)
+		return -1;
+	memcpy(slot, elem, ring->elem_size);
+	ring_commit(ring);
+	return 0;
+}
+
+/*!
+ * \brief Copy the oldest element out of the ring, consumer side
+ *
+ * \return 0 if everything goes well, -1 if the ring is empty
+ */
+static inline int ring_pop(ring_t *ring, void *elem)
+{
+	void *slot = ring_peek(ring);
+
+	if (slot == NULL)
+		return -1;
+	memcpy(elem, slot, ring->elem_size);
+	ring_release(ring);
+	return 0;
+}
+
+#endif /* _RING_H_ */
@@ -0,0 +1,66 @@
+#ifndef _RLE_H_
+#define _RLE_H_
+
+#include <stddef.h>
+
+/*
+ * Run-length encoding of monochrome pixels: one byte per run, the high bit
+ * is the value of the pixels and the 7 low bits the length of the run - 1.
+ * The encoded size is never more than the number of pixels.
+ */
+#define RLE_MAX_RUN 128
+
+/*!
+ * \brief Encode pixels
+ *
+ * \param pixels the pixels, any non-zero value is set
+ * \param n number of pixels
+ * \param out where the runs are written, at least n bytes
+ *
+ * \return the number of bytes written
+ */
+size_t rle_encode(const unsigned char *pixels, size_t n, unsigned char *out);
+
+/*!
+ * \brief Decode pixels
+ *
+ * \param in the runs
+ * \param len number of bytes available in in
+ * \param pixels where the pixels (0 or 1) are written
+ * \param n number of pixels to decode
+ *
+ * \return the number of bytes read from in, 0 if the runs are invalid
+ */
+size_t rle_decode(const unsigned char *in, size_t len, unsigned char *pixels, size_t n);
+
+/*
+ * Run-length encoding of bytes (PackBits): a control byte c < 128 is followed
+ * by c + 1 literal bytes, a control byte c >= 128 by one byte repeated
+ * c - 125 times (3 to 130). In the worst case the size grows by 1 / 128.
+ */
+#define RLE_BYTES_MAX_SIZE(n) ((n) + ((n) + 127) / 128)
+
+/*!
+ * \brief Encode bytes
+ *
+ * \param in the bytes
+ * \param n number of bytes
+ * \param out where the runs are written, at least RLE_BYTES_MAX_SIZE(n) bytes
+ *
+ * \return the number of bytes written
+ */
+size_t rle_encode_bytes(const unsigned char *in, size_t n, unsigned char *out);
+
+/*!
+ * \brief Decode bytes
+ *
+ * \param in the runs
+ * \param len number of bytes available in in
+ * \param out where the bytes are written
+ * \param n number of bytes to decode
+ *
+ * \return the number of bytes read from in, 0 if the runs are invalid
+ */
+size_t rle_decode_bytes(const unsigned char *in, size_t len, unsigned char *out, size_t n);
+
+#endif /* _RLE_H_ */
@@ -0,0 +1,125 @@
+#ifndef _ROMPACK_H_
+#define _ROMPACK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "vm.h"
+
+/*
+ * ROM pack: many games in one file, mapped in memory so a batch of runs
+ * starts without opening and reading one file per game.
+ *
+ * The file starts with a ROMPACK_HEADER_SIZE bytes header: ROMPACK_MAGIC,
+ * the version on one byte, three zero bytes and the number of games on four
+ * bytes. It is followed by the index, one ROMPACK_ENTRY_SIZE bytes record
+ * per game sorted by name: the name padded with zeros on ROMPACK_NAME bytes,
+ * the FNV-1a hash of the game on eight bytes, the offset of the game from
+ * the beginning of the file on four bytes, its size on two bytes, the quirk
+ * profile on one byte, a zero byte, then the key map on 16 bytes. The games
+ * follow the index. All the integers are big endian.
+ * The key map gives the chip8 key pressed by each key of the host, so a game
+ * expecting odd keys can be played with the usual ones.
+ */
+#define ROMPACK_MAGIC "C8PK"
+#define ROMPACK_VERSION 1
+#define ROMPACK_HEADER_SIZE 12
+#define ROMPACK_ENTRY_SIZE 64
+/* with the final zero */
+#define ROMPACK_NAME 32
+
+/* A pack mapped in memory */
+typedef struct rompack_s {
+	const unsigned char *base;
+	size_t size;
+	uint32_t count; /* number of games */
+} rompack_t;
+
+/* A game of a pack, pointing into the mapping */
+typedef struct rompack_entry_s {
+	const char *name;
+	uint64_t hash;
+	const unsigned char *rom;
+	size_t size;
+	int profile; /* CHIP8_PROFILE_XXX */
+	const unsigned char *keys; /* key map, keys[host key] = chip8 key */
+} rompack_entry_t;
+
+/*!
+ * \brief Map a pack in memory and check its index
+ * The games themselves are only read when they are loaded.
+ *
+ * \param pack the pack to fill
+ * \param path the file of the pack
+ *
+ * \return 0 if everything goes well, -1 otherwise (errno is EINVAL when the
+ * file is not a valid pack)
+ */
+int rompack_open(rompack_t *pack, const char *path);
+
+/*!
+ * \brief Unmap a pack, its entries are no longer valid
+ */
+void rompack_close(rompack_t *pack);
+
+/*!
+ * \brief Get a game by its position in the index
+ *
+ * \param pack an open pack
+ * \param index less than pack->count, the games are sorted by name
+ * \param entry filled with the game
+ */
+void rompack_entry(const rompack_t *pack, uint32_t index, rompack_entry_t *entry);
+
+/*!
+ * \brief Find a game by its name, with a binary search of the index
+ *
+ * \param pack an open pack
+ * \param name the name of the game
+ * \param entry filled with the game
+ *
+ * \return 0 if the game was found, -1 otherwise
+ */
+int rompack_find(const rompack_t *pack, const char *name, rompack_entry_t *entry);
+
+/*!
+ * \brief Load a game in a chip8 and select its quirk profile
+ *
+ * \param chip8 an initialized chip8
+ * \param entry a game of an open pack
+ *
+ * \return 0 if everything goes well, -1 otherwise
+ */
+int rompack_load(chip8_t *chip8, const rompack_entry_t *entry);
+
+/*!
+ * \brief Translate the keys of the host with the key map of a game
+ *
+ * \param entry a game of an open pack
+ * \param host the 16 keys filled by handle_event
+ * \param key the 16 keys of the chip8, overwritten
+ */
+void rompack_map_keys(const rompack_entry_t *entry, const unsigned char *host, unsigned char *key);
+
+/*!
+ * \brief Check the hash of a game, this reads the whole game
+ *
+ * \return 0 if the game is intact, -1 otherwise
+ */
+int rompack_verify(const rompack_entry_t *entry);
+
+/*!
+ * \brief Write a pack
+ * The hashes are computed, entries[i].hash is ignored, and a NULL key map
+ * is the identity.
+ *
+ * \param file where to write
+ * \param entries the games, sorted by name without duplicates
+ * \param count number of games
+ *
+ * \return 0 if everything goes well, -1 otherwise (errno is EINVAL when an
+ * entry cannot be stored)
+ */
+int rompack_write(FILE *file, const rompack_entry_t *entries, uint32_t count);
+
+#endif /* _ROMPACK_H_ */
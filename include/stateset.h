@@ -0,0 +1,54 @@
+#ifndef _STATESET_H_
+#define _STATESET_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Set of state hashes (see chip8_state_hash) shared by several threads
+ * without any lock: open addressing with linear probing, the empty slots
+ * are claimed with a compare and swap. It has a fixed capacity and never
+ * removes anything, which is all the explorers need.
+ */
+typedef struct stateset_s {
+	uint64_t *slots; /* 0 is an empty slot */
+	size_t mask; /* number of slots - 1 */
+	size_t count; /* number of hashes inserted */
+} stateset_t;
+
+/*!
+ * \brief Initialize an empty set
+ *
+ * \param set the set to initialize
+ * \param bits the set has 2^bits slots, it is full at 3/4 of them
+ *
+ * \return 0 if everything goes well, -1 otherwise
+ */
+int stateset_init(stateset_t *set, unsigned bits);
+
+/*!
+ * \brief Free the memory of a set
+ *
+ * \param set an initialized set
+ */
+void stateset_destroy(stateset_t *set);
+
+/*!
+ * \brief Add a hash, can be called by several threads at once
+ *
+ * \param set an initialized set
+ * \param hash the hash
+ *
+ * \return 1 if it was added, 0 if it was already there, -1 if the set is full
+ */
+int stateset_insert(stateset_t *set, uint64_t hash);
+
+/*!
+ * \brief Number of hashes in a set
+ */
+static inline size_t stateset_count(const stateset_t *set)
+{
+	return __atomic_load_n(&set->count, __ATOMIC_RELAXED);
+}
+
+#endif /* _STATESET_H_ */
@@ -0,0 +1,103 @@
+#ifndef _TIMERWHEEL_H_
+#define _TIMERWHEEL_H_
+
+#include <stdint.h>
+
+/*
+ * Hierarchical timer wheel: TIMERWHEEL_LEVELS wheels of TIMERWHEEL_SLOTS
+ * slots, each slot of a level covering a whole turn of the level below.
+ * Adding and removing a timer is O(1) whatever the number of timers, and a
+ * timer only moves down to the level below when its turn is coming
+ * (cascading), so the far timers cost nothing until then.
+ * The time is counted in ticks, the unit is chosen by the user. Not thread
+ * safe: each thread has its own wheel.
+ */
+#define TIMERWHEEL_BITS   6
+#define TIMERWHEEL_SLOTS  (1u << TIMERWHEEL_BITS)
+#define TIMERWHEEL_LEVELS 4
+/* the farthest timers are clamped to this delay */
+#define TIMERWHEEL_MAX_DELAY ((1ULL << (TIMERWHEEL_BITS * TIMERWHEEL_LEVELS)) - 1)
+
+typedef struct wheel_timer_s {
+	struct wheel_timer_s *next;
+	struct wheel_timer_s **pprev; /* NULL when the timer is not pending */
+	uint64_t expires; /* tick when the timer fires */
+	unsigned level;
+	void (*expire)(void *data); /* called when the timer fires */
+	void *data;
+} wheel_timer_t;
+
+typedef struct timerwheel_s {
+	uint64_t now; /* all the timers up to this tick have fired */
+	unsigned count[TIMERWHEEL_LEVELS]; /* pending timers on each level */
+	wheel_timer_t *slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+} timerwheel_t;
+
+/*!
+ * \brief Initialize an empty wheel
+ *
+ * \param wheel the wheel to initialize
+ * \param now the current tick
+ */
+void timerwheel_init(timerwheel_t *wheel, uint64_t now);
+
+/*!
+ * \brief Initialize a timer, not pending
+ *
+ * \param timer the timer to initialize
+ * \param expire called with data when the timer fires
+ * \param data given to expire
+ */
+void timerwheel_timer_init(wheel_timer_t *timer, void (*expire)(void *data), void *data);
+
+/*!
+ * \brief Schedule a timer, or move it if it is already pending
+ *
+ * \param wheel an initialized wheel
+ * \param timer an initialized timer
+ * \param expires the tick when it fires, the next tick if it is already over
+ */
+void timerwheel_add(timerwheel_t *wheel, wheel_timer_t *timer, uint64_t expires);
+
+/*!
+ * \brief Cancel a timer, nothing is done if it is not pending
+ *
+ * \param wheel the wheel of the timer
+ * \param timer an initialized timer
+ */
+void timerwheel_del(timerwheel_t *wheel, wheel_timer_t *timer);
+
+/*!
+ * \brief Tell if a timer is scheduled
+ *
+ * \param timer an initialized timer
+ *
+ * \return 1 if it is pending, 0 otherwise
+ */
+static inline int timerwheel_pending(const wheel_timer_t *timer)
+{
+	return timer->pprev != NULL;
+}
+
+/*!
+ * \brief Fire all the timers expired up to now
+ * The callbacks can add and remove any timer, including the one firing.
+ *
+ * \param wheel an initialized wheel
+ * \param now the current tick
+ *
+ * \return the number of timers fired
+ */
+unsigned timerwheel_advance(timerwheel_t *wheel, uint64_t now);
+
+/*!
+ * \brief Get how long the owner of the wheel can sleep
+ *
+ * \param wheel an initialized wheel
+ *
+ * \return the number of ticks until the next timer fires, or until the
+ * next cascade which may bring one closer, UINT64_MAX if there is no timer
+ */
+uint64_t timerwheel_next(const timerwheel_t *wheel);
+
+#endif /* _TIMERWHEEL_H_ */
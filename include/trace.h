@@ -0,0 +1,149 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "vm.h"
+#include "ring.h"
+
+/*
+ * Binary trace of the executed instructions.
+ * The file starts with a TRACE_HEADER_SIZE bytes header: TRACE_MAGIC, the
+ * version, the quirk profile, then TRACE_BYTE_ORDER on two bytes in the byte
+ * order of the entries (the one of the host which wrote them).
+ * It is followed by one 16 bytes entry per instruction, plus one more entry
+ * when the instruction changed more than 4 registers (FX65).
+ */
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 8
+#define TRACE_BYTE_ORDER 0x0102
+/* entries waiting for the writer thread, must be a power of two */
+#define TRACE_QUEUE (1 << 18)
+/* flag in pc: the next entry holds the values of the other changed registers */
+#define TRACE_CONTINUED 0x8000
+
+typedef union trace_entry_u {
+	struct {
+		uint32_t cycle; /* number of the instruction, modulo 2^32 */
+		uint16_t pc; /* address of the instruction, and TRACE_CONTINUED */
+		uint16_t opcode;
+		uint16_t I; /* after the instruction */
+		uint16_t changed; /* bit X is set when VX was changed */
+		uint8_t values[4]; /* new values of the first changed registers */
+	} insn;
+	struct {
+		uint32_t cycle; /* the same as the previous entry */
+		uint8_t values[12]; /* new values of the next changed registers */
+	} more;
+} trace_entry_t;
+
+typedef struct trace_s {
+	ring_t queue; /* of trace_entry_t */
+	uint32_t cycle; /* number of the next instruction */
+	unsigned long stalls; /* number of times the VM waited for the writer */
+
+	FILE *file;
+	pthread_t writer;
+	int stop;
+	int error; /* a write failed */
+} trace_t;
+
+/*!
+ * \brief Start tracing the instructions executed by a chip8
+ * The chip8 switches to the instrumented interpreters, the entries are
+ * written by a new thread.
+ *
+ * \param chip8 an initialized chip8, with its quirk profile set
+ * \param path the file to create
+ *
+ * \return 0 if everything goes well, -1 otherwise
+ */
+int trace_start(chip8_t *chip8, const char *path);
+
+/*!
+ * \brief Stop tracing, write the queued entries and close the file
+ *
+ * \param chip8 a traced chip8
+ *
+ * \return 0 if everything goes well, -1 if the file could not be written
+ */
+int trace_stop(chip8_t *chip8);
+
+/*!
+ * \brief Wait until the writer makes room in the queue
+ *
+ * \param trace an open trace
+ *
+ * \return the reserved entry
+ */
+trace_entry_t *trace_wait(trace_t *trace);
+
+/* Reserve the next entry of the queue */
+static inline trace_entry_t *trace_reserve(trace_t *trace)
+{
+	trace_entry_t *entry = ring_reserve(&trace->queue);
+
+	return entry != NULL ? entry : trace_wait(trace);
+}
+
+/*!
+ * \brief Record an instruction, called by the instrumented interpreters
+ *
+ * \param trace an open trace
+ * \param chip8 the chip8, after the instruction
+ * \param pc address of the instruction
+ * \param V the registers before the instruction
+ */
+static inline void trace_record(trace_t *trace, const chip8_t *chip8, uint16_t pc,
+		const unsigned char *V)
+{
+	trace_entry_t *entry = trace_reserve(trace);
+	uint64_t before[2], after[2];
+	uint16_t changed = 0;
+
+	// most instructions change no register, compare them 8 at a time first
+	memcpy(before, V, sizeof(before));
+	memcpy(after, chip8->V, sizeof(after));
+	if (before[0] != after[0] || before[1] != after[1])
+		for (unsigned x = 0; x < 16; x++)
+			if (V[x] != chip8->V[x])
+				changed = (uint16_t)(changed | 1u << x);
+
+	entry->insn.cycle = trace->cycle;
+	entry->insn.pc = pc;
+	entry->insn.opcode = chip8->opcode;
+	entry->insn.I = chip8->I;
+	entry->insn.changed = changed;
+	memset(entry->insn.values, 0, sizeof(entry->insn.values));
+	if (changed != 0)
+	{
+		uint8_t *values = entry->insn.values;
+		unsigned room = sizeof(entry->insn.values);
+
+		for (unsigned x = 0; changed >> x != 0; x++)
+		{
+			if (!(changed >> x & 1))
+				continue;
+			if (room == 0)
+			{
+				// more than 4 registers: continue in the next entry
+				entry->insn.pc |= TRACE_CONTINUED;
+				ring_commit(&trace->queue);
+				entry = trace_reserve(trace);
+				entry->more.cycle = trace->cycle;
+				values = entry->more.values;
+				room = sizeof(entry->more.values);
+				memset(values, 0, room);
+			}
+			*values++ = chip8->V[x];
+			room--;
+		}
+	}
+	ring_commit(&trace->queue);
+	trace->cycle++;
+}
+
+#endif /* _TRACE_H_ */
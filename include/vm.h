@@ -5,12 +5,85 @@
 #include <stdio.h>
 
 #include "window.h"
+#include "ring.h"
 
 extern const unsigned char chip8_fontset[];
 
+/* the timers and the display run at 60Hz, this is our unit of real time */
+#define CHIP8_FRAME_RATE 60
+/* number of instructions executed during one emulated frame (~600Hz) */
+#define CHIP8_CYCLES_PER_FRAME 10
+/* bytes of code read by the longest superinstruction, see src/vm.c */
+#define CHIP8_DECODE_SPAN 8
+
+/*
+ * Quirk profiles: the behaviour of a few instructions differs between the
+ * chip8 variants, see include/vm_ops.h.
+ * These are macros so they can be used by the preprocessor.
+ */
+#define CHIP8_PROFILE_DEFAULT 0 /* historical behaviour of this emulator */
+#define CHIP8_PROFILE_VIP     1 /* original COSMAC VIP interpreter */
+#define CHIP8_PROFILE_SCHIP   2 /* SUPER-CHIP */
+#define CHIP8_PROFILE_COUNT   3
+#define CHIP8_PROFILE_NAMES { "default", "vip", "schip" }
+
+/*
+ * Execution engines, they must all behave exactly the same, see
+ * tools/c8lockstep.c
+ */
+#define CHIP8_ENGINE_FAST      0 /* decoding cache and superinstructions */
+#define CHIP8_ENGINE_REFERENCE 1 /* one instruction at a time, decoded each time */
+#define CHIP8_ENGINE_COUNT     2
+#define CHIP8_ENGINE_NAMES { "fast", "reference" }
+
+/* initial state of the random number generator of CXNN, see chip8_seed */
+#define CHIP8_RANDOM_SEED 0x2545F491
+
+/* number of events the host can leave in the queue, see chip8_poll_event */
+#define CHIP8_EVENT_QUEUE 64
+
+/* What the chip8 reports to the host */
+typedef enum chip8_event_type_e {
+	CHIP8_EVENT_SOUND_START, /* the buzzer starts */
+	CHIP8_EVENT_SOUND_STOP,  /* the buzzer stops */
+	CHIP8_EVENT_UNKNOWN_OPCODE,
+	CHIP8_EVENT_STACK_OVERFLOW,  /* more than 16 nested calls */
+	CHIP8_EVENT_STACK_UNDERFLOW, /* return without call */
+	CHIP8_EVENT_PC_OVERFLOW, /* pc went past the end of the memory */
+	CHIP8_EVENT_ADDRESS_OVERFLOW, /* I + offset went past the end of the memory */
+	CHIP8_EVENT_OUT_OF_MEMORY, /* a shared page could not be copied for a write */
+	CHIP8_EVENT_HALTED, /* the chip8 stopped after one of the errors above */
+} chip8_event_type_t;
+
+typedef struct chip8_event_s {
+	uint16_t type; /* chip8_event_type_t */
+	uint16_t pc; /* address of the instruction which raised it */
+	uint16_t opcode; /* the instruction which raised it */
+} chip8_event_t;
+
+/*
+ * The memory is split in pages shared by the chip8 running the same ROM
+ * (see chip8_clone): a page is only copied when one of them writes it.
+ * The pages never written, like the font and the ROM code, stay shared by
+ * all of them.
+ */
+#define CHIP8_MEMORY_SIZE 0x1000
+#define CHIP8_PAGE_BITS   8
+#define CHIP8_PAGE_SIZE   (1u << CHIP8_PAGE_BITS)
+#define CHIP8_PAGE_COUNT  (CHIP8_MEMORY_SIZE / CHIP8_PAGE_SIZE)
+
+/* the games are loaded at CHIP8_ROM_START, up to the stack area at 0xEA0 */
+#define CHIP8_ROM_START 0x200
+#define CHIP8_ROM_MAX   (0xEA0 - CHIP8_ROM_START)
+
+typedef struct chip8_page_s {
+	unsigned refs; /* number of chip8 using the page, 0 for the static pages */
+	unsigned char bytes[CHIP8_PAGE_SIZE];
+} chip8_page_t;
+
 typedef struct chip8_s {
 	uint16_t opcode; /* all the instruction are on two bytes */
-	unsigned char memory[0x1000]; /* 4ko for the chip8 */
+	chip8_page_t *pages[CHIP8_PAGE_COUNT]; /* 4ko for the chip8, see chip8_read */
 	unsigned char V[16]; /* 15 register + one carry flag*/
 	uint16_t I; /* index register */
 	uint16_t pc; /* program counter */
@@ -23,9 +96,75 @@ typedef struct chip8_s {
 	unsigned char key[16]; /* which key are pressed */
 	unsigned char gfx[64 * 32]; /* pixel array */
 
+	unsigned char decoded[0x1000]; /* decoded instruction at each address */
+	unsigned char profile; /* CHIP8_PROFILE_XXX, select the interpreter */
+	unsigned char halted; /* stopped by an error, nothing is executed anymore */
+	unsigned char engine; /* CHIP8_ENGINE_XXX */
+	uint32_t random; /* state of the random number generator, never 0 */
+
+	/* XOR of the chip8_cell_hash of each byte, updated on every write */
+	uint64_t memory_hash;
+	uint64_t gfx_hash;
+
+	/* follow the key changes up to the screen, see include/latency.h */
+	uint32_t key_tag[16]; /* tag of the last change of each key, set by the host */
+	uint32_t read_tag; /* highest key_tag read by EX9E, EXA1 or FX0A */
+	uint32_t draw_tag; /* read_tag when the screen last changed */
+
+	ring_t events; /* chip8_event_t for the host */
+	struct chip8_debug_s *debug; /* NULL unless a debugger is attached, see include/debug.h */
+	struct trace_s *trace; /* NULL unless the execution is traced, see include/trace.h */
+
 	window_t *window;
 } chip8_t;
 
+/*!
+ * \brief Read a byte of the memory
+ *
+ * \param chip8 an initialized chip8
+ * \param addr an address below CHIP8_MEMORY_SIZE
+ */
+static inline unsigned char chip8_read(const chip8_t *chip8, unsigned addr)
+{
+	return chip8->pages[addr >> CHIP8_PAGE_BITS]->bytes[addr & (CHIP8_PAGE_SIZE - 1)];
+}
+
+/*!
+ * \brief Give a private copy of a shared page to a chip8, before writing it
+ *
+ * \param chip8 an initialized chip8
+ * \param index the number of the page
+ *
+ * \return 0 if everything goes well, -1 if the memory is exhausted
+ */
+int chip8_page_unshare(chip8_t *chip8, unsigned index);
+
+/* the pixels follow the memory in the numbering of the cells */
+#define CHIP8_GFX_CELL(pos) (0x1000u + (unsigned)(pos))
+
+/*!
+ * \brief Hash of one byte of the memory or of the screen
+ * The state hash is the XOR of the hashes of all the cells, so a write only
+ * removes the hash of the old value and adds the one of the new value.
+ *
+ * \param cell the address in the memory, or CHIP8_GFX_CELL(pixel)
+ * \param value the byte stored in the cell
+ *
+ * \return the hash, 0 for 0 so the blank memory and screen hash to 0
+ */
+static inline uint64_t chip8_cell_hash(unsigned cell, unsigned value)
+{
+	uint64_t x;
+
+	if (value == 0)
+		return 0;
+	// splitmix64 finalizer
+	x = ((uint64_t)cell << 8 | value) + 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
 /*!
  * \brief Initialize a new chip8 structure
  * Malloc a new chip8 structure and initialize all it's internal values / timer
@@ -34,6 +173,28 @@ typedef struct chip8_s {
  */
 chip8_t *chip8_init(void);
 
+/*!
+ * \brief Create a chip8 in the same state as another
+ * The memory pages are shared until one of the two writes them, so
+ * loading a ROM once then cloning it for each instance saves most of the
+ * memory. The events, debugger and trace are not copied.
+ *
+ * \param chip8 an initialized chip8, not running while it is cloned
+ *
+ * \return the new chip8, NULL if the memory is exhausted
+ */
+chip8_t *chip8_clone(const chip8_t *chip8);
+
+/*!
+ * \brief Put a chip8 in the same state as another
+ * Like chip8_clone, but in an existing chip8 which keeps its events queue
+ * (emptied), its debugger, trace and window.
+ *
+ * \param dst an initialized chip8
+ * \param src an initialized chip8, not running while it is copied
+ */
+void chip8_copy(chip8_t *dst, const chip8_t *src);
+
 /*!
  * \brief Free a chip8 structure
  *
@@ -52,13 +213,141 @@ void chip8_free(chip8_t *chip8);
  */
 int chip8_load_game(chip8_t *chip8, FILE *file);
 
+/*!
+ * \brief load a game already in memory into the chip8_t memory
+ * Like chip8_load_game, for the ROMs of a pack (see include/rompack.h) or
+ * received from the network.
+ *
+ * \param chip8 an initialized chip8
+ * \param rom the game, may be NULL if size is 0
+ * \param size bytes of the game, at most CHIP8_ROM_MAX
+ *
+ * \return 0 if everything goes well, -1 otherwise
+ */
+int chip8_load_rom(chip8_t *chip8, const unsigned char *rom, size_t size);
+
+/*!
+ * \brief Select the quirk profile
+ * Each profile has its own interpreter, specialized at compile time.
+ *
+ * \param chip8 an initialized chip8
+ * \param profile one of the CHIP8_PROFILE_XXX
+ *
+ * \return 0 if everything goes well, -1 otherwise
+ */
+int chip8_set_profile(chip8_t *chip8, int profile);
+
+/*!
+ * \brief Find a quirk profile by its name
+ *
+ * \param name the name of the profile, from CHIP8_PROFILE_NAMES
+ *
+ * \return the CHIP8_PROFILE_XXX, -1 if no profile has this name
+ */
+int chip8_profile_by_name(const char *name);
+
+/*!
+ * \brief Select the execution engine
+ *
+ * \param chip8 an initialized chip8
+ * \param engine one of the CHIP8_ENGINE_XXX
+ *
+ * \return 0 if everything goes well, -1 otherwise
+ */
+int chip8_set_engine(chip8_t *chip8, int engine);
+
+/*!
+ * \brief Find an execution engine by its name
+ *
+ * \param name the name of the engine, from CHIP8_ENGINE_NAMES
+ *
+ * \return the CHIP8_ENGINE_XXX, -1 if no engine has this name
+ */
+int chip8_engine_by_name(const char *name);
+
+/*!
+ * \brief Seed the random number generator used by CXNN
+ *
+ * \param chip8 an initialized chip8
+ * \param seed any value, 0 selects CHIP8_RANDOM_SEED
+ */
+void chip8_seed(chip8_t *chip8, uint32_t seed);
+
+/*!
+ * \brief Hash the state of the chip8
+ * Everything which changes the execution is hashed: the registers, the
+ * timers, the stack, the memory, the screen and the random number
+ * generator. The caches of the engines are not.
+ * The memory and the screen are hashed incrementally by the instructions
+ * writing them, only the registers are hashed here.
+ *
+ * \param chip8 an initialized chip8
+ *
+ * \return the hash
+ */
+uint64_t chip8_state_hash(const chip8_t *chip8);
+
+/*!
+ * \brief Hash the state of the chip8 from scratch
+ * Slow, only useful to check the incremental hashes.
+ *
+ * \param chip8 an initialized chip8
+ *
+ * \return the hash, equal to chip8_state_hash
+ */
+uint64_t chip8_state_hash_full(const chip8_t *chip8);
+
 /*!
  * \brief Emulate one cycle of the chip8
  * 
  * \param chip8 an initialized chip8 with a loaded game
  *
- * \return 0 if everything goes well, -1 otherwise
+ * \return 0 if everything goes well, -1 if the chip8 is halted
  */
 int chip8_emulate_cycle(chip8_t *chip8);
 
+/*!
+ * \brief Emulate one frame of the chip8
+ * Run CHIP8_CYCLES_PER_FRAME cycles, which is what the chip8 executes in
+ * 1 / CHIP8_FRAME_RATE second of real time.
+ *
+ * \param chip8 an initialized chip8 with a loaded game
+ *
+ * \return 0 if everything goes well, -1 if the chip8 is halted
+ */
+int chip8_emulate_frame(chip8_t *chip8);
+
+/*!
+ * \brief Emulate several cycles of the chip8
+ * The engine is free to execute them in any way, e.g. several at once.
+ *
+ * \param chip8 an initialized chip8 with a loaded game
+ * \param count the number of cycles
+ *
+ * \return 0 if everything goes well, -1 if the chip8 is halted
+ */
+int chip8_emulate_cycles(chip8_t *chip8, unsigned count);
+
+/*!
+ * \brief Get the next event raised by the chip8
+ * The events are queued in a lock-free ring, so they can be consumed from
+ * another thread than the one running the chip8. When the host does not
+ * read them the oldest are kept and the new ones are lost.
+ *
+ * \param chip8 an initialized chip8
+ * \param event where the event is stored
+ *
+ * \return 0 if an event was read, -1 if there is no event
+ */
+int chip8_poll_event(chip8_t *chip8, chip8_event_t *event);
+
+/*!
+ * \brief Describe an event type
+ *
+ * \param type one of the chip8_event_type_t
+ *
+ * \return a static string
+ */
+const char *chip8_event_name(int type);
+
 #endif /* _VM_H_ */
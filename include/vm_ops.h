@@ -0,0 +1,525 @@
+#ifndef _VM_OPS_H_
+#define _VM_OPS_H_
+
+/*
+ * Implementation of every chip8 instruction.
+ * They live in a header so the interpreter (src/vm.c) and the code generated
+ * by the ahead of time compiler (aot/) share the exact same semantic.
+ * Each handler executes the instruction stored in chip8->opcode.
+ *
+ * The handlers are a template specialized for one quirk profile: define
+ * CHIP8_PROFILE and CHIP8_NAME(name) (the name of the generated functions)
+ * before including this file. It can be included once per profile, the
+ * default is CHIP8_PROFILE_DEFAULT with the chip8_opcode_XXXX names.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm.h"
+
+/* Report an event to the host, it is lost if the host does not keep up */
+static inline void chip8_event(chip8_t *chip8, chip8_event_type_t type)
+{
+	chip8_event_t *event = ring_reserve(&chip8->events);
+
+	if (event == NULL)
+		return;
+	event->type = (uint16_t)type;
+	event->pc = chip8->pc;
+	event->opcode = chip8->opcode;
+	ring_commit(&chip8->events);
+}
+
+/* Stop the execution on an error, the instruction is not executed */
+static inline void chip8_fault(chip8_t *chip8, chip8_event_type_t type)
+{
+	chip8->halted = 1;
+	chip8_event(chip8, type);
+	chip8_event(chip8, CHIP8_EVENT_HALTED);
+}
+
+/* Update the timers, must be called once per executed instruction */
+static inline void chip8_timers_tick(chip8_t *chip8)
+{
+	if(chip8->delay_timer > 0)
+		chip8->delay_timer--;
+
+	if(chip8->sound_timer > 0)
+	{
+		if(chip8->sound_timer == 1)
+			chip8_event(chip8, CHIP8_EVENT_SOUND_STOP);
+		chip8->sound_timer--;
+	}
+}
+
+/* Next pseudo random number (xorshift32), each chip8 has its own sequence */
+static inline uint32_t chip8_random(chip8_t *chip8)
+{
+	uint32_t x = chip8->random;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	chip8->random = x;
+	return x;
+}
+
+/*
+ * Check that the len bytes at I are in the memory, halt if they are not
+ * Return 0 if they are.
+ */
+static inline int chip8_check_I(chip8_t *chip8, unsigned len)
+{
+	if (chip8->I + len <= CHIP8_MEMORY_SIZE)
+		return 0;
+	chip8_fault(chip8, CHIP8_EVENT_ADDRESS_OVERFLOW);
+	return -1;
+}
+
+/*
+ * Write a byte of the memory, and update its hash
+ * The page is copied first if it is shared with other chip8.
+ */
+static inline void chip8_store(chip8_t *chip8, unsigned addr, unsigned char value)
+{
+	unsigned index = addr >> CHIP8_PAGE_BITS;
+
+	if (__atomic_load_n(&chip8->pages[index]->refs, __ATOMIC_ACQUIRE) != 1
+			&& chip8_page_unshare(chip8, index) < 0)
+	{
+		chip8_fault(chip8, CHIP8_EVENT_OUT_OF_MEMORY);
+		return;
+	}
+	chip8->memory_hash ^= chip8_cell_hash(addr, chip8_read(chip8, addr)) ^ chip8_cell_hash(addr, value);
+	chip8->pages[index]->bytes[addr & (CHIP8_PAGE_SIZE - 1)] = value;
+}
+
+/* The memory in [addr, addr + len) changed, forget the decoded instructions */
+static inline void chip8_invalidate(chip8_t *chip8, unsigned addr, unsigned len)
+{
+	unsigned start = addr >= CHIP8_DECODE_SPAN ? addr - (CHIP8_DECODE_SPAN - 1) : 0;
+	unsigned end = addr + len;
+
+	if (end > sizeof(chip8->decoded))
+		end = sizeof(chip8->decoded);
+	if (start < end)
+		memset(chip8->decoded + start, 0, end - start);
+}
+
+/* The program read a key, the changes of the key up to now are consumed */
+static inline void chip8_key_read(chip8_t *chip8, unsigned key)
+{
+	if (chip8->key_tag[key] > chip8->read_tag)
+		chip8->read_tag = chip8->key_tag[key];
+}
+
+/* Decode the instruction */
+#define OP ((chip8->opcode & 0xF000) >> 12)
+#define OP_NNN (chip8->opcode & 0x0FFF)
+#define OP_NN (chip8->opcode & 0x00FF)
+#define OP_N (chip8->opcode & 0x000F)
+#define OP_X ((chip8->opcode & 0x0F00) >> 8)
+#define OP_Y ((chip8->opcode & 0x00F0) >> 4)
+
+#endif /* _VM_OPS_H_ */
+
+#ifndef CHIP8_PROFILE
+#define CHIP8_PROFILE CHIP8_PROFILE_DEFAULT
+#endif
+#ifndef CHIP8_NAME
+#define CHIP8_NAME(name) chip8_##name
+#endif
+
+/*
+ * CHIP8_QUIRK_SHIFT_VY: 8XY6 and 8XYE shift VY into VX instead of VX
+ * CHIP8_QUIRK_LOAD_STORE_I: FX55 and FX65 leave I at the end of the registers
+ * CHIP8_QUIRK_JUMP_VX: BNNN jumps to NNN plus VX instead of V0
+ */
+#if CHIP8_PROFILE == CHIP8_PROFILE_DEFAULT
+#define CHIP8_QUIRK_SHIFT_VY 0
+#define CHIP8_QUIRK_LOAD_STORE_I 0
+#define CHIP8_QUIRK_JUMP_VX 0
+#elif CHIP8_PROFILE == CHIP8_PROFILE_VIP
+#define CHIP8_QUIRK_SHIFT_VY 1
+#define CHIP8_QUIRK_LOAD_STORE_I 1
+#define CHIP8_QUIRK_JUMP_VX 0
+#elif CHIP8_PROFILE == CHIP8_PROFILE_SCHIP
+#define CHIP8_QUIRK_SHIFT_VY 0
+#define CHIP8_QUIRK_LOAD_STORE_I 0
+#define CHIP8_QUIRK_JUMP_VX 1
+#else
+#error "Unknown CHIP8_PROFILE"
+#endif
+
+/* Clears the screen. */
+static inline void CHIP8_NAME(opcode_00E0)(chip8_t *chip8)
+{
+	if (chip8->gfx_hash != 0) // the screen is not blank already
+		chip8->draw_tag = chip8->read_tag;
+	memset(chip8->gfx, 0, sizeof(chip8->gfx));
+	chip8->gfx_hash = 0;
+	chip8->pc += 2;
+}
+
+/* Returns from a subroutine. */
+static inline void CHIP8_NAME(opcode_00EE)(chip8_t *chip8)
+{
+	if (chip8->sp == 0)
+	{
+		chip8_fault(chip8, CHIP8_EVENT_STACK_UNDERFLOW);
+		return;
+	}
+	chip8->sp--;
+	chip8->pc = chip8->stack[chip8->sp];
+	chip8->pc += 2;
+}
+
+/* Calls RCA 1802 program at address NNN. Not necessary for most ROMs. */
+static inline void CHIP8_NAME(opcode_0NNN)(chip8_t *chip8)
+{
+	chip8->pc += 2;
+}
+
+/* Jumps to address NNN. */
+static inline void CHIP8_NAME(opcode_1NNN)(chip8_t *chip8)
+{
+	chip8->pc = OP_NNN;
+}
+
+/* Calls subroutine at NNN. */
+static inline void CHIP8_NAME(opcode_2NNN)(chip8_t *chip8)
+{
+	if (chip8->sp >= sizeof(chip8->stack) / sizeof(chip8->stack[0]))
+	{
+		chip8_fault(chip8, CHIP8_EVENT_STACK_OVERFLOW);
+		return;
+	}
+	// Store current address in stack
+	chip8->stack[chip8->sp] = chip8->pc;
+	chip8->sp++; // Increment stack pointer
+	// Set the program counter to the address at NNN
+	chip8->pc = OP_NNN;
+}
+
+/* Skips the next instruction if VX equals NN. (Usually the next instruction is a jump to skip a code block) */
+static inline void CHIP8_NAME(opcode_3XNN)(chip8_t *chip8)
+{
+	if(chip8->V[OP_X] == OP_NN)
+		chip8->pc += 2;
+	chip8->pc += 2;
+}
+
+/* Skips the next instruction if VX doesn't equal NN. (Usually the next instruction is a jump to skip a code block) */
+static inline void CHIP8_NAME(opcode_4XNN)(chip8_t *chip8)
+{
+	if(chip8->V[OP_X] != OP_NN)
+		chip8->pc += 2;
+	chip8->pc += 2;
+}
+
+/* Skips the next instruction if VX equals VY. (Usually the next instruction is a jump to skip a code block) */
+static inline void CHIP8_NAME(opcode_5XY0)(chip8_t *chip8)
+{
+	if(chip8->V[OP_X] == chip8->V[OP_Y])
+		chip8->pc += 2;
+	chip8->pc += 2;
+}
+
+/* Sets VX to NN. */
+static inline void CHIP8_NAME(opcode_6XNN)(chip8_t *chip8)
+{
+	chip8->V[OP_X] = (unsigned char)OP_NN;
+	chip8->pc += 2;
+}
+
+/* Adds NN to VX. (Carry flag is not changed) */
+static inline void CHIP8_NAME(opcode_7XNN)(chip8_t *chip8)
+{
+	chip8->V[OP_X] = (unsigned char)(chip8->V[OP_X] + OP_NN);
+	chip8->pc += 2;
+}
+
+/* Sets VX to the value of VY. */
+static inline void CHIP8_NAME(opcode_8XY0)(chip8_t *chip8)
+{
+	chip8->V[OP_X] = chip8->V[OP_Y];
+	chip8->pc += 2;
+}
+
+/* Sets VX to VX or VY. (Bitwise OR operation) */
+static inline void CHIP8_NAME(opcode_8XY1)(chip8_t *chip8)
+{
+	chip8->V[OP_X] |= chip8->V[OP_Y];
+	chip8->pc += 2;
+}
+
+/* Sets VX to VX and VY. (Bitwise AND operation) */
+static inline void CHIP8_NAME(opcode_8XY2)(chip8_t *chip8)
+{
+	chip8->V[OP_X] &= chip8->V[OP_Y];
+	chip8->pc += 2;
+}
+
+/* Sets VX to VX xor VY. */
+static inline void CHIP8_NAME(opcode_8XY3)(chip8_t *chip8)
+{
+	chip8->V[OP_X] ^= chip8->V[OP_Y];
+	chip8->pc += 2;
+}
+
+/* Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't. */
+static inline void CHIP8_NAME(opcode_8XY4)(chip8_t *chip8)
+{
+	unsigned short sum = chip8->V[OP_X] + chip8->V[OP_Y];
+
+	if(sum > 0xFF) chip8->V[0xF] = 1;
+	else chip8->V[0xF] = 0;
+
+	chip8->V[OP_X] = (unsigned char)sum;
+	chip8->pc += 2;
+}
+
+/* VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't. */
+static inline void CHIP8_NAME(opcode_8XY5)(chip8_t *chip8)
+{
+	if(chip8->V[OP_Y] > chip8->V[OP_X])
+		chip8->V[0xF] = 0; // there is a borrow
+	else
+		chip8->V[0xF] = 1;
+	chip8->V[OP_X] -= chip8->V[OP_Y];
+	chip8->pc += 2;
+}
+
+/* Stores the least significant bit of VX in VF and then shifts VX to the right by 1. (VY shifted into VX with the shift quirk) */
+static inline void CHIP8_NAME(opcode_8XY6)(chip8_t *chip8)
+{
+#if CHIP8_QUIRK_SHIFT_VY
+	chip8->V[0xF] = chip8->V[OP_Y] & 0x1;
+	chip8->V[OP_X] = chip8->V[OP_Y] >> 1;
+#else
+	chip8->V[0xF] = chip8->V[OP_X] & 0x1;
+	chip8->V[OP_X] >>= 1;
+#endif
+	chip8->pc += 2;
+}
+
+/* Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't. */
+static inline void CHIP8_NAME(opcode_8XY7)(chip8_t *chip8)
+{
+	if(chip8->V[OP_X] > chip8->V[OP_Y])
+		chip8->V[0xF] = 0;
+	else
+		chip8->V[0xF] = 1;
+
+	chip8->V[OP_X] = chip8->V[OP_Y] - chip8->V[OP_X];
+	chip8->pc += 2;
+}
+
+/* Stores the most significant bit of VX in VF and then shifts VX to the left by 1. (VY shifted into VX with the shift quirk) */
+static inline void CHIP8_NAME(opcode_8XYE)(chip8_t *chip8)
+{
+#if CHIP8_QUIRK_SHIFT_VY
+	chip8->V[0xF] = chip8->V[OP_Y] >> 7;
+	chip8->V[OP_X] = (unsigned char)(chip8->V[OP_Y] << 1);
+#else
+	chip8->V[0xF] = chip8->V[OP_X] >> 7;
+	chip8->V[OP_X] <<= 1;
+#endif
+	chip8->pc += 2;
+}
+
+/* Skips the next instruction if VX doesn't equal VY. (Usually the next instruction is a jump to skip a code block) */
+static inline void CHIP8_NAME(opcode_9XY0)(chip8_t *chip8)
+{
+	if(chip8->V[OP_X] != chip8->V[OP_Y])
+		chip8->pc += 2;
+	chip8->pc += 2;
+}
+
+// Sets I to the address NNN
+static inline void CHIP8_NAME(opcode_ANNN)(chip8_t *chip8)
+{
+	chip8->I = OP_NNN;
+	chip8->pc += 2;
+}
+
+/* Jumps to the address NNN plus V0. (XNN plus VX with the jump quirk) */
+static inline void CHIP8_NAME(opcode_BNNN)(chip8_t *chip8)
+{
+#if CHIP8_QUIRK_JUMP_VX
+	chip8->pc = (uint16_t)(OP_NNN + chip8->V[OP_X]);
+#else
+	chip8->pc = (uint16_t)(OP_NNN + chip8->V[0]);
+#endif
+}
+
+/* Sets VX to the result of a bitwise and operation on a random number (Typically: 0 to 255) and NN. */
+static inline void CHIP8_NAME(opcode_CXNN)(chip8_t *chip8)
+{
+	chip8->V[OP_X] = (unsigned char)((chip8_random(chip8) % 0xFF) & OP_NN);
+	chip8->pc += 2;
+}
+
+/* Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels. Each row of 8 pixels is read as bit-coded starting from memory location I; I value doesn’t change after the execution of this instruction. As described above, VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that doesn’t happen */
+static inline void CHIP8_NAME(opcode_DXYN)(chip8_t *chip8)
+{
+	unsigned char X = chip8->V[OP_X];
+	unsigned char Y = chip8->V[OP_Y];
+	uint16_t height = OP_N;
+	uint16_t pixel;
+	unsigned drawn = 0; // a pixel is flipped by each bit set
+
+	if (chip8_check_I(chip8, height))
+		return;
+	chip8->V[0xF] = 0;
+	for (unsigned char s_y = 0; s_y < height; s_y++)
+	{
+		pixel = chip8_read(chip8, chip8->I + s_y);
+		drawn |= pixel;
+		for(unsigned char s_x = 0; s_x < 8; s_x++)
+		{
+			if((pixel & (0x80 >> s_x)) != 0)
+			{
+				size_t pos = (size_t)(X + s_x + ((Y + s_y) * 64)) % 2048;
+				if(chip8->gfx[pos] == 1)
+					chip8->V[0xF] = 1;
+				chip8->gfx_hash ^= chip8_cell_hash(CHIP8_GFX_CELL(pos), chip8->gfx[pos]);
+				chip8->gfx[pos] = ~chip8->gfx[pos] ;
+				chip8->gfx_hash ^= chip8_cell_hash(CHIP8_GFX_CELL(pos), chip8->gfx[pos]);
+			}
+		}
+	}
+	if (drawn != 0)
+		chip8->draw_tag = chip8->read_tag;
+	chip8->pc += 2;
+}
+
+/* Skips the next instruction if the key stored in VX is pressed. (Usually the next instruction is a jump to skip a code block) */
+static inline void CHIP8_NAME(opcode_EX9E)(chip8_t *chip8)
+{
+	chip8_key_read(chip8, chip8->V[OP_X] & 0xF);
+	if(chip8->key[chip8->V[OP_X] & 0xF] != 0)
+		chip8->pc += 2;
+	chip8->pc += 2;
+}
+
+/* Skips the next instruction if the key stored in VX isn't pressed. (Usually the next instruction is a jump to skip a code block) */
+static inline void CHIP8_NAME(opcode_EXA1)(chip8_t *chip8)
+{
+	chip8_key_read(chip8, chip8->V[OP_X] & 0xF);
+	if(chip8->key[chip8->V[OP_X] & 0xF] == 0)
+		chip8->pc += 2;
+	chip8->pc += 2;
+}
+
+/* Sets VX to the value of the delay timer. */
+static inline void CHIP8_NAME(opcode_FX07)(chip8_t *chip8)
+{
+	chip8->V[OP_X] = chip8->delay_timer;
+	chip8->pc += 2;
+}
+
+/* A key press is awaited, and then stored in VX. (Blocking Operation. All instruction halted until next key event) */
+static inline void CHIP8_NAME(opcode_FX0A)(chip8_t *chip8)
+{
+	char key_pressed = 0;
+
+	for(unsigned char i = 0; i < 16; i++)
+	{
+		if(chip8->key[i] != 0)
+		{
+			chip8->V[OP_X] = i;
+			key_pressed = 1;
+		}
+	}
+
+	// If we didn't received a keypress, skip this cycle and try again.
+	if(key_pressed == 0)
+		return;
+
+	chip8_key_read(chip8, chip8->V[OP_X]);
+	chip8->pc += 2;
+}
+
+/* Sets the delay timer to VX. */
+static inline void CHIP8_NAME(opcode_FX15)(chip8_t *chip8)
+{
+	chip8->delay_timer = chip8->V[OP_X];
+	chip8->pc += 2;
+}
+
+/* Sets the sound timer to VX. */
+static inline void CHIP8_NAME(opcode_FX18)(chip8_t *chip8)
+{
+	if (chip8->sound_timer == 0 && chip8->V[OP_X] != 0)
+		chip8_event(chip8, CHIP8_EVENT_SOUND_START);
+	else if (chip8->sound_timer != 0 && chip8->V[OP_X] == 0)
+		chip8_event(chip8, CHIP8_EVENT_SOUND_STOP);
+	chip8->sound_timer = chip8->V[OP_X];
+	chip8->pc += 2;
+}
+
+/* Adds VX to I. VF is set to 1 when I goes past the memory, and to 0 when it doesn't. */
+static inline void CHIP8_NAME(opcode_FX1E)(chip8_t *chip8)
+{
+	unsigned short sum = chip8->I + chip8->V[OP_X];
+	if(sum > 0xFFF) chip8->V[0xF] = 1;
+	else chip8->V[0xF] = 0;
+
+	chip8->I += chip8->V[OP_X];
+	chip8->pc += 2;
+}
+
+/* Sets I to the location of the sprite for the character in VX. Characters 0-F (in hexadecimal) are represented by a 4x5 font. */
+static inline void CHIP8_NAME(opcode_FX29)(chip8_t *chip8)
+{
+	chip8->I = chip8->V[OP_X] * 0x5;
+	chip8->pc += 2;
+}
+
+/* Stores the binary-coded decimal representation of VX, with the most significant of three digits at the address in I, the middle digit at I plus 1, and the least significant digit at I plus 2. (In other words, take the decimal representation of VX, place the hundreds digit in memory at location in I, the tens digit at location I+1, and the ones digit at location I+2.) */
+static inline void CHIP8_NAME(opcode_FX33)(chip8_t *chip8)
+{
+	if (chip8_check_I(chip8, 3))
+		return;
+	chip8_store(chip8, chip8->I,     chip8->V[OP_X] / 100);
+	chip8_store(chip8, chip8->I + 1u, (chip8->V[OP_X] / 10) % 10);
+	chip8_store(chip8, chip8->I + 2u, chip8->V[OP_X] % 10);
+	chip8_invalidate(chip8, chip8->I, 3);
+	chip8->pc += 2;
+}
+
+/* Stores V0 to VX (including VX) in memory starting at address I. The offset from I is increased by 1 for each value written, but I itself is left unmodified. (I is increased too with the load/store quirk) */
+static inline void CHIP8_NAME(opcode_FX55)(chip8_t *chip8)
+{
+	if (chip8_check_I(chip8, OP_X + 1u))
+		return;
+	for (unsigned char i = 0; i <= OP_X; i++)
+		chip8_store(chip8, chip8->I + i, chip8->V[i]);
+	chip8_invalidate(chip8, chip8->I, OP_X + 1);
+#if CHIP8_QUIRK_LOAD_STORE_I
+	chip8->I = (uint16_t)(chip8->I + OP_X + 1);
+#endif
+
+	chip8->pc += 2;
+}
+
+/* Fills V0 to VX (including VX) with values from memory starting at address I. The offset from I is increased by 1 for each value written, but I itself is left unmodified. (I is increased too with the load/store quirk) */
+static inline void CHIP8_NAME(opcode_FX65)(chip8_t *chip8)
+{
+	if (chip8_check_I(chip8, OP_X + 1u))
+		return;
+	for (unsigned char i = 0; i <= OP_X; i++)
+		chip8->V[i] = chip8_read(chip8, chip8->I + i);
+#if CHIP8_QUIRK_LOAD_STORE_I
+	chip8->I = (uint16_t)(chip8->I + OP_X + 1);
+#endif
+
+	chip8->pc += 2;
+}
+
+#undef CHIP8_QUIRK_SHIFT_VY
+#undef CHIP8_QUIRK_LOAD_STORE_I
+#undef CHIP8_QUIRK_JUMP_VX
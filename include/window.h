@@ -1,6 +1,10 @@
 #ifndef _WINDOW_H_
 #define _WINDOW_H_
 
+/* flags returned by handle_event */
+#define WINDOW_EVENT_QUIT  0x1 /* the user want to leave */
+#define WINDOW_EVENT_TURBO 0x2 /* toggle the turbo mode */
+
 typedef void window_t;
 
 window_t *create_window(int width, int height);
@@ -11,6 +15,17 @@ void window_clear(window_t *window);
 
 void update_window(window_t *win, const unsigned char *gfx);
 
+/* display a short status line (emulation speed, ...) next to the screen */
+void window_status(window_t *window, const char *status);
+
+/* turn the buzzer on (on != 0) or off */
+void window_sound(window_t *window, int on);
+
+/* give the terminal back for line input (the debugger) until window_resume */
+void window_suspend(window_t *window);
+
+void window_resume(window_t *window);
+
 int handle_event(unsigned char *keyboard);
 
 #endif /* _WINDOW_H_ */
@@ -1,67 +1,396 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <signal.h>
+#include <string.h>
 
 #include "vm.h"
 #include "window.h"
+#include "pacer.h"
+#include "capture.h"
+#include "debug.h"
+#include "trace.h"
+#include "latency.h"
+#include "rompack.h"
+#include "metrics.h"
+#include "framebuf.h"
+
+#define FRAME_NS (NSEC_PER_SEC / CHIP8_FRAME_RATE)
 
 chip8_t *chip8;
 
+static volatile sig_atomic_t stop;
+
 static void usage(void)
 {
-	fprintf(stderr, "usage: %s game_file\n", __FILE__);
+	fprintf(stderr, "usage: %s [-tcsd] [-n frames] [-q profile] [-r file] [-T file] [-L file] [-P pack] [-F name] game_file\n", __FILE__);
+	fprintf(stderr, "\t-t: start in turbo mode (toggle with tab)\n");
+	fprintf(stderr, "\t-n: in turbo mode draw one frame every n emulated frames\n"
+			"\t    instead of drawing at %d Hz\n", CHIP8_FRAME_RATE);
+	fprintf(stderr, "\t-q: quirk profile of the game: default, vip or schip\n");
+	fprintf(stderr, "\t-P: game_file is the name of a game of this pack (see tools/c8pack),\n"
+			"\t    played with the profile and the key map of the pack\n");
+	fprintf(stderr, "\t-c: catch up the late frames instead of dropping them\n");
+	fprintf(stderr, "\t-s: print the frame timing and input latency statistics on exit\n");
+	fprintf(stderr, "\t-r: record all the emulated frames in file (see tools/c8replay)\n");
+	fprintf(stderr, "\t-d: start in the debugger, ^C comes back to it\n");
+	fprintf(stderr, "\t-T: trace all the executed instructions in file (see tools/c8trace)\n");
+	fprintf(stderr, "\t-L: write the input latency histograms in file on exit\n");
+	fprintf(stderr, "\t-F: also publish the drawn frames in shared memory under this name\n"
+			"\t    (see include/framebuf.h and tools/c8fbview)\n");
 	exit(1);
 }
 
+/* ^C stops the chip8 and opens the debugger */
+static void on_interrupt(int sig)
+{
+	(void)sig;
+	chip8_debug_interrupt(chip8);
+}
+
+/* leave cleanly, so the metrics page and the recording are not left behind */
+static void on_stop(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+/* forward what the chip8 reported during the last frame to the host */
+static void handle_vm_events(void)
+{
+	chip8_event_t event;
+
+	while (chip8_poll_event(chip8, &event) == 0)
+	{
+		switch (event.type)
+		{
+			case CHIP8_EVENT_SOUND_START:
+				window_sound(chip8->window, 1);
+				break;
+			case CHIP8_EVENT_SOUND_STOP:
+				window_sound(chip8->window, 0);
+				break;
+			default:
+				fprintf(stderr, "%s at 0x%03X (opcode 0x%04X)\n",
+						chip8_event_name(event.type), event.pc, event.opcode);
+		}
+	}
+}
+
 int main(int argc, char **argv)
 {
 	FILE *fd = NULL;
+	int turbo = 0;
+	int profile = -1; // from the pack, or CHIP8_PROFILE_DEFAULT
+	unsigned long skip = 0; // 0 -> draw at CHIP8_FRAME_RATE in turbo mode
+	pacer_policy_t policy = PACER_DROP;
+	int stats = 0;
+	int debug = 0;
+	const char *record = NULL;
+	const char *trace = NULL;
+	const char *latency_file = NULL;
+	const char *pack_path = NULL;
+	const char *framebuf_name = NULL;
+	framebuf_page_t *framebuf = NULL;
+	const char *name = "stdin"; // of the game, for tools/c8top
+	rompack_t pack;
+	rompack_entry_t game;
+	unsigned char host_keys[16] = { 0 }; // before the key map of the pack
+	capture_t *capture = NULL;
+	int opt;
 
-	// Get a filedescriptor to the game
-	if (argc == 1)
+	while ((opt = getopt(argc, argv, "tcsdn:q:r:T:L:P:F:")) != -1)
+	{
+		switch (opt)
+		{
+			case 't':
+				turbo = 1;
+				break;
+			case 'c':
+				policy = PACER_CATCH_UP;
+				break;
+			case 's':
+				stats = 1;
+				break;
+			case 'r':
+				record = optarg;
+				break;
+			case 'd':
+				debug = 1;
+				break;
+			case 'T':
+				trace = optarg;
+				break;
+			case 'L':
+				latency_file = optarg;
+				break;
+			case 'P':
+				pack_path = optarg;
+				break;
+			case 'F':
+				framebuf_name = optarg;
+				break;
+			case 'n':
+				skip = strtoul(optarg, NULL, 0);
+				break;
+			case 'q':
+				profile = chip8_profile_by_name(optarg);
+				if (profile < 0)
+					usage();
+				break;
+			default:
+				usage();
+		}
+	}
+
+	// Get a filedescriptor to the game, or find it in the pack
+	if (pack_path != NULL)
+	{
+		if (optind + 1 != argc)
+			usage();
+		if (rompack_open(&pack, pack_path) < 0)
+		{
+			perror("Failed to open the pack: ");
+			return 1;
+		}
+		if (rompack_find(&pack, argv[optind], &game) < 0)
+		{
+			fprintf(stderr, "No game %s in %s\n", argv[optind], pack_path);
+			return 1;
+		}
+		if (rompack_verify(&game) < 0)
+		{
+			fprintf(stderr, "Game %s of %s is corrupted\n", argv[optind], pack_path);
+			return 1;
+		}
+		name = game.name;
+	}
+	else if (optind == argc)
 		fd = stdin;
-	else if (argc == 2)
+	else if (optind + 1 == argc)
 	{
-		fd = fopen(argv[1], "rb");
+		fd = fopen(argv[optind], "rb");
 		if (fd == NULL)
 		{
 			perror("Failed to open file: ");
 			return 0;
 		}
+		name = strrchr(argv[optind], '/') != NULL ? strrchr(argv[optind], '/') + 1 : argv[optind];
 	}
 	else
 		usage();
 
 	// Initialize the Chip8 system
 	chip8 = chip8_init();
+	if (chip8 == NULL)
+	{
+		perror("Failed to create the chip8: ");
+		return 1;
+	}
+
+	// Load the game into the memory, before the window takes the terminal
+	if ((pack_path != NULL ? rompack_load(chip8, &game) : chip8_load_game(chip8, fd)) < 0)
+	{
+		fprintf(stderr, "Failed to load %s: unreadable or larger than %d bytes\n", name, CHIP8_ROM_MAX);
+		return 1;
+	}
+	if (profile >= 0)
+		chip8_set_profile(chip8, profile);
+
+	if (record != NULL)
+	{
+		capture = capture_open(record, 64, 32, CHIP8_FRAME_RATE);
+		if (capture == NULL)
+		{
+			perror("Failed to record: ");
+			return 1;
+		}
+	}
+
+	if (framebuf_name != NULL)
+	{
+		framebuf = framebuf_open(framebuf_name, 64, 32);
+		if (framebuf == NULL)
+		{
+			perror("Failed to publish the frames: ");
+			return 1;
+		}
+	}
+
+	if (trace != NULL && trace_start(chip8, trace) < 0)
+	{
+		perror("Failed to trace: ");
+		return 1;
+	}
 
-	// Set up render system and register input callbacks
+	if (debug)
+	{
+		if (chip8_debug_attach(chip8) == NULL)
+			return 1;
+		chip8_debug_interrupt(chip8); // stop before the first instruction
+		signal(SIGINT, on_interrupt);
+	}
+	else
+		signal(SIGINT, on_stop);
+	signal(SIGTERM, on_stop);
+
+	// Set up render system and register input callbacks, once nothing
+	// can fail anymore: the TERM backend changes the terminal settings
 	chip8->window = create_window(64, 32);
 
-	// Load the game into the memory
-	chip8_load_game(chip8, fd);
+	pacer_t pacer;
+	pacer_init(&pacer, CHIP8_FRAME_RATE, policy);
+
+	// time from the key changes to the screen
+	latency_t latency;
+	latency_init(&latency);
+
+	uint64_t now = pacer_now();
+	uint64_t next_draw = now;  // deadline of the next draw in turbo mode
+	uint64_t speed_time = now; // used to compute the emulation speed
+	unsigned long frames = 0, speed_frames = 0;
+	unsigned todo = 1; // frames to emulate before the next draw
+	int halted = 0;
+
+	// live counters, published for tools/c8top
+	metrics_page_t *metrics = metrics_open(name, CHIP8_GFX);
+	metrics_counters_t counters = { .start = now };
+	uint64_t next_publish = now;
+	uint64_t vm_start = now; // the loop reuses its timestamps, no clock read is added
 
-	while(1)
+	while(!halted && !stop)
 	{
-		if (chip8_emulate_cycle(chip8))
-			break;
+		for (; todo > 0 && !halted && !chip8_debug_stopped(chip8); todo--)
+		{
+			halted = chip8_emulate_frame(chip8);
+			latency_emulated(&latency, chip8);
+			handle_vm_events();
+			if (capture != NULL)
+				capture_frame(capture, chip8->gfx);
+			frames++;
+		}
+		todo = 1;
+		now = pacer_now();
+		counters.vm_ns += now - vm_start;
+
+		if (now >= next_publish || chip8_debug_stopped(chip8))
+		{
+			counters.now = now;
+			counters.cycles = frames * CHIP8_CYCLES_PER_FRAME;
+			counters.frames = frames;
+			counters.dropped = pacer.dropped;
+			counters.flags = (turbo ? METRICS_TURBO : 0) | (halted ? METRICS_HALTED : 0)
+				| (chip8_debug_stopped(chip8) ? METRICS_DEBUG : 0);
+			metrics_publish(metrics, &counters);
+			next_publish = now + METRICS_PERIOD;
+		}
+
+		if (chip8_debug_stopped(chip8))
+		{
+			// show the screen as it is where the chip8 stopped
+			update_window(chip8->window, chip8->gfx);
+			if (framebuf != NULL)
+				framebuf_publish(framebuf, chip8->gfx, frames);
+			latency_presented(&latency);
+			window_suspend(chip8->window);
+			if (chip8_debug_repl(chip8, stdin, stderr) < 0)
+				break;
+			window_resume(chip8->window);
+			// detached: ^C leaves, as without -d
+			if (chip8->debug == NULL)
+				signal(SIGINT, on_stop);
+			pacer_reset(&pacer);
+			now = pacer_now();
+		}
+
+		// in turbo mode we only draw a sample of the emulated frames
+		if (turbo && (skip ? frames % skip != 0 : now < next_draw))
+		{
+			vm_start = now;
+			continue;
+		}
+		next_draw = now + FRAME_NS;
+
+		if (now - speed_time >= NSEC_PER_SEC / 2)
+		{
+			char status[32];
+			double speed = (double)(frames - speed_frames) * NSEC_PER_SEC
+				/ (double)(now - speed_time) / CHIP8_FRAME_RATE;
+
+			snprintf(status, sizeof(status), "%s x%.1f",
+					turbo ? "turbo" : "speed", speed);
+			window_status(chip8->window, status);
+			counters.speed = (uint32_t)(speed * 1000);
+			speed_time = now;
+			speed_frames = frames;
+		}
 
 		update_window(chip8->window, chip8->gfx);
+		if (framebuf != NULL)
+			framebuf_publish(framebuf, chip8->gfx, frames);
+		uint64_t event_start = pacer_now();
+		counters.update_ns += event_start - now;
+		counters.presented++;
+		latency_presented(&latency);
 
-		if (handle_event(chip8->key))
+		int event = handle_event(pack_path != NULL ? host_keys : chip8->key);
+		vm_start = pacer_now();
+		counters.event_ns += vm_start - event_start;
+		if (pack_path != NULL)
+			rompack_map_keys(&game, host_keys, chip8->key);
+		latency_input(&latency, chip8);
+		if (event & WINDOW_EVENT_QUIT)
 			break;
+		if (event & WINDOW_EVENT_TURBO)
+		{
+			turbo = !turbo;
+			pacer_reset(&pacer);
+		}
+
+		// run at real speed: wait for the beginning of the next frame
+		if (!turbo)
+		{
+			todo = pacer_wait(&pacer);
+			vm_start = pacer.last;
+		}
+	}
 
-		/* TODO without SDL
-		if ((time = (get_time() - time)) < 2000)
-			nanosleep(
-			usleep(time / 1000);
+	if (stats)
+	{
+		pacer_report(&pacer, stderr);
+		latency_report(&latency, stderr, CHIP8_GFX);
+	}
+	if (latency_file != NULL)
+	{
+		FILE *file = fopen(latency_file, "w");
+
+		if (file == NULL)
+			perror("Failed to write the latency: ");
 		else
-			printf("Too slow : %ld\n", time);
-		time = SDL_GetTicks();
-		*/
+		{
+			latency_export(&latency, file, CHIP8_GFX);
+			fclose(file);
+		}
 	}
 
+	if (capture != NULL)
+	{
+		if (capture_dropped(capture) > 0)
+			fprintf(stderr, "%lu frames dropped from the recording\n", capture_dropped(capture));
+		if (capture_close(capture) < 0)
+			perror("Failed to write the recording: ");
+	}
+
+	if (trace != NULL && trace_stop(chip8) < 0)
+		perror("Failed to write the trace: ");
+
+	metrics_close(metrics);
+	framebuf_close(framebuf);
+	destroy_window(chip8->window);
 	chip8_free(chip8);
+	if (pack_path != NULL)
+		rompack_close(&pack);
 
 	return 0;
 }
@@ -0,0 +1,108 @@
+/*
+ * Send queues of the clients, like in the NET backend (src/gfx/NET): each
+ * message is encoded once and shared by the queues of all the clients of a
+ * session. A session and its clients belong to one worker, so the reference
+ * counts are not atomic.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "server.h"
+
+server_msg_t *server_msg_new(uint8_t type, uint8_t flags, uint32_t seq,
+		const void *payload, size_t len)
+{
+	server_msg_t *msg = malloc(sizeof(*msg) + NETPROTO_HEADER_SIZE + len);
+	netproto_header_t hdr = {
+		.type = type,
+		.flags = flags,
+		.length = (uint16_t)len,
+		.seq = seq,
+	};
+
+	if (msg == NULL)
+		return NULL;
+	msg->refs = 1;
+	msg->len = NETPROTO_HEADER_SIZE + len;
+	netproto_write_header(msg->data, &hdr);
+	if (len > 0)
+		memcpy(msg->data + NETPROTO_HEADER_SIZE, payload, len);
+	return msg;
+}
+
+void server_msg_unref(server_msg_t *msg)
+{
+	if (msg != NULL && --msg->refs == 0)
+		free(msg);
+}
+
+client_t *client_new(int fd)
+{
+	client_t *client = calloc(1, sizeof(*client));
+
+	if (client == NULL)
+		return NULL;
+	client->fd = fd;
+	client->keyframe = 1;
+	return client;
+}
+
+void client_free(client_t *client)
+{
+	for (; client->count > 0; client->count--)
+	{
+		server_msg_unref(client->queue[client->head]);
+		client->head = (client->head + 1) % SERVER_QUEUE;
+	}
+	close(client->fd);
+	free(client);
+}
+
+int client_push(client_t *client, server_msg_t *msg)
+{
+	if (msg == NULL || client->count == SERVER_QUEUE)
+		return -1;
+	msg->refs++;
+	client->queue[(client->head + client->count) % SERVER_QUEUE] = msg;
+	client->count++;
+	return 0;
+}
+
+int client_flush(client_t *client)
+{
+	while (client->count > 0)
+	{
+		server_msg_t *msg = client->queue[client->head];
+		ssize_t n = send(client->fd, msg->data + client->offset,
+				msg->len - client->offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+		if (n < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				return -1;
+			return 0;
+		}
+		client->offset += (size_t)n;
+		if (client->offset < msg->len)
+			return 0;
+		client->offset = 0;
+		server_msg_unref(msg);
+		client->head = (client->head + 1) % SERVER_QUEUE;
+		client->count--;
+	}
+	return 0;
+}
+
+void client_error(client_t *client, const char *reason)
+{
+	server_msg_t *msg = server_msg_new(NETPROTO_ERROR, 0, 0, reason, strlen(reason));
+
+	// best effort, the client is closed right after
+	if (client_push(client, msg) == 0)
+		client_flush(client);
+	server_msg_unref(msg);
+}
@@ -0,0 +1,352 @@
+/*
+ * Multi-session server: runs many chip8 in one process and streams them to
+ * their clients with the protocol of the NET backend (include/netproto.h).
+ * The main thread accepts the clients and reads their first message: a
+ * CREATE loads a ROM in a new session, given to the least loaded worker, an
+ * ATTACH joins an existing session. The client is then handed over to the
+ * worker running its session (see server/worker.c), which runs the frames
+ * of all its sessions from a timer wheel. A session without client is
+ * paused, and destroyed when it stays alone too long.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "server.h"
+#include "pacer.h"
+
+#define SERVER_EVENTS 64
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-j workers] [-m sessions] [-i seconds] [address]\n", name);
+	fprintf(stderr, "\taddress: unix:PATH, tcp:PORT or tcp:HOST:PORT, %s by default\n",
+			SERVER_DEFAULT_ADDR);
+	fprintf(stderr, "\t         tcp:PORT is local, tcp:*:PORT listens on all the interfaces\n");
+	fprintf(stderr, "\t-j: threads running the sessions (%d)\n", SERVER_DEFAULT_WORKERS);
+	fprintf(stderr, "\t-m: maximum number of sessions (%d)\n", SERVER_DEFAULT_SESSIONS);
+	fprintf(stderr, "\t-i: destroy the sessions without client after this delay,\n"
+			"\t    0 to keep them forever (%d)\n", SERVER_DEFAULT_IDLE);
+	fprintf(stderr, "\tclients: see tools/netview -c and -s\n");
+	exit(1);
+}
+
+uint64_t server_tick(const server_t *server)
+{
+	return (pacer_now() - server->epoch) / SERVER_TICK_NS;
+}
+
+void server_unregister(server_t *server, session_t *session)
+{
+	pthread_mutex_lock(&server->lock);
+	for (unsigned i = 0; i < server->max_sessions; i++)
+		if (server->sessions[i] == session)
+		{
+			server->sessions[i] = NULL;
+			session->worker->nsessions--;
+			break;
+		}
+	pthread_mutex_unlock(&server->lock);
+}
+
+/* Find the worker of a session, NULL if there is no such session */
+static worker_t *server_lookup(server_t *server, uint32_t id)
+{
+	worker_t *worker = NULL;
+
+	pthread_mutex_lock(&server->lock);
+	for (unsigned i = 0; i < server->max_sessions; i++)
+		if (server->sessions[i] != NULL && server->sessions[i]->id == id)
+		{
+			worker = server->sessions[i]->worker;
+			break;
+		}
+	pthread_mutex_unlock(&server->lock);
+	return worker;
+}
+
+/* Give a number and a worker to a new session, return -1 if it is full */
+static int server_register(server_t *server, session_t *session)
+{
+	int ret = -1;
+
+	pthread_mutex_lock(&server->lock);
+	for (unsigned i = 0; i < server->max_sessions; i++)
+		if (server->sessions[i] == NULL)
+		{
+			worker_t *worker = &server->workers[0];
+
+			for (unsigned w = 1; w < server->nworkers; w++)
+				if (server->workers[w].nsessions < worker->nsessions)
+					worker = &server->workers[w];
+			session->id = ++server->next_id;
+			session->worker = worker;
+			worker->nsessions++;
+			server->sessions[i] = session;
+			ret = 0;
+			break;
+		}
+	pthread_mutex_unlock(&server->lock);
+	return ret;
+}
+
+/* Load the ROM of a CREATE in a new session */
+static session_t *server_create(const unsigned char *payload, size_t len)
+{
+	session_t *session;
+
+	if (len < 1 || payload[0] >= CHIP8_PROFILE_COUNT)
+		return NULL;
+	session = calloc(1, sizeof(*session));
+	if (session == NULL)
+		return NULL;
+	session->chip8 = chip8_init();
+
+	if (session->chip8 == NULL || chip8_set_profile(session->chip8, payload[0]) < 0
+			|| chip8_load_rom(session->chip8, payload + 1, len - 1) < 0)
+	{
+		chip8_free(session->chip8);
+		free(session);
+		return NULL;
+	}
+	return session;
+}
+
+/*
+ * Handle the first message of a client, return 1 when the client must be
+ * given to *worker, 0 if the message is not complete yet, -1 if the client
+ * must be closed
+ */
+static int server_first_message(server_t *server, client_t *client, worker_t **worker)
+{
+	netproto_header_t hdr;
+	const unsigned char *payload = client->input + NETPROTO_HEADER_SIZE;
+	size_t len = netproto_read_header(client->input, client->input_len, &hdr);
+
+	if (len == 0)
+	{
+		if (client->input_len < sizeof(client->input))
+			return 0;
+		client_error(client, "message too long");
+		return -1;
+	}
+
+	switch (hdr.type)
+	{
+		case NETPROTO_CREATE:
+			client->created = server_create(payload, hdr.length);
+			if (client->created == NULL)
+			{
+				client_error(client, "invalid ROM or profile");
+				return -1;
+			}
+			if (server_register(server, client->created) < 0)
+			{
+				chip8_free(client->created->chip8);
+				free(client->created);
+				client_error(client, "too many sessions");
+				return -1;
+			}
+			fprintf(stderr, "Session %u created\n", client->created->id);
+			*worker = client->created->worker;
+			break;
+		case NETPROTO_ATTACH:
+			*worker = server_lookup(server, hdr.seq);
+			if (*worker == NULL)
+			{
+				client_error(client, "no such session");
+				return -1;
+			}
+			client->wanted = hdr.seq;
+			break;
+		default:
+			client_error(client, "create or attach a session first");
+			return -1;
+	}
+
+	// the worker handles what follows, e.g. the keys sent right away
+	client->input_len -= len;
+	memmove(client->input, client->input + len, client->input_len);
+	return 1;
+}
+
+static void server_accept(server_t *server, client_t **pending)
+{
+	int fd;
+
+	while ((fd = accept4(server->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		client_t *client = client_new(fd);
+		struct epoll_event ev = { .events = EPOLLIN };
+
+		if (client == NULL)
+		{
+			close(fd);
+			continue;
+		}
+		ev.data.ptr = client;
+		if (epoll_ctl(server->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		{
+			client_free(client);
+			continue;
+		}
+		client->next = *pending;
+		*pending = client;
+	}
+}
+
+/* Read the first message of a client, not attached yet */
+static void server_read(server_t *server, client_t **pending, client_t *client)
+{
+	ssize_t n = recv(client->fd, client->input + client->input_len,
+			sizeof(client->input) - client->input_len, MSG_DONTWAIT);
+	worker_t *worker = NULL;
+	int ret;
+
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return;
+	if (n <= 0)
+		ret = -1;
+	else
+	{
+		client->input_len += (size_t)n;
+		ret = server_first_message(server, client, &worker);
+	}
+	if (ret == 0)
+		return;
+
+	while (*pending != client)
+		pending = &(*pending)->next;
+	*pending = client->next;
+	client->next = NULL;
+	epoll_ctl(server->epfd, EPOLL_CTL_DEL, client->fd, NULL);
+	if (ret < 0)
+		client_free(client);
+	else
+		worker_handoff(worker, client);
+}
+
+int main(int argc, char **argv)
+{
+	static server_t server;
+	const char *addr = SERVER_DEFAULT_ADDR;
+	unsigned long workers = SERVER_DEFAULT_WORKERS;
+	unsigned long sessions = SERVER_DEFAULT_SESSIONS;
+	unsigned long idle = SERVER_DEFAULT_IDLE;
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+	struct epoll_event events[SERVER_EVENTS];
+	struct sigaction sa = { .sa_handler = on_signal };
+	sigset_t signals, old_signals;
+	client_t *pending = NULL; // clients which have not sent their first message
+	int opt;
+
+	while ((opt = getopt(argc, argv, "j:m:i:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'j':
+				workers = strtoul(optarg, NULL, 0);
+				if (workers == 0 || workers > SERVER_MAX_WORKERS)
+					usage(argv[0]);
+				break;
+			case 'm':
+				sessions = strtoul(optarg, NULL, 0);
+				if (sessions == 0)
+					usage(argv[0]);
+				break;
+			case 'i':
+				idle = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind + 1 == argc)
+		addr = argv[optind];
+	else if (optind != argc)
+		usage(argv[0]);
+
+	server.epoch = pacer_now();
+	server.idle = idle * (NSEC_PER_SEC / SERVER_TICK_NS);
+	server.max_sessions = (unsigned)sessions;
+	server.sessions = calloc(sessions, sizeof(*server.sessions));
+	if (server.sessions == NULL)
+	{
+		perror("Failed to allocate the sessions: ");
+		return 1;
+	}
+	pthread_mutex_init(&server.lock, NULL);
+
+	server.fd = netproto_listen(addr);
+	if (server.fd < 0)
+	{
+		perror("Failed to listen: ");
+		return 1;
+	}
+	fcntl(server.fd, F_SETFL, fcntl(server.fd, F_GETFL) | O_NONBLOCK);
+	server.epfd = epoll_create1(EPOLL_CLOEXEC);
+	epoll_ctl(server.epfd, EPOLL_CTL_ADD, server.fd, &ev);
+
+	// the signals interrupt the epoll_wait of the main thread only
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+	for (server.nworkers = 0; server.nworkers < workers; server.nworkers++)
+		if (worker_start(&server.workers[server.nworkers], &server) < 0)
+		{
+			perror("Failed to start a worker: ");
+			return 1;
+		}
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	fprintf(stderr, "Waiting for clients on %s, %u workers\n", addr, server.nworkers);
+	while (!stop)
+	{
+		int n = epoll_wait(server.epfd, events, SERVER_EVENTS, -1);
+
+		for (int i = 0; i < n; i++)
+		{
+			if (events[i].data.ptr == NULL)
+				server_accept(&server, &pending);
+			else
+				server_read(&server, &pending, events[i].data.ptr);
+		}
+	}
+
+	fprintf(stderr, "Stopping\n");
+	for (unsigned w = 0; w < server.nworkers; w++)
+		worker_stop(&server.workers[w]);
+	while (pending != NULL)
+	{
+		client_t *next = pending->next;
+
+		client_free(pending);
+		pending = next;
+	}
+	close(server.epfd);
+	close(server.fd);
+	if (strncmp(addr, "unix:", 5) == 0)
+		unlink(addr + 5);
+	free(server.sessions);
+	pthread_mutex_destroy(&server.lock);
+	return 0;
+}
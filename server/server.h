@@ -0,0 +1,189 @@
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "vm.h"
+#include "netproto.h"
+#include "timerwheel.h"
+
+/* used when no address is given */
+#define SERVER_DEFAULT_ADDR "unix:/tmp/c8server.sock"
+#define SERVER_DEFAULT_WORKERS 2
+#define SERVER_DEFAULT_SESSIONS 1024
+/* a session without client is destroyed after this delay, in seconds */
+#define SERVER_DEFAULT_IDLE 600
+#define SERVER_MAX_WORKERS 64
+
+/* clients attached to one session */
+#define SERVER_MAX_CLIENTS 32
+/* messages waiting to be sent to a client, it is too slow beyond that */
+#define SERVER_QUEUE 32
+/* enough for a CREATE with the largest ROM */
+#define SERVER_INPUT (NETPROTO_HEADER_SIZE + 1 + CHIP8_MEMORY_SIZE)
+/* the timer wheels count milliseconds */
+#define SERVER_TICK_NS 1000000ULL
+
+#define SERVER_GFX_W 64
+#define SERVER_GFX_H 32
+
+/* A message shared by the send queues of the clients of a session */
+typedef struct server_msg_s {
+	unsigned refs;
+	size_t len;
+	unsigned char data[];
+} server_msg_t;
+
+typedef struct client_s {
+	int fd;
+	struct client_s *next; /* in the session, the worker inbox or the pending list */
+	struct session_s *session; /* NULL until attached, and once detached */
+	struct session_s *created; /* new session to attach to, see worker_handoff */
+	uint32_t wanted; /* session requested by an ATTACH */
+
+	server_msg_t *queue[SERVER_QUEUE];
+	unsigned head; /* first message to send */
+	unsigned count;
+	size_t offset; /* bytes of the first message already sent */
+	int keyframe; /* the client needs all the rows on the next frame */
+	int polling_out; /* EPOLLOUT is registered */
+
+	unsigned char input[SERVER_INPUT];
+	size_t input_len;
+} client_t;
+
+/*
+ * A chip8 and the clients watching it. A session belongs to one worker,
+ * which runs it and talks to its clients: nothing is shared between the
+ * threads but the directory of the sessions.
+ */
+typedef struct session_s {
+	uint32_t id;
+	chip8_t *chip8;
+	struct worker_s *worker;
+	struct session_s *next; /* in the worker */
+	client_t *clients;
+	unsigned nclients;
+
+	wheel_timer_t frame_timer; /* pending while clients are attached */
+	wheel_timer_t idle_timer;  /* pending while no client is attached */
+	uint64_t start;   /* when the frames were resumed, in ns */
+	uint64_t frames;  /* frame periods since start */
+	uint64_t dropped; /* frames skipped because the worker was late */
+
+	uint32_t seq; /* number of the next frame */
+	unsigned char prev[SERVER_GFX_W * SERVER_GFX_H]; /* last frame sent */
+} session_t;
+
+typedef struct worker_s {
+	struct server_s *server;
+	pthread_t thread;
+	int epfd;
+	int wakefd; /* eventfd, written when the inbox is filled or to stop */
+	timerwheel_t wheel;
+	session_t *sessions;
+	unsigned nsessions; /* protected by the lock of the server */
+	client_t *detached; /* freed once the events being handled are done */
+
+	pthread_mutex_t lock; /* protects inbox and stop */
+	client_t *inbox; /* clients handed over by the acceptor */
+	int stop;
+} worker_t;
+
+typedef struct server_s {
+	int fd; /* listening socket */
+	int epfd;
+	uint64_t epoch; /* tick 0 of the timer wheels, in ns */
+	uint64_t idle; /* ticks before a detached session is destroyed, 0 for never */
+
+	worker_t workers[SERVER_MAX_WORKERS];
+	unsigned nworkers;
+
+	pthread_mutex_t lock; /* protects the directory */
+	session_t **sessions; /* directory, NULL for a free slot */
+	unsigned max_sessions;
+	uint32_t next_id;
+} server_t;
+
+/* server.c */
+
+/*!
+ * \brief Get the current tick of the timer wheels
+ */
+uint64_t server_tick(const server_t *server);
+
+/*!
+ * \brief Remove a session from the directory, before destroying it
+ */
+void server_unregister(server_t *server, session_t *session);
+
+/* client.c */
+
+/*!
+ * \brief Build a message, with a reference for the caller
+ *
+ * \return the message, NULL if the memory is exhausted
+ */
+server_msg_t *server_msg_new(uint8_t type, uint8_t flags, uint32_t seq,
+		const void *payload, size_t len);
+
+/*!
+ * \brief Drop a reference to a message, NULL is ignored
+ */
+void server_msg_unref(server_msg_t *msg);
+
+/*!
+ * \brief Allocate a client for a connected socket
+ *
+ * \return the client, NULL if the memory is exhausted
+ */
+client_t *client_new(int fd);
+
+/*!
+ * \brief Close the socket of a client and free it
+ */
+void client_free(client_t *client);
+
+/*!
+ * \brief Queue a message for a client
+ *
+ * \return 0 if everything goes well, -1 if the queue is full
+ */
+int client_push(client_t *client, server_msg_t *msg);
+
+/*!
+ * \brief Send as much of the queue as possible without blocking
+ *
+ * \return 0 if everything goes well, -1 if the client is gone
+ */
+int client_flush(client_t *client);
+
+/*!
+ * \brief Send an ERROR to a client which is about to be freed
+ */
+void client_error(client_t *client, const char *reason);
+
+/* worker.c */
+
+/*!
+ * \brief Start the thread of a worker
+ *
+ * \return 0 if everything goes well, -1 otherwise
+ */
+int worker_start(worker_t *worker, server_t *server);
+
+/*!
+ * \brief Stop the thread of a worker, then destroy its sessions
+ */
+void worker_stop(worker_t *worker);
+
+/*!
+ * \brief Give a client to the worker of its session
+ * The client has read its CREATE (client->created is the new session, not
+ * yet known by the worker) or its ATTACH (client->wanted).
+ */
+void worker_handoff(worker_t *worker, client_t *client);
+
+#endif /* _SERVER_H_ */
@@ -0,0 +1,572 @@
+/*
+ * A worker thread runs its sessions and serves their clients: one epoll loop
+ * for the sockets of the clients, woken up by the timer wheel which holds
+ * the next frame of every session.
+ * The frames of a session are on a grid of absolute deadlines, like with
+ * the pacer (include/pacer.h), so the frame rate does not drift. A late
+ * worker drops frames instead of catching up, all the sessions stay smooth.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "server.h"
+#include "pacer.h"
+
+#define WORKER_EVENTS 64
+/* the wheel is checked at least this often, in ticks */
+#define WORKER_MAX_SLEEP 60000
+#define NSEC_PER_MSEC 1000000ULL
+#define FRAME_NS (NSEC_PER_SEC / CHIP8_FRAME_RATE)
+
+static void session_frame(void *data);
+static void session_destroy(session_t *session);
+
+/* Register the events to wait for, EPOLLOUT only while something is queued */
+static void worker_poll_client(worker_t *worker, client_t *client)
+{
+	int out = client->count > 0;
+	struct epoll_event ev = {
+		.events = EPOLLIN | (out ? EPOLLOUT : 0),
+		.data.ptr = client,
+	};
+
+	if (out != client->polling_out)
+	{
+		epoll_ctl(worker->epfd, EPOLL_CTL_MOD, client->fd, &ev);
+		client->polling_out = out;
+	}
+}
+
+/* Schedule the frame after the current one on the grid of the session */
+static void session_schedule(session_t *session)
+{
+	server_t *server = session->worker->server;
+	uint64_t deadline = session->start + (session->frames + 1) * FRAME_NS;
+
+	// the wheel fires on the tick following the deadline
+	timerwheel_add(&session->worker->wheel, &session->frame_timer,
+			(deadline - server->epoch + SERVER_TICK_NS - 1) / SERVER_TICK_NS);
+}
+
+/* The first client is attached: run the chip8 again */
+static void session_resume(session_t *session)
+{
+	timerwheel_del(&session->worker->wheel, &session->idle_timer);
+	session->start = pacer_now();
+	session->frames = 0;
+	session_schedule(session);
+}
+
+/* The last client is gone: nothing runs until another one is attached */
+static void session_pause(session_t *session)
+{
+	worker_t *worker = session->worker;
+
+	timerwheel_del(&worker->wheel, &session->frame_timer);
+	if (worker->server->idle > 0)
+		timerwheel_add(&worker->wheel, &session->idle_timer,
+				worker->wheel.now + worker->server->idle);
+}
+
+static void session_idle(void *data)
+{
+	session_t *session = data;
+
+	fprintf(stderr, "Session %u destroyed after being idle\n", session->id);
+	session_destroy(session);
+}
+
+/*
+ * The client is freed after the events being handled, some of them may be
+ * for this client
+ */
+static void worker_drop_client(worker_t *worker, client_t *client)
+{
+	epoll_ctl(worker->epfd, EPOLL_CTL_DEL, client->fd, NULL);
+	client->session = NULL;
+	client->next = worker->detached;
+	worker->detached = client;
+}
+
+static void worker_free_detached(worker_t *worker)
+{
+	while (worker->detached != NULL)
+	{
+		client_t *client = worker->detached;
+
+		worker->detached = client->next;
+		client_free(client);
+	}
+}
+
+static void session_detach(session_t *session, client_t *client)
+{
+	client_t **p = &session->clients;
+
+	while (*p != client)
+		p = &(*p)->next;
+	*p = client->next;
+	worker_drop_client(session->worker, client);
+	if (--session->nclients == 0)
+		session_pause(session);
+}
+
+/* Send the same message to all the clients of a session */
+static void session_broadcast(session_t *session, server_msg_t *msg)
+{
+	for (client_t *client = session->clients; client != NULL; client = client->next)
+		client_push(client, msg);
+	server_msg_unref(msg);
+}
+
+/* Send what is queued, drop the clients which are gone */
+static void session_flush(session_t *session)
+{
+	client_t *client = session->clients;
+
+	while (client != NULL)
+	{
+		client_t *next = client->next;
+
+		if (client_flush(client) < 0)
+			session_detach(session, client);
+		else
+			worker_poll_client(session->worker, client);
+		client = next;
+	}
+}
+
+/* Stream the screen, like update_window in src/gfx/NET */
+static void session_send_frame(session_t *session)
+{
+	const unsigned char *gfx = session->chip8->gfx;
+	unsigned char payload[NETPROTO_FRAME_SIZE(SERVER_GFX_W, SERVER_GFX_H)];
+	server_msg_t *delta, *keyframe = NULL;
+	size_t len;
+
+	len = netproto_encode_frame(session->prev, gfx, SERVER_GFX_W, SERVER_GFX_H, payload);
+	delta = server_msg_new(NETPROTO_FRAME, 0, session->seq, payload, len);
+
+	for (client_t *client = session->clients; client != NULL; client = client->next)
+	{
+		// a late client skips the deltas then restarts from a key frame
+		if (client->count == SERVER_QUEUE)
+			client->keyframe = 1;
+		else if (client->keyframe)
+		{
+			if (keyframe == NULL)
+			{
+				len = netproto_encode_frame(NULL, gfx, SERVER_GFX_W, SERVER_GFX_H, payload);
+				keyframe = server_msg_new(NETPROTO_FRAME, NETPROTO_KEYFRAME,
+						session->seq, payload, len);
+			}
+			if (client_push(client, keyframe) == 0)
+				client->keyframe = 0;
+		}
+		else
+			client_push(client, delta);
+	}
+	server_msg_unref(delta);
+	server_msg_unref(keyframe);
+
+	memcpy(session->prev, gfx, sizeof(session->prev));
+	session->seq++;
+}
+
+/* Forward what the chip8 reported during the last frame to the clients */
+static void session_handle_vm_events(session_t *session)
+{
+	chip8_event_t event;
+	char status[64];
+	unsigned char on;
+
+	while (chip8_poll_event(session->chip8, &event) == 0)
+	{
+		switch (event.type)
+		{
+			case CHIP8_EVENT_SOUND_START:
+			case CHIP8_EVENT_SOUND_STOP:
+				on = event.type == CHIP8_EVENT_SOUND_START;
+				session_broadcast(session, server_msg_new(NETPROTO_SOUND, 0,
+							session->seq, &on, 1));
+				break;
+			default:
+				snprintf(status, sizeof(status), "%s at 0x%03X (opcode 0x%04X)",
+						chip8_event_name(event.type), event.pc, event.opcode);
+				session_broadcast(session, server_msg_new(NETPROTO_STATUS, 0,
+							session->seq, status, strlen(status)));
+		}
+	}
+}
+
+/* The frame timer fired: emulate one frame and send it */
+static void session_frame(void *data)
+{
+	session_t *session = data;
+	uint64_t now = pacer_now();
+	uint64_t deadline = session->start + (session->frames + 1) * FRAME_NS;
+
+	// stay on the same grid of deadlines, skipping the missed ones
+	if (now >= deadline + FRAME_NS)
+	{
+		uint64_t behind = (now - deadline) / FRAME_NS;
+
+		session->dropped += behind;
+		session->frames += behind;
+	}
+	session->frames++;
+
+	chip8_emulate_frame(session->chip8);
+	session_handle_vm_events(session);
+	session_send_frame(session);
+
+	if (session->seq % CHIP8_FRAME_RATE == 0)
+	{
+		char status[64];
+
+		snprintf(status, sizeof(status), "session %u, %u viewers, %llu dropped",
+				session->id, session->nclients, (unsigned long long)session->dropped);
+		session_broadcast(session, server_msg_new(NETPROTO_STATUS, 0,
+					session->seq, status, strlen(status)));
+	}
+	session_flush(session);
+
+	// a halted chip8 does not change anymore, a new client still gets its
+	// screen since attaching resumes the session for one frame
+	if (!session->chip8->halted && session->nclients > 0)
+		session_schedule(session);
+}
+
+static void session_destroy(session_t *session)
+{
+	worker_t *worker = session->worker;
+	session_t **p = &worker->sessions;
+
+	server_unregister(worker->server, session);
+	timerwheel_del(&worker->wheel, &session->frame_timer);
+	timerwheel_del(&worker->wheel, &session->idle_timer);
+	while (session->clients != NULL)
+	{
+		client_t *client = session->clients;
+
+		session->clients = client->next;
+		worker_drop_client(worker, client);
+	}
+
+	while (*p != session)
+		p = &(*p)->next;
+	*p = session->next;
+	chip8_free(session->chip8);
+	free(session);
+}
+
+static void session_handle_message(session_t *session, const netproto_header_t *hdr,
+		const unsigned char *payload)
+{
+	switch (hdr->type)
+	{
+		case NETPROTO_KEY:
+			if (hdr->length >= 2 && payload[0] < 16)
+				session->chip8->key[payload[0]] = payload[1] != 0;
+			break;
+		case NETPROTO_QUIT:
+			fprintf(stderr, "Session %u destroyed by a client\n", session->id);
+			session_destroy(session);
+			break;
+		case NETPROTO_TURBO:
+			break; // the sessions always run at real speed
+	}
+}
+
+/*
+ * Handle the complete messages received from a client, until one of them
+ * destroys the session (client->session is NULL then)
+ */
+static void worker_client_input(client_t *client)
+{
+	netproto_header_t hdr;
+	size_t len;
+
+	while (client->session != NULL
+			&& (len = netproto_read_header(client->input, client->input_len, &hdr)) > 0)
+	{
+		session_handle_message(client->session, &hdr, client->input + NETPROTO_HEADER_SIZE);
+		client->input_len -= len;
+		memmove(client->input, client->input + len, client->input_len);
+	}
+	// a message which can never fit in the buffer
+	if (client->session != NULL && client->input_len == sizeof(client->input))
+		session_detach(client->session, client);
+}
+
+static void worker_client_read(client_t *client)
+{
+	ssize_t n;
+
+	n = recv(client->fd, client->input + client->input_len,
+			sizeof(client->input) - client->input_len, MSG_DONTWAIT);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return;
+	if (n <= 0)
+	{
+		session_detach(client->session, client);
+		return;
+	}
+	client->input_len += (size_t)n;
+	worker_client_input(client);
+}
+
+static session_t *worker_find(worker_t *worker, uint32_t id)
+{
+	session_t *session = worker->sessions;
+
+	while (session != NULL && session->id != id)
+		session = session->next;
+	return session;
+}
+
+/* Tell if a session, maybe freed, is still running */
+static int worker_owns(worker_t *worker, const session_t *session)
+{
+	for (session_t *s = worker->sessions; s != NULL; s = s->next)
+		if (s == session)
+			return 1;
+	return 0;
+}
+
+/* A client handed over by the acceptor joins its session */
+static void worker_attach(worker_t *worker, client_t *client)
+{
+	session_t *session = client->created;
+	unsigned char hello[3] = { NETPROTO_VERSION, SERVER_GFX_W, SERVER_GFX_H };
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = client };
+	server_msg_t *msg;
+
+	if (session != NULL)
+	{
+		session->next = worker->sessions;
+		worker->sessions = session;
+		timerwheel_timer_init(&session->frame_timer, session_frame, session);
+		timerwheel_timer_init(&session->idle_timer, session_idle, session);
+	}
+	else
+		session = worker_find(worker, client->wanted);
+
+	// destroyed since the acceptor looked it up
+	if (session == NULL)
+	{
+		client_error(client, "no such session");
+		client_free(client);
+		return;
+	}
+	if (session->nclients == SERVER_MAX_CLIENTS)
+	{
+		client_error(client, "too many clients in this session");
+		client_free(client);
+		return;
+	}
+	if (epoll_ctl(worker->epfd, EPOLL_CTL_ADD, client->fd, &ev) < 0)
+	{
+		client_free(client);
+		if (session->nclients == 0)
+			session_pause(session); // a new session must not live forever
+		return;
+	}
+
+	client->session = session;
+	client->created = NULL;
+	client->keyframe = 1;
+	client->next = session->clients;
+	session->clients = client;
+	session->nclients++;
+	// paused without client, or halted: the new client needs a frame anyway
+	if (!timerwheel_pending(&session->frame_timer))
+		session_resume(session);
+
+	msg = server_msg_new(NETPROTO_SESSION, 0, session->id, NULL, 0);
+	client_push(client, msg);
+	server_msg_unref(msg);
+	msg = server_msg_new(NETPROTO_HELLO, 0, 0, hello, sizeof(hello));
+	client_push(client, msg);
+	server_msg_unref(msg);
+
+	// the messages sent right after the ATTACH, e.g. the keys
+	worker_client_input(client);
+	if (client->session != NULL)
+		session_flush(session);
+}
+
+/* Attach the clients of the inbox, return 1 if the worker must stop */
+static int worker_inbox(worker_t *worker)
+{
+	uint64_t value;
+	client_t *inbox, *client;
+	int stop;
+
+	if (read(worker->wakefd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+		return 0;
+
+	pthread_mutex_lock(&worker->lock);
+	inbox = worker->inbox;
+	worker->inbox = NULL;
+	stop = worker->stop;
+	pthread_mutex_unlock(&worker->lock);
+
+	// the inbox is a stack, the CREATE of a session must come before the
+	// ATTACH which may follow it
+	client = NULL;
+	while (inbox != NULL)
+	{
+		client_t *next = inbox->next;
+
+		inbox->next = client;
+		client = inbox;
+		inbox = next;
+	}
+
+	while (client != NULL)
+	{
+		client_t *next = client->next;
+
+		client->next = NULL;
+		if (stop)
+		{
+			if (client->created != NULL)
+				chip8_free(client->created->chip8);
+			free(client->created);
+			client_free(client);
+		}
+		else
+			worker_attach(worker, client);
+		client = next;
+	}
+	return stop;
+}
+
+/* Time until the next tick which may fire a timer, for epoll_wait */
+static int worker_timeout(worker_t *worker)
+{
+	uint64_t next = timerwheel_next(&worker->wheel);
+	uint64_t wake, now;
+
+	if (next == UINT64_MAX)
+		return -1;
+	if (next > WORKER_MAX_SLEEP)
+		next = WORKER_MAX_SLEEP;
+	wake = worker->server->epoch + (worker->wheel.now + next) * SERVER_TICK_NS;
+	now = pacer_now();
+	return wake <= now ? 0 : (int)((wake - now + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC);
+}
+
+static void *worker_run(void *arg)
+{
+	worker_t *worker = arg;
+	struct epoll_event events[WORKER_EVENTS];
+
+	for (;;)
+	{
+		int n;
+
+		timerwheel_advance(&worker->wheel, server_tick(worker->server));
+		worker_free_detached(worker);
+
+		n = epoll_wait(worker->epfd, events, WORKER_EVENTS, worker_timeout(worker));
+		for (int i = 0; i < n; i++)
+		{
+			client_t *client = events[i].data.ptr;
+			session_t *session;
+
+			if (client == NULL)
+			{
+				if (worker_inbox(worker))
+					return NULL;
+				continue;
+			}
+			session = client->session;
+			if (session == NULL)
+				continue; // detached by a previous event
+			if (events[i].events & EPOLLOUT && client_flush(client) < 0)
+			{
+				session_detach(session, client);
+				continue;
+			}
+			if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+				worker_client_read(client);
+			if (worker_owns(worker, session)) // unless a QUIT destroyed it
+				session_flush(session);
+		}
+		worker_free_detached(worker);
+	}
+}
+
+int worker_start(worker_t *worker, server_t *server)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+
+	worker->server = server;
+	worker->sessions = NULL;
+	worker->nsessions = 0;
+	worker->detached = NULL;
+	worker->inbox = NULL;
+	worker->stop = 0;
+	timerwheel_init(&worker->wheel, server_tick(server));
+	pthread_mutex_init(&worker->lock, NULL);
+
+	worker->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (worker->epfd < 0)
+		return -1;
+	worker->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (worker->wakefd < 0 || epoll_ctl(worker->epfd, EPOLL_CTL_ADD, worker->wakefd, &ev) < 0)
+	{
+		close(worker->epfd);
+		return -1;
+	}
+	if (pthread_create(&worker->thread, NULL, worker_run, worker) != 0)
+	{
+		close(worker->wakefd);
+		close(worker->epfd);
+		return -1;
+	}
+	return 0;
+}
+
+static void worker_wake(worker_t *worker)
+{
+	uint64_t one = 1;
+
+	if (write(worker->wakefd, &one, sizeof(one)) < 0)
+		perror("Failed to wake a worker: ");
+}
+
+void worker_stop(worker_t *worker)
+{
+	pthread_mutex_lock(&worker->lock);
+	worker->stop = 1;
+	pthread_mutex_unlock(&worker->lock);
+	worker_wake(worker);
+	pthread_join(worker->thread, NULL);
+
+	// the thread is gone, its sessions can be destroyed from here
+	while (worker->sessions != NULL)
+		session_destroy(worker->sessions);
+	worker_free_detached(worker);
+	close(worker->wakefd);
+	close(worker->epfd);
+	pthread_mutex_destroy(&worker->lock);
+}
+
+void worker_handoff(worker_t *worker, client_t *client)
+{
+	pthread_mutex_lock(&worker->lock);
+	client->next = worker->inbox;
+	worker->inbox = client;
+	pthread_mutex_unlock(&worker->lock);
+	worker_wake(worker);
+}
@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "capture.h"
+#include "ring.h"
+#include "rle.h"
+
+#define CAPTURE_BITS (CAPTURE_MAX_PIXELS / 8)
+
+/* A frame in the queue, packed by the emulation thread */
+struct capture_slot_s {
+	uint32_t frame;
+	unsigned char bits[CAPTURE_BITS];
+};
+
+struct capture_s {
+	FILE *file;
+	size_t size; /* bytes of packed pixels per frame */
+
+	ring_t queue; /* of struct capture_slot_s */
+	sem_t pending; /* one post per queued frame, and one to stop */
+	pthread_t writer;
+	int stop;
+	int error; /* a write failed */
+
+	uint32_t frame; /* number of the next frame */
+	unsigned long dropped;
+};
+
+static void capture_pack(const unsigned char *gfx, size_t pixels, unsigned char *bits)
+{
+	memset(bits, 0, pixels / 8);
+	for (size_t i = 0; i < pixels; i++)
+		if (gfx[i])
+			bits[i / 8] |= (unsigned char)(0x80 >> (i % 8));
+}
+
+static void capture_unpack(const unsigned char *bits, size_t pixels, unsigned char *gfx)
+{
+	for (size_t i = 0; i < pixels; i++)
+		gfx[i] = (bits[i / 8] >> (7 - i % 8)) & 1;
+}
+
+static void capture_write_record(struct capture_s *capture, int type, uint32_t frame,
+		const unsigned char *data, size_t len)
+{
+	unsigned char record[CAPTURE_RECORD_SIZE] = {
+		(unsigned char)type,
+		(unsigned char)(frame >> 24), (unsigned char)(frame >> 16),
+		(unsigned char)(frame >> 8), (unsigned char)frame,
+		(unsigned char)(len >> 8), (unsigned char)len,
+	};
+
+	if (fwrite(record, sizeof(record), 1, capture->file) != 1
+			|| fwrite(data, len, 1, capture->file) != 1)
+		capture->error = 1;
+}
+
+/* Compress and write the queued frames, the only thread doing I/O */
+static void *capture_writer(void *arg)
+{
+	struct capture_s *capture = arg;
+	struct capture_slot_s slot;
+	unsigned char prev[CAPTURE_BITS] = { 0 };
+	unsigned char delta[CAPTURE_BITS];
+	unsigned char data[RLE_BYTES_MAX_SIZE(CAPTURE_BITS)];
+	uint32_t keyframe = 0;
+	int first = 1;
+
+	while (1)
+	{
+		sem_wait(&capture->pending);
+		if (ring_pop(&capture->queue, &slot) < 0)
+		{
+			if (__atomic_load_n(&capture->stop, __ATOMIC_ACQUIRE))
+				break;
+			continue;
+		}
+
+		if (first || slot.frame - keyframe >= CAPTURE_KEYFRAME_INTERVAL)
+		{
+			size_t len = rle_encode_bytes(slot.bits, capture->size, data);
+
+			capture_write_record(capture, CAPTURE_KEYFRAME, slot.frame, data, len);
+			keyframe = slot.frame;
+			first = 0;
+		}
+		else
+		{
+			for (size_t i = 0; i < capture->size; i++)
+				delta[i] = prev[i] ^ slot.bits[i];
+			size_t len = rle_encode_bytes(delta, capture->size, data);
+			capture_write_record(capture, CAPTURE_DELTA, slot.frame, data, len);
+		}
+		memcpy(prev, slot.bits, capture->size);
+	}
+	return NULL;
+}
+
+capture_t *capture_open(const char *path, int width, int height, int rate)
+{
+	struct capture_s *capture;
+	unsigned char header[CAPTURE_HEADER_SIZE] = {
+		[4] = CAPTURE_VERSION, // after CAPTURE_MAGIC, copied below
+		(unsigned char)width, (unsigned char)height, (unsigned char)rate,
+		CAPTURE_KEYFRAME_INTERVAL >> 8, CAPTURE_KEYFRAME_INTERVAL & 0xFF,
+	};
+
+	if (width * height > CAPTURE_MAX_PIXELS || (width * height) % 8 != 0)
+		return NULL;
+
+	capture = calloc(1, sizeof(*capture));
+	if (capture == NULL)
+		return NULL;
+	capture->size = (size_t)(width * height) / 8;
+
+	capture->file = fopen(path, "wb");
+	if (capture->file == NULL)
+		goto err_free;
+	memcpy(header, CAPTURE_MAGIC, 4);
+	if (fwrite(header, sizeof(header), 1, capture->file) != 1)
+		goto err_close;
+	if (ring_init(&capture->queue, sizeof(struct capture_slot_s), CAPTURE_QUEUE) < 0)
+		goto err_close;
+	if (sem_init(&capture->pending, 0, 0) < 0)
+		goto err_ring;
+	if (pthread_create(&capture->writer, NULL, capture_writer, capture) != 0)
+		goto err_sem;
+	return capture;
+
+err_sem:
+	sem_destroy(&capture->pending);
+err_ring:
+	ring_destroy(&capture->queue);
+err_close:
+	fclose(capture->file);
+err_free:
+	free(capture);
+	return NULL;
+}
+
+int capture_frame(capture_t *capture, const unsigned char *gfx)
+{
+	struct capture_slot_s *slot = ring_reserve(&capture->queue);
+	uint32_t frame = capture->frame++;
+
+	if (slot == NULL)
+	{
+		capture->dropped++;
+		return -1;
+	}
+	// packed here: 8 times less to copy through the queue
+	slot->frame = frame;
+	capture_pack(gfx, capture->size * 8, slot->bits);
+	ring_commit(&capture->queue);
+	sem_post(&capture->pending);
+	return 0;
+}
+
+unsigned long capture_dropped(const capture_t *capture)
+{
+	return capture->dropped;
+}
+
+int capture_close(capture_t *capture)
+{
+	int error;
+
+	__atomic_store_n(&capture->stop, 1, __ATOMIC_RELEASE);
+	sem_post(&capture->pending);
+	pthread_join(capture->writer, NULL);
+
+	error = capture->error;
+	if (fclose(capture->file) != 0)
+		error = 1;
+	sem_destroy(&capture->pending);
+	ring_destroy(&capture->queue);
+	free(capture);
+	return error ? -1 : 0;
+}
+
+int capture_reader_open(capture_reader_t *reader, const char *path)
+{
+	unsigned char header[CAPTURE_HEADER_SIZE];
+
+	reader->file = fopen(path, "rb");
+	if (reader->file == NULL)
+		return -1;
+	if (fread(header, sizeof(header), 1, reader->file) != 1
+			|| memcmp(header, CAPTURE_MAGIC, 4) != 0
+			|| header[4] != CAPTURE_VERSION
+			|| header[5] * header[6] > CAPTURE_MAX_PIXELS
+			|| header[5] * header[6] % 8 != 0)
+	{
+		fclose(reader->file);
+		return -1;
+	}
+
+	reader->width = header[5];
+	reader->height = header[6];
+	reader->rate = header[7];
+	reader->keyframe_interval = (unsigned)(header[8] << 8 | header[9]);
+	memset(reader->bits, 0, sizeof(reader->bits));
+	return 0;
+}
+
+int capture_reader_next(capture_reader_t *reader, unsigned char *gfx, uint32_t *frame)
+{
+	unsigned char record[CAPTURE_RECORD_SIZE];
+	unsigned char data[RLE_BYTES_MAX_SIZE(CAPTURE_BITS)];
+	unsigned char bits[CAPTURE_BITS];
+	size_t size = (size_t)(reader->width * reader->height) / 8;
+	size_t len;
+
+	if (fread(record, sizeof(record), 1, reader->file) != 1)
+		return feof(reader->file) ? 0 : -1;
+	len = (size_t)(record[5] << 8 | record[6]);
+	if (len > sizeof(data) || fread(data, len, 1, reader->file) != 1)
+		return -1;
+	if (rle_decode_bytes(data, len, bits, size) != len)
+		return -1;
+
+	switch (record[0])
+	{
+		case CAPTURE_KEYFRAME:
+			memcpy(reader->bits, bits, size);
+			break;
+		case CAPTURE_DELTA:
+			for (size_t i = 0; i < size; i++)
+				reader->bits[i] ^= bits[i];
+			break;
+		default:
+			return -1;
+	}
+
+	*frame = (uint32_t)record[1] << 24 | (uint32_t)record[2] << 16
+		| (uint32_t)record[3] << 8 | record[4];
+	capture_unpack(reader->bits, size * 8, gfx);
+	return 1;
+}
+
+void capture_reader_close(capture_reader_t *reader)
+{
+	fclose(reader->file);
+}
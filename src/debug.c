@@ -0,0 +1,356 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "debug.h"
+#include "disasm.h"
+
+static const char *const chip8_reg_names[CHIP8_REG_COUNT] = {
+	"V0", "V1", "V2", "V3", "V4", "V5", "V6", "V7",
+	"V8", "V9", "VA", "VB", "VC", "VD", "VE", "VF",
+	"I", "DT", "ST", "SP",
+};
+
+chip8_debug_t *chip8_debug_attach(chip8_t *chip8)
+{
+	if (chip8->debug == NULL)
+		chip8->debug = calloc(1, sizeof(*chip8->debug));
+	return chip8->debug;
+}
+
+void chip8_debug_detach(chip8_t *chip8)
+{
+	free(chip8->debug);
+	chip8->debug = NULL;
+}
+
+uint16_t chip8_debug_reg(const chip8_t *chip8, unsigned reg)
+{
+	if (reg < 16)
+		return chip8->V[reg];
+	switch (reg)
+	{
+		case CHIP8_REG_I:
+			return chip8->I;
+		case CHIP8_REG_DT:
+			return chip8->delay_timer;
+		case CHIP8_REG_ST:
+			return chip8->sound_timer;
+		case CHIP8_REG_SP:
+			return chip8->sp;
+	}
+	return 0;
+}
+
+int chip8_debug_reg_by_name(const char *name)
+{
+	for (int i = 0; i < CHIP8_REG_COUNT; i++)
+		if (strcasecmp(chip8_reg_names[i], name) == 0)
+			return i;
+	return -1;
+}
+
+int chip8_debug_condition(chip8_t *chip8, unsigned reg, chip8_cond_t type, uint16_t value)
+{
+	chip8_debug_t *dbg = chip8->debug;
+
+	for (int i = 0; i < CHIP8_DEBUG_CONDITIONS; i++)
+		if (!dbg->conditions[i].used)
+		{
+			dbg->conditions[i].used = 1;
+			dbg->conditions[i].reg = (unsigned char)reg;
+			dbg->conditions[i].type = (unsigned char)type;
+			dbg->conditions[i].value = value;
+			return i;
+		}
+	return -1;
+}
+
+void chip8_debug_continue(chip8_t *chip8, unsigned long steps)
+{
+	chip8->debug->stop = CHIP8_DEBUG_RUNNING;
+	chip8->debug->steps = steps;
+	chip8->debug->resume = 1;
+}
+
+void chip8_debug_interrupt(chip8_t *chip8)
+{
+	chip8_debug_t *dbg = chip8->debug;
+
+	if (dbg != NULL)
+		__atomic_store_n(&dbg->interrupt, 1, __ATOMIC_RELEASE);
+}
+
+chip8_debug_stop_t chip8_debug_stopped(const chip8_t *chip8)
+{
+	return chip8->debug != NULL ? chip8->debug->stop : CHIP8_DEBUG_RUNNING;
+}
+
+static int chip8_debug_stop(chip8_debug_t *dbg, chip8_debug_stop_t stop, uint16_t pc,
+		uint16_t info)
+{
+	dbg->stop = stop;
+	dbg->stop_pc = pc;
+	dbg->stop_info = info;
+	return 1;
+}
+
+int chip8_debug_before(chip8_t *chip8)
+{
+	chip8_debug_t *dbg = chip8->debug;
+	uint16_t pc = chip8->pc;
+	uint16_t opcode = (uint16_t)(chip8_read(chip8, pc & 0xFFFu) << 8 | chip8_read(chip8, (pc + 1u) & 0xFFF));
+	int resume = dbg->resume;
+	unsigned start = chip8->I, len = 0;
+
+	if (dbg->stop != CHIP8_DEBUG_RUNNING)
+		return 1;
+	dbg->resume = 0;
+	if (__atomic_exchange_n(&dbg->interrupt, 0, __ATOMIC_ACQ_REL))
+		return chip8_debug_stop(dbg, CHIP8_DEBUG_INTERRUPT, pc, 0);
+	if (dbg->breakpoints[pc] && !resume)
+		return chip8_debug_stop(dbg, CHIP8_DEBUG_BREAKPOINT, pc, 0);
+
+	dbg->stop_pc = pc;
+	for (unsigned reg = 0; reg < CHIP8_REG_COUNT; reg++)
+		dbg->regs[reg] = chip8_debug_reg(chip8, reg);
+
+	// the only instructions writing to the memory
+	if ((opcode & 0xF0FF) == 0xF033)
+		len = 3;
+	else if ((opcode & 0xF0FF) == 0xF055)
+		len = ((opcode & 0x0F00u) >> 8) + 1;
+
+	dbg->write_len = 0;
+	for (unsigned i = 0; i < len && start + i < sizeof(dbg->watchpoints); i++)
+		if (dbg->watchpoints[start + i])
+		{
+			dbg->write_start = (uint16_t)start;
+			dbg->write_len = (uint16_t)len;
+			for (unsigned j = 0; j < len && start + j < CHIP8_MEMORY_SIZE; j++)
+				dbg->write_old[j] = chip8_read(chip8, start + j);
+			break;
+		}
+	return 0;
+}
+
+int chip8_debug_after(chip8_t *chip8)
+{
+	chip8_debug_t *dbg = chip8->debug;
+	uint16_t pc = dbg->stop_pc;
+
+	if (dbg->write_len > 0)
+	{
+		for (unsigned i = 0; i < dbg->write_len; i++)
+			if (dbg->watchpoints[(dbg->write_start + i) & 0xFFF])
+				return chip8_debug_stop(dbg, CHIP8_DEBUG_WATCHPOINT, pc,
+						(uint16_t)(dbg->write_start + i));
+	}
+
+	for (int i = 0; i < CHIP8_DEBUG_CONDITIONS; i++)
+	{
+		unsigned reg = dbg->conditions[i].reg;
+		uint16_t value = chip8_debug_reg(chip8, reg);
+
+		if (!dbg->conditions[i].used)
+			continue;
+		if (dbg->conditions[i].type == CHIP8_COND_CHANGE ? value != dbg->regs[reg]
+				: value == dbg->conditions[i].value && dbg->regs[reg] != value)
+			return chip8_debug_stop(dbg, CHIP8_DEBUG_CONDITION, pc, (uint16_t)i);
+	}
+
+	if (dbg->steps > 0 && --dbg->steps == 0)
+		return chip8_debug_stop(dbg, CHIP8_DEBUG_STEP, pc, 0);
+	return 0;
+}
+
+static void chip8_debug_print_insn(const chip8_t *chip8, uint16_t addr, FILE *out)
+{
+	uint16_t opcode = (uint16_t)(chip8_read(chip8, addr & 0xFFFu) << 8 | chip8_read(chip8, (addr + 1u) & 0xFFF));
+	char text[32];
+
+	chip8_disassemble(opcode, text, sizeof(text));
+	fprintf(out, "%c%c 0x%03X: %04X  %s\n",
+			addr == chip8->pc ? '>' : ' ',
+			chip8->debug->breakpoints[addr & 0xFFF] ? '*' : ' ',
+			addr, opcode, text);
+}
+
+static void chip8_debug_print_stop(const chip8_t *chip8, FILE *out)
+{
+	const chip8_debug_t *dbg = chip8->debug;
+
+	switch (dbg->stop)
+	{
+		case CHIP8_DEBUG_BREAKPOINT:
+			fprintf(out, "Breakpoint at 0x%03X\n", dbg->stop_pc);
+			break;
+		case CHIP8_DEBUG_WATCHPOINT:
+		{
+			unsigned offset = dbg->stop_info - dbg->write_start;
+
+			fprintf(out, "Watchpoint 0x%03X written by 0x%03X: 0x%02X -> 0x%02X\n",
+					dbg->stop_info, dbg->stop_pc, dbg->write_old[offset],
+					chip8_read(chip8, dbg->stop_info));
+			break;
+		}
+		case CHIP8_DEBUG_CONDITION:
+		{
+			unsigned reg = dbg->conditions[dbg->stop_info].reg;
+
+			fprintf(out, "Condition %u by 0x%03X: %s 0x%X -> 0x%X\n", dbg->stop_info,
+					dbg->stop_pc, chip8_reg_names[reg], dbg->regs[reg],
+					chip8_debug_reg(chip8, reg));
+			break;
+		}
+		case CHIP8_DEBUG_INTERRUPT:
+			fprintf(out, "Interrupted\n");
+			break;
+		case CHIP8_DEBUG_STEP:
+		case CHIP8_DEBUG_RUNNING:
+			break;
+	}
+	chip8_debug_print_insn(chip8, chip8->pc, out);
+}
+
+static void chip8_debug_print_regs(const chip8_t *chip8, FILE *out)
+{
+	for (unsigned reg = 0; reg < 16; reg++)
+		fprintf(out, "V%X=%02X%c", reg, chip8->V[reg], reg % 8 == 7 ? '\n' : ' ');
+	fprintf(out, "PC=%03X I=%03X SP=%X DT=%02X ST=%02X\n", chip8->pc, chip8->I,
+			chip8->sp, chip8->delay_timer, chip8->sound_timer);
+	for (unsigned i = 0; i < chip8->sp && i < 16; i++)
+		fprintf(out, "  stack[%u]=%03X\n", i, chip8->stack[i]);
+}
+
+static void chip8_debug_help(FILE *out)
+{
+	fprintf(out,
+		"c              continue\n"
+		"s [N]          execute N instructions (1 by default)\n"
+		"b [ADDR]       toggle a breakpoint, list them without ADDR\n"
+		"w ADDR [LEN]   toggle a watchpoint on the writes to the memory\n"
+		"cond REG       stop when REG (V0-VF, I, DT, ST, SP) changes\n"
+		"cond REG VAL   stop when REG becomes VAL\n"
+		"uncond N       remove the condition N\n"
+		"r              show the registers\n"
+		"x ADDR [LEN]   dump the memory\n"
+		"l [ADDR] [N]   disassemble N instructions (10 by default)\n"
+		"detach         detach the debugger and continue at full speed\n"
+		"q              quit\n"
+		"The numbers are in hexadecimal, an empty line repeats the last command.\n");
+}
+
+/* Parse a hexadecimal number, return -1 if invalid */
+static long chip8_debug_number(const char *arg)
+{
+	char *end;
+	long value;
+
+	if (arg == NULL)
+		return -1;
+	value = strtol(arg, &end, 16);
+	return *end == '\0' && value >= 0 ? value : -1;
+}
+
+int chip8_debug_repl(chip8_t *chip8, FILE *in, FILE *out)
+{
+	chip8_debug_t *dbg = chip8->debug;
+	char line[sizeof(dbg->last)];
+
+	chip8_debug_print_stop(chip8, out);
+	while (1)
+	{
+		char *argv[4] = { NULL };
+		int argc = 0;
+
+		fprintf(out, "(chip8) ");
+		fflush(out);
+		if (fgets(line, sizeof(line), in) == NULL)
+			return -1;
+		if (strspn(line, " \t\n") == strlen(line))
+			strcpy(line, dbg->last);
+		else
+			strcpy(dbg->last, line);
+
+		for (char *tok = strtok(line, " \t\n"); tok != NULL && argc < 4; tok = strtok(NULL, " \t\n"))
+			argv[argc++] = tok;
+		if (argc == 0)
+			continue;
+
+		const char *cmd = argv[0];
+		long a = chip8_debug_number(argv[1]);
+		long b = chip8_debug_number(argv[2]);
+
+		if (strcmp(cmd, "c") == 0)
+		{
+			chip8_debug_continue(chip8, 0);
+			return 0;
+		}
+		else if (strcmp(cmd, "s") == 0)
+		{
+			chip8_debug_continue(chip8, argc > 1 && a > 0 ? (unsigned long)a : 1);
+			return 0;
+		}
+		else if (strcmp(cmd, "b") == 0 && argc == 1)
+		{
+			for (unsigned addr = 0; addr < sizeof(dbg->breakpoints); addr++)
+				if (dbg->breakpoints[addr])
+					chip8_debug_print_insn(chip8, (uint16_t)addr, out);
+		}
+		else if (strcmp(cmd, "b") == 0 && a >= 0 && a < 0x1000)
+		{
+			dbg->breakpoints[a] = !dbg->breakpoints[a];
+			fprintf(out, "Breakpoint at 0x%03lX %s\n", a, dbg->breakpoints[a] ? "set" : "removed");
+		}
+		else if (strcmp(cmd, "w") == 0 && a >= 0 && a < 0x1000)
+		{
+			long len = argc > 2 ? b : 1;
+
+			for (long i = 0; i < len && a + i < 0x1000; i++)
+				dbg->watchpoints[a + i] = !dbg->watchpoints[a + i];
+			fprintf(out, "Watchpoint at 0x%03lX %s\n", a, dbg->watchpoints[a] ? "set" : "removed");
+		}
+		else if (strcmp(cmd, "cond") == 0 && argc > 1 && chip8_debug_reg_by_name(argv[1]) >= 0)
+		{
+			int reg = chip8_debug_reg_by_name(argv[1]);
+			int index = argc > 2 ?
+				chip8_debug_condition(chip8, (unsigned)reg, CHIP8_COND_EQUAL, (uint16_t)b) :
+				chip8_debug_condition(chip8, (unsigned)reg, CHIP8_COND_CHANGE, 0);
+
+			if (index < 0)
+				fprintf(out, "Too many conditions\n");
+			else
+				fprintf(out, "Condition %d set\n", index);
+		}
+		else if (strcmp(cmd, "uncond") == 0 && a >= 0 && a < CHIP8_DEBUG_CONDITIONS)
+			dbg->conditions[a].used = 0;
+		else if (strcmp(cmd, "r") == 0)
+			chip8_debug_print_regs(chip8, out);
+		else if (strcmp(cmd, "x") == 0 && a >= 0 && a < 0x1000)
+		{
+			long len = argc > 2 && b > 0 ? b : 16;
+
+			for (long i = 0; i < len && a + i < 0x1000; i++)
+				fprintf(out, "%s%02X", i % 16 == 0 ? (i ? "\n" : "") : " ", chip8_read(chip8, (unsigned)(a + i)));
+			fprintf(out, "\n");
+		}
+		else if (strcmp(cmd, "l") == 0)
+		{
+			long addr = argc > 1 && a >= 0 ? a : chip8->pc;
+			long n = argc > 2 && b > 0 ? b : 10;
+
+			for (long i = 0; i < n && addr + 2 * i < 0x1000; i++)
+				chip8_debug_print_insn(chip8, (uint16_t)(addr + 2 * i), out);
+		}
+		else if (strcmp(cmd, "detach") == 0)
+		{
+			chip8_debug_detach(chip8);
+			return 0;
+		}
+		else if (strcmp(cmd, "q") == 0)
+			return -1;
+		else
+			chip8_debug_help(out);
+	}
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+
+#include "disasm.h"
+
+void chip8_disassemble(uint16_t opcode, char *buf, size_t size)
+{
+	unsigned nnn = opcode & 0x0FFFu;
+	unsigned nn = opcode & 0x00FFu;
+	unsigned n = opcode & 0x000Fu;
+	unsigned x = (opcode & 0x0F00u) >> 8;
+	unsigned y = (opcode & 0x00F0u) >> 4;
+
+	switch (opcode >> 12)
+	{
+		case 0x0:
+			if (opcode == 0x00E0)
+				snprintf(buf, size, "CLS");
+			else if (opcode == 0x00EE)
+				snprintf(buf, size, "RET");
+			else
+				snprintf(buf, size, "SYS 0x%03X", nnn);
+			return;
+		case 0x1:
+			snprintf(buf, size, "JP 0x%03X", nnn);
+			return;
+		case 0x2:
+			snprintf(buf, size, "CALL 0x%03X", nnn);
+			return;
+		case 0x3:
+			snprintf(buf, size, "SE V%X, 0x%02X", x, nn);
+			return;
+		case 0x4:
+			snprintf(buf, size, "SNE V%X, 0x%02X", x, nn);
+			return;
+		case 0x5:
+			if (n != 0)
+				break;
+			snprintf(buf, size, "SE V%X, V%X", x, y);
+			return;
+		case 0x6:
+			snprintf(buf, size, "LD V%X, 0x%02X", x, nn);
+			return;
+		case 0x7:
+			snprintf(buf, size, "ADD V%X, 0x%02X", x, nn);
+			return;
+		case 0x8:
+		{
+			static const char *const ops[16] = {
+				[0x0] = "LD", [0x1] = "OR", [0x2] = "AND", [0x3] = "XOR",
+				[0x4] = "ADD", [0x5] = "SUB", [0x6] = "SHR", [0x7] = "SUBN",
+				[0xE] = "SHL",
+			};
+
+			if (ops[n] == NULL)
+				break;
+			snprintf(buf, size, "%s V%X, V%X", ops[n], x, y);
+			return;
+		}
+		case 0x9:
+			if (n != 0)
+				break;
+			snprintf(buf, size, "SNE V%X, V%X", x, y);
+			return;
+		case 0xA:
+			snprintf(buf, size, "LD I, 0x%03X", nnn);
+			return;
+		case 0xB:
+			snprintf(buf, size, "JP V0, 0x%03X", nnn);
+			return;
+		case 0xC:
+			snprintf(buf, size, "RND V%X, 0x%02X", x, nn);
+			return;
+		case 0xD:
+			snprintf(buf, size, "DRW V%X, V%X, %u", x, y, n);
+			return;
+		case 0xE:
+			if (nn == 0x9E)
+				snprintf(buf, size, "SKP V%X", x);
+			else if (nn == 0xA1)
+				snprintf(buf, size, "SKNP V%X", x);
+			else
+				break;
+			return;
+		case 0xF:
+			switch (nn)
+			{
+				case 0x07: snprintf(buf, size, "LD V%X, DT", x); return;
+				case 0x0A: snprintf(buf, size, "LD V%X, K", x); return;
+				case 0x15: snprintf(buf, size, "LD DT, V%X", x); return;
+				case 0x18: snprintf(buf, size, "LD ST, V%X", x); return;
+				case 0x1E: snprintf(buf, size, "ADD I, V%X", x); return;
+				case 0x29: snprintf(buf, size, "LD F, V%X", x); return;
+				case 0x33: snprintf(buf, size, "LD B, V%X", x); return;
+				case 0x55: snprintf(buf, size, "LD [I], V%X", x); return;
+				case 0x65: snprintf(buf, size, "LD V%X, [I]", x); return;
+			}
+			break;
+	}
+	snprintf(buf, size, "DW 0x%04X", opcode);
+}
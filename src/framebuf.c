@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "framebuf.h"
+#include "pacer.h"
+
+/* a reader retries when the writer overwrites the slot it was taking */
+#define FRAMEBUF_RETRIES 16
+
+static size_t framebuf_size(unsigned width, unsigned height)
+{
+	return sizeof(framebuf_page_t) + 2 * (size_t)width * height;
+}
+
+static int framebuf_path(char *path, size_t size, const char *name)
+{
+	if (strchr(name, '/') != NULL || strlen(name) >= FRAMEBUF_NAME)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	snprintf(path, size, "/" FRAMEBUF_PREFIX "%s", name);
+	return 0;
+}
+
+static unsigned char *framebuf_pixels(const framebuf_page_t *page, uint32_t seq)
+{
+	return (unsigned char *)page->pixels + (seq & 1) * (size_t)page->width * page->height;
+}
+
+framebuf_page_t *framebuf_open(const char *name, int width, int height)
+{
+	char path[64];
+	size_t size;
+	framebuf_page_t *page;
+	int fd;
+
+	if (width <= 0 || height <= 0 || width > UINT16_MAX || height > UINT16_MAX
+			|| framebuf_path(path, sizeof(path), name) < 0)
+		return NULL;
+	size = framebuf_size((unsigned)width, (unsigned)height);
+	fd = shm_open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, (off_t)size) < 0)
+	{
+		close(fd);
+		shm_unlink(path);
+		return NULL;
+	}
+	page = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED)
+	{
+		shm_unlink(path);
+		return NULL;
+	}
+
+	page->version = FRAMEBUF_VERSION;
+	page->pid = (uint32_t)getpid();
+	strcpy(page->name, name);
+	page->width = (uint16_t)width;
+	page->height = (uint16_t)height;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(page->magic, FRAMEBUF_MAGIC, sizeof(page->magic));
+	return page;
+}
+
+void framebuf_publish(framebuf_page_t *page, const unsigned char *gfx, uint64_t frame)
+{
+	// only this process writes, 0 is kept for "no frame" when seq wraps
+	uint32_t seq = page->seq + 1 != 0 ? page->seq + 1 : 2;
+	framebuf_slot_t *slot = &page->slots[seq & 1];
+	unsigned char *pixels;
+
+	__atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	// the chip8 lights its pixels with 0xFF, the readers get 0 or 1
+	pixels = framebuf_pixels(page, seq);
+	for (size_t i = 0; i < (size_t)page->width * page->height; i++)
+		pixels[i] = gfx[i] != 0;
+	__atomic_store_n(&slot->frame, frame, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->time, pacer_now(), __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+
+	// either the reader sees the new seq before sleeping, or we see it waiting
+	__atomic_store_n(&page->seq, seq, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&page->waiters, __ATOMIC_SEQ_CST) != 0)
+		syscall(SYS_futex, &page->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+void framebuf_close(framebuf_page_t *page)
+{
+	char path[64];
+
+	if (page == NULL)
+		return;
+	framebuf_path(path, sizeof(path), page->name);
+	munmap(page, framebuf_size(page->width, page->height));
+	shm_unlink(path);
+}
+
+framebuf_page_t *framebuf_attach(const char *name)
+{
+	char path[64];
+	struct stat st;
+	framebuf_page_t *page;
+	size_t size;
+	int fd;
+
+	if (framebuf_path(path, sizeof(path), name) < 0)
+		return NULL;
+	// writable for the count of the waiters
+	fd = shm_open(path, O_RDWR, 0);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*page))
+	{
+		close(fd);
+		return NULL;
+	}
+	page = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED)
+		return NULL;
+
+	size = (size_t)st.st_size;
+	if (memcmp(page->magic, FRAMEBUF_MAGIC, sizeof(page->magic)) != 0)
+		goto invalid;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (page->version != FRAMEBUF_VERSION || framebuf_size(page->width, page->height) != size)
+		goto invalid;
+	return page;
+
+invalid:
+	munmap(page, size);
+	return NULL;
+}
+
+void framebuf_detach(framebuf_page_t *page)
+{
+	munmap(page, framebuf_size(page->width, page->height));
+}
+
+int framebuf_wait(framebuf_page_t *page, uint32_t seq, int timeout_ms)
+{
+	uint64_t deadline = pacer_now() + (uint64_t)timeout_ms * 1000000;
+
+	while (__atomic_load_n(&page->seq, __ATOMIC_SEQ_CST) == seq)
+	{
+		struct timespec timeout, *ptimeout = NULL;
+		long ret;
+
+		if (timeout_ms >= 0)
+		{
+			uint64_t now = pacer_now();
+
+			if (now >= deadline)
+				return -1;
+			timeout.tv_sec = (time_t)((deadline - now) / NSEC_PER_SEC);
+			timeout.tv_nsec = (long)((deadline - now) % NSEC_PER_SEC);
+			ptimeout = &timeout;
+		}
+		__atomic_add_fetch(&page->waiters, 1, __ATOMIC_SEQ_CST);
+		// sleeps only if seq was not changed in the meantime
+		ret = syscall(SYS_futex, &page->seq, FUTEX_WAIT, seq, ptimeout, NULL, 0);
+		__atomic_sub_fetch(&page->waiters, 1, __ATOMIC_SEQ_CST);
+		if (ret < 0 && errno == EINTR)
+			return -1;
+	}
+	return 0;
+}
+
+int framebuf_acquire(const framebuf_page_t *page, framebuf_frame_t *frame)
+{
+	for (unsigned i = 0; i < FRAMEBUF_RETRIES; i++)
+	{
+		uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+		const framebuf_slot_t *slot = &page->slots[seq & 1];
+
+		if (seq == 0)
+			return -1;
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq)
+			continue;
+		frame->seq = seq;
+		frame->frame = __atomic_load_n(&slot->frame, __ATOMIC_RELAXED);
+		frame->time = __atomic_load_n(&slot->time, __ATOMIC_RELAXED);
+		frame->pixels = framebuf_pixels(page, seq);
+		if (framebuf_valid(page, frame))
+			return 0;
+	}
+	return -1;
+}
+
+int framebuf_valid(const framebuf_page_t *page, const framebuf_frame_t *frame)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&page->slots[frame->seq & 1].seq, __ATOMIC_RELAXED) == frame->seq;
+}
@@ -61,6 +61,37 @@ void update_window(window_t *window, const unsigned char *gfx)
 	refresh();
 }
 
+void window_status(window_t *window, const char *status)
+{
+	struct window_s *win = window;
+
+	mvprintw(win->h, 0, "%s", status);
+	clrtoeol();
+}
+
+void window_sound(window_t *window, int on)
+{
+	(void)window;
+	// the terminal can only ring the bell
+	if (on)
+		beep();
+}
+
+void window_suspend(window_t *window)
+{
+	(void)window;
+	// back to the shell mode, the screen is kept for window_resume
+	def_prog_mode();
+	endwin();
+}
+
+void window_resume(window_t *window)
+{
+	(void)window;
+	reset_prog_mode();
+	refresh();
+}
+
 int handle_event(unsigned char *keyboard)
 {
 	// clear the keyboard before adding the new input
@@ -72,7 +103,9 @@ int handle_event(unsigned char *keyboard)
 		case 3:
 		// C^c
 		case 26:
-			return 1;
+			return WINDOW_EVENT_QUIT;
+		case '\t':
+			return WINDOW_EVENT_TURBO;
 		case '1':
 			keyboard[0] = 1;
 			break;
@@ -0,0 +1,412 @@
+/*
+ * Headless backend streaming the screen to remote viewers, see
+ * include/netproto.h for the protocol.
+ * The address is read from the CHIP8_NET environment variable
+ * (NETPROTO_DEFAULT_ADDR by default). Every viewer gets the same messages:
+ * each one is encoded once and shared by the send queues of all the viewers.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "window.h"
+#include "netproto.h"
+
+#define NET_MAX_CLIENTS 32
+/* messages waiting to be sent to a viewer, it is too slow beyond that */
+#define NET_QUEUE 32
+#define NET_INPUT 256
+
+/* messages a viewer did not get because its queue was full */
+#define NET_MISSED_SOUND 1
+#define NET_MISSED_STATUS 2
+
+/* A message shared by all the send queues */
+struct net_msg_s {
+	unsigned refs;
+	size_t len;
+	unsigned char data[];
+};
+
+struct net_client_s {
+	int fd; /* -1 when the slot is free */
+	struct net_msg_s *queue[NET_QUEUE];
+	unsigned head; /* first message to send */
+	unsigned count;
+	size_t offset; /* bytes of the first message already sent */
+	int keyframe; /* the viewer needs all the rows on the next frame */
+	int missed; /* NET_MISSED_XXX, the last ones are sent again */
+	unsigned char keys[16]; /* held by this viewer */
+
+	unsigned char input[NET_INPUT];
+	size_t input_len;
+};
+
+struct window_s {
+	int fd; /* listening socket */
+	int w;
+	int h;
+
+	uint32_t seq; /* number of the next frame */
+	unsigned char *prev; /* last frame sent */
+	struct net_msg_s *sound; /* last ones sent, for the viewers which missed them */
+	struct net_msg_s *status;
+	int events; /* WINDOW_EVENT_XXX requested by the viewers */
+
+	struct net_client_s clients[NET_MAX_CLIENTS];
+};
+
+/* handle_event does not get the window */
+static struct window_s *net_window;
+
+static struct net_msg_s *net_msg_new(uint8_t type, uint8_t flags, uint32_t seq,
+		const void *payload, size_t len)
+{
+	struct net_msg_s *msg = malloc(sizeof(*msg) + NETPROTO_HEADER_SIZE + len);
+	netproto_header_t hdr = {
+		.type = type,
+		.flags = flags,
+		.length = (uint16_t)len,
+		.seq = seq,
+	};
+
+	if (msg == NULL)
+		return NULL;
+	msg->refs = 1;
+	msg->len = NETPROTO_HEADER_SIZE + len;
+	netproto_write_header(msg->data, &hdr);
+	memcpy(msg->data + NETPROTO_HEADER_SIZE, payload, len);
+	return msg;
+}
+
+static void net_msg_unref(struct net_msg_s *msg)
+{
+	if (msg != NULL && --msg->refs == 0)
+		free(msg);
+}
+
+static void net_client_close(struct net_client_s *client)
+{
+	for (; client->count > 0; client->count--)
+	{
+		net_msg_unref(client->queue[client->head]);
+		client->head = (client->head + 1) % NET_QUEUE;
+	}
+	close(client->fd);
+	client->fd = -1;
+}
+
+/* Queue msg for client, return -1 if the queue is full */
+static int net_client_push(struct net_client_s *client, struct net_msg_s *msg)
+{
+	if (client->fd < 0 || msg == NULL || client->count == NET_QUEUE)
+		return -1;
+	msg->refs++;
+	client->queue[(client->head + client->count) % NET_QUEUE] = msg;
+	client->count++;
+	return 0;
+}
+
+/* Send as much as possible without blocking */
+static void net_client_flush(struct net_client_s *client)
+{
+	while (client->count > 0)
+	{
+		struct net_msg_s *msg = client->queue[client->head];
+		ssize_t n = send(client->fd, msg->data + client->offset,
+				msg->len - client->offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+		if (n < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				net_client_close(client);
+			return;
+		}
+		client->offset += (size_t)n;
+		if (client->offset < msg->len)
+			return;
+		client->offset = 0;
+		net_msg_unref(msg);
+		client->head = (client->head + 1) % NET_QUEUE;
+		client->count--;
+	}
+}
+
+static void net_accept(struct window_s *win)
+{
+	int fd;
+
+	while ((fd = accept4(win->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		struct net_client_s *client = NULL;
+		unsigned char hello[3] = { NETPROTO_VERSION, (unsigned char)win->w, (unsigned char)win->h };
+		int one = 1;
+
+		for (int i = 0; i < NET_MAX_CLIENTS && client == NULL; i++)
+			if (win->clients[i].fd < 0)
+				client = &win->clients[i];
+		if (client == NULL)
+		{
+			close(fd); // too many viewers
+			continue;
+		}
+
+		// the frames are small and must be shown as soon as possible
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		memset(client, 0, sizeof(*client));
+		client->fd = fd;
+		client->keyframe = 1;
+		client->missed = NET_MISSED_SOUND | NET_MISSED_STATUS;
+
+		struct net_msg_s *msg = net_msg_new(NETPROTO_HELLO, 0, 0, hello, sizeof(hello));
+		net_client_push(client, msg);
+		net_msg_unref(msg);
+	}
+}
+
+window_t *create_window(int width, int height)
+{
+	struct window_s *window = calloc(1, sizeof(*window));
+	const char *addr = getenv("CHIP8_NET");
+
+	if (addr == NULL)
+		addr = NETPROTO_DEFAULT_ADDR;
+
+	window->w = width;
+	window->h = height;
+	window->prev = calloc((size_t)(width * height), 1);
+	for (int i = 0; i < NET_MAX_CLIENTS; i++)
+		window->clients[i].fd = -1;
+
+	window->fd = netproto_listen(addr);
+	if (window->fd < 0)
+	{
+		perror("Failed to listen: ");
+		exit(1);
+	}
+	// viewers are accepted between two frames, never wait for them
+	fcntl(window->fd, F_SETFL, fcntl(window->fd, F_GETFL) | O_NONBLOCK);
+	fprintf(stderr, "Waiting for viewers on %s\n", addr);
+	net_window = window;
+	return window;
+}
+
+void destroy_window(window_t *window)
+{
+	struct window_s *win = window;
+
+	for (int i = 0; i < NET_MAX_CLIENTS; i++)
+		if (win->clients[i].fd >= 0)
+			net_client_close(&win->clients[i]);
+	close(win->fd);
+	net_msg_unref(win->sound);
+	net_msg_unref(win->status);
+	free(win->prev);
+	free(win);
+}
+
+void window_clear(window_t *window)
+{
+	(void)window; // the next frame holds the whole screen anyway
+}
+
+/* Send the same message to all the viewers, the ones with a full queue get
+ * it later from net_client_resend */
+static void net_broadcast(struct window_s *win, struct net_msg_s *msg, int missed)
+{
+	for (int i = 0; i < NET_MAX_CLIENTS; i++)
+	{
+		struct net_client_s *client = &win->clients[i];
+
+		if (client->fd < 0)
+			continue;
+		if (net_client_push(client, msg) == 0)
+		{
+			client->missed &= ~missed;
+			net_client_flush(client);
+		}
+		else
+			client->missed |= missed;
+	}
+}
+
+/* Queue the last sound and status messages a viewer missed */
+static void net_client_resend(struct window_s *win, struct net_client_s *client)
+{
+	if (client->missed & NET_MISSED_STATUS && net_client_push(client, win->status) == 0)
+		client->missed &= ~NET_MISSED_STATUS;
+	if (client->missed & NET_MISSED_SOUND && net_client_push(client, win->sound) == 0)
+		client->missed &= ~NET_MISSED_SOUND;
+}
+
+void update_window(window_t *window, const unsigned char *gfx)
+{
+	struct window_s *win = window;
+	unsigned char payload[NETPROTO_FRAME_SIZE(64, 32)];
+	struct net_msg_s *delta = NULL, *keyframe = NULL;
+	size_t len;
+
+	net_accept(win);
+
+	// the rows changed since the last frame, encoded once for everybody.
+	// It is sent even when empty, so the viewers see every sequence number
+	len = netproto_encode_frame(win->prev, gfx, win->w, win->h, payload);
+	delta = net_msg_new(NETPROTO_FRAME, 0, win->seq, payload, len);
+
+	for (int i = 0; i < NET_MAX_CLIENTS; i++)
+	{
+		struct net_client_s *client = &win->clients[i];
+
+		if (client->fd < 0)
+			continue;
+		// before the frame, which may follow them
+		net_client_resend(win, client);
+		// a late viewer skips the deltas then restarts from a key frame
+		if (client->count == NET_QUEUE)
+			client->keyframe = 1;
+		else if (client->keyframe)
+		{
+			if (keyframe == NULL)
+			{
+				len = netproto_encode_frame(NULL, gfx, win->w, win->h, payload);
+				keyframe = net_msg_new(NETPROTO_FRAME, NETPROTO_KEYFRAME, win->seq, payload, len);
+			}
+			if (net_client_push(client, keyframe) == 0)
+				client->keyframe = 0;
+		}
+		else
+			net_client_push(client, delta);
+		net_client_flush(client);
+	}
+	net_msg_unref(delta);
+	net_msg_unref(keyframe);
+
+	memcpy(win->prev, gfx, (size_t)(win->w * win->h));
+	win->seq++;
+}
+
+void window_status(window_t *window, const char *status)
+{
+	struct window_s *win = window;
+
+	net_msg_unref(win->status);
+	win->status = net_msg_new(NETPROTO_STATUS, 0, win->seq, status, strlen(status));
+	net_broadcast(win, win->status, NET_MISSED_STATUS);
+}
+
+void window_sound(window_t *window, int on)
+{
+	struct window_s *win = window;
+	unsigned char payload = on != 0;
+
+	net_msg_unref(win->sound);
+	win->sound = net_msg_new(NETPROTO_SOUND, 0, win->seq, &payload, 1);
+	net_broadcast(win, win->sound, NET_MISSED_SOUND);
+}
+
+void window_suspend(window_t *window)
+{
+	(void)window; // the terminal is not used
+}
+
+void window_resume(window_t *window)
+{
+	(void)window;
+}
+
+static void net_handle_message(struct window_s *win, struct net_client_s *client,
+		const netproto_header_t *hdr, const unsigned char *payload)
+{
+	switch (hdr->type)
+	{
+		case NETPROTO_KEY:
+			if (hdr->length >= 2 && payload[0] < 16)
+				client->keys[payload[0]] = payload[1] != 0;
+			break;
+		case NETPROTO_TURBO:
+			win->events |= WINDOW_EVENT_TURBO;
+			break;
+		case NETPROTO_QUIT:
+			win->events |= WINDOW_EVENT_QUIT;
+			break;
+	}
+}
+
+/* Read and handle the messages of a viewer */
+static void net_client_read(struct window_s *win, struct net_client_s *client)
+{
+	netproto_header_t hdr;
+	size_t len;
+	ssize_t n;
+
+	n = recv(client->fd, client->input + client->input_len,
+			sizeof(client->input) - client->input_len, MSG_DONTWAIT);
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+	{
+		net_client_close(client);
+		return;
+	}
+	if (n < 0)
+		return;
+	client->input_len += (size_t)n;
+
+	while ((len = netproto_read_header(client->input, client->input_len, &hdr)) > 0)
+	{
+		net_handle_message(win, client, &hdr, client->input + NETPROTO_HEADER_SIZE);
+		client->input_len -= len;
+		memmove(client->input, client->input + len, client->input_len);
+	}
+	// a message which can never fit in the buffer
+	if (client->input_len == sizeof(client->input))
+		net_client_close(client);
+}
+
+int handle_event(unsigned char *keyboard)
+{
+	struct window_s *win = net_window;
+	struct pollfd fds[NET_MAX_CLIENTS];
+	int nfds = 0, events;
+
+	for (int i = 0; i < NET_MAX_CLIENTS; i++)
+		if (win->clients[i].fd >= 0)
+		{
+			fds[nfds].fd = win->clients[i].fd;
+			fds[nfds].events = POLLIN | (win->clients[i].count > 0 ? POLLOUT : 0);
+			nfds++;
+		}
+
+	if (nfds > 0 && poll(fds, (nfds_t)nfds, 0) > 0)
+	{
+		nfds = 0;
+		for (int i = 0; i < NET_MAX_CLIENTS; i++)
+		{
+			struct net_client_s *client = &win->clients[i];
+
+			if (client->fd < 0)
+				continue;
+			short revents = fds[nfds++].revents;
+			if (revents & POLLOUT)
+				net_client_flush(client);
+			if (client->fd >= 0 && revents & (POLLIN | POLLHUP | POLLERR))
+				net_client_read(win, client);
+		}
+	}
+
+	// the keys stay pressed until the viewer releases them or leaves
+	memset(keyboard, 0, sizeof(win->clients[0].keys));
+	for (int i = 0; i < NET_MAX_CLIENTS; i++)
+		if (win->clients[i].fd >= 0)
+			for (unsigned k = 0; k < sizeof(win->clients[0].keys); k++)
+				keyboard[k] |= win->clients[i].keys[k];
+	events = win->events;
+	win->events = 0;
+	return events;
+}
@@ -0,0 +1,144 @@
+/*
+ * Headless backend: nothing is drawn and nothing is read from the terminal.
+ * CHIP8_INPUT: a script of the keys to press, see include/input_script.h.
+ * The frames of the script are counted by handle_event, run with -t -n 1 to
+ * get one frame per emulated frame at full speed.
+ * CHIP8_HASH: a file where the hash of each drawn frame is written. The hash
+ * of all the frames is printed on stderr when the window is destroyed, to
+ * compare two runs.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "window.h"
+#include "input_script.h"
+#include "fnv.h"
+
+struct window_s {
+	int w;
+	int h;
+
+	input_script_t script;
+	int scripted;
+	unsigned char keys[16]; /* held by the script */
+
+	FILE *hashes; /* NULL when not hashing */
+	uint64_t hash; /* of all the frames */
+	unsigned long frames; /* number of update_window */
+	unsigned long events; /* number of handle_event */
+};
+
+/* handle_event does not get the window */
+static struct window_s *null_window;
+
+window_t *create_window(int width, int height)
+{
+	struct window_s *window = calloc(1, sizeof(*window));
+	const char *input = getenv("CHIP8_INPUT");
+	const char *hashes = getenv("CHIP8_HASH");
+
+	window->w = width;
+	window->h = height;
+	window->hash = FNV_OFFSET;
+
+	if (input != NULL)
+	{
+		if (input_script_open(&window->script, input) < 0)
+		{
+			perror("Failed to open the input script: ");
+			exit(1);
+		}
+		window->scripted = 1;
+	}
+	if (hashes != NULL)
+	{
+		window->hashes = strcmp(hashes, "-") == 0 ? stdout : fopen(hashes, "w");
+		if (window->hashes == NULL)
+		{
+			perror("Failed to open the hash file: ");
+			exit(1);
+		}
+	}
+
+	null_window = window;
+	return window;
+}
+
+void destroy_window(window_t *window)
+{
+	struct window_s *win = window;
+
+	if (win->scripted)
+		input_script_close(&win->script);
+	if (win->hashes != NULL)
+	{
+		fprintf(stderr, "%lu frames, hash %016llx\n", win->frames,
+				(unsigned long long)win->hash);
+		if (win->hashes != stdout)
+			fclose(win->hashes);
+	}
+	null_window = NULL;
+	free(win);
+}
+
+void window_clear(window_t *window)
+{
+	(void)window;
+}
+
+void update_window(window_t *window, const unsigned char *gfx)
+{
+	struct window_s *win = window;
+	uint64_t hash = FNV_OFFSET;
+
+	win->frames++;
+	if (win->hashes == NULL)
+		return;
+
+	// FNV-1a of the pixels, then of the hash of the frame for the whole run
+	for (int i = 0; i < win->w * win->h; i++)
+		hash = fnv_byte(hash, gfx[i] != 0);
+	for (int i = 0; i < 64; i += 8)
+		win->hash = fnv_byte(win->hash, (hash >> i) & 0xFF);
+	fprintf(win->hashes, "%lu %016llx\n", win->frames - 1, (unsigned long long)hash);
+}
+
+void window_status(window_t *window, const char *status)
+{
+	(void)window;
+	(void)status;
+}
+
+void window_sound(window_t *window, int on)
+{
+	(void)window;
+	(void)on;
+}
+
+void window_suspend(window_t *window)
+{
+	(void)window; // the terminal is not used
+}
+
+void window_resume(window_t *window)
+{
+	(void)window;
+}
+
+int handle_event(unsigned char *keyboard)
+{
+	struct window_s *win = null_window;
+	int events = 0;
+
+	if (win->scripted)
+	{
+		events = input_script_step(&win->script, win->events, win->keys);
+		if (events < 0)
+			events = WINDOW_EVENT_QUIT;
+	}
+	win->events++;
+	memcpy(keyboard, win->keys, sizeof(win->keys));
+	return events;
+}
@@ -1,20 +1,72 @@
+#include <stdio.h>
+#include <string.h>
 #include <SDL.h>
 
 #include "window.h"
 #include "SDL_utils.h"
 
+#define AUDIO_FREQ 44100
+#define BUZZER_FREQ 440 /* Hz of the square wave */
+#define BUZZER_VOLUME 16
+
 struct window_s {
 	SDL_Window *window;
 	SDL_Renderer *renderer;
 
+	SDL_AudioDeviceID audio; /* 0 if there is no sound */
+	int sound; /* buzzer state, read by the audio thread */
+	unsigned phase; /* position in the square wave, in samples */
+
 	int w;
 	int h;
 };
 
+/* Runs in the SDL audio thread: play a square wave while the buzzer is on */
+static void audio_callback(void *userdata, Uint8 *stream, int len)
+{
+	struct window_s *win = userdata;
+	Sint8 *samples = (Sint8 *)stream;
+	unsigned period = AUDIO_FREQ / BUZZER_FREQ;
+
+	if (!__atomic_load_n(&win->sound, __ATOMIC_RELAXED))
+	{
+		memset(stream, 0, (size_t)len);
+		return;
+	}
+
+	for (int i = 0; i < len; i++)
+	{
+		samples[i] = win->phase < period / 2 ? BUZZER_VOLUME : -BUZZER_VOLUME;
+		win->phase = (win->phase + 1) % period;
+	}
+}
+
+static void open_audio(struct window_s *window)
+{
+	SDL_AudioSpec want, have;
+
+	SDL_zero(want);
+	want.freq = AUDIO_FREQ;
+	want.format = AUDIO_S8;
+	want.channels = 1;
+	want.samples = 512;
+	want.callback = audio_callback;
+	want.userdata = window;
+
+	window->audio = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+	if (window->audio == 0)
+	{
+		// not fatal, we just won't hear the buzzer
+		SDL_Log("Could not open audio: %s", SDL_GetError());
+		return;
+	}
+	SDL_PauseAudioDevice(window->audio, 0);
+}
+
 window_t *create_window(int width, int height)
 {
 	struct window_s *window = malloc(sizeof(*window));
-	if (SDL_Init(SDL_INIT_VIDEO))
+	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO))
 		handle_SDL_Error("Unable to initialize SDL");
 
 	window->window = SDL_CreateWindow("CHIP-8",
@@ -34,12 +86,18 @@ window_t *create_window(int width, int height)
 	window->w = width;
 	window->h = height;
 
+	window->sound = 0;
+	window->phase = 0;
+	open_audio(window);
+
 	return window;
 }
 
 void destroy_window(window_t *window)
 {
 	struct window_s *win = window;
+	if (win->audio != 0)
+		SDL_CloseAudioDevice(win->audio);
 	SDL_DestroyRenderer(win->renderer);
 	SDL_DestroyWindow(win->window);
 
@@ -81,6 +139,32 @@ void update_window(window_t *window, const unsigned char *gfx)
 
 }
 
+void window_status(window_t *window, const char *status)
+{
+	struct window_s *win = window;
+	char title[64];
+
+	snprintf(title, sizeof(title), "CHIP-8 - %s", status);
+	SDL_SetWindowTitle(win->window, title);
+}
+
+void window_sound(window_t *window, int on)
+{
+	struct window_s *win = window;
+
+	__atomic_store_n(&win->sound, on, __ATOMIC_RELAXED);
+}
+
+void window_suspend(window_t *window)
+{
+	(void)window; // the terminal is not used
+}
+
+void window_resume(window_t *window)
+{
+	(void)window;
+}
+
 static void handle_keyboard(unsigned char *keyboard, int sym, unsigned char value)
 {
 	switch (sym)
@@ -139,14 +223,17 @@ static void handle_keyboard(unsigned char *keyboard, int sym, unsigned char valu
 int handle_event(unsigned char *keyboard)
 {
 	SDL_Event event;
+	int ret = 0;
 
 	while(SDL_PollEvent(&event) != 0)
 	{
 		switch (event.type)
 		{
 			case SDL_QUIT:
-				return 1;
+				return WINDOW_EVENT_QUIT;
 			case SDL_KEYDOWN:
+				if (event.key.keysym.sym == SDLK_TAB && !event.key.repeat)
+					ret |= WINDOW_EVENT_TURBO;
 				handle_keyboard(keyboard, event.key.keysym.sym, 1);
 				break;
 			case SDL_KEYUP:
@@ -158,6 +245,6 @@ int handle_event(unsigned char *keyboard)
 		}
 	}
 
-	return 0;
+	return ret;
 }
 
@@ -1,28 +1,55 @@
+/*
+ * Terminal backend.
+ * A terminal does not report the key releases: a typed key is held for
+ * CHIP8_KEY_HOLD milliseconds (TERM_DEFAULT_HOLD_MS by default), and held
+ * longer by the repetitions of the terminal while it stays pressed.
+ */
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <termios.h>
 
 #include "window.h"
+#include "pacer.h"
+
+#define TERM_DEFAULT_HOLD_MS 100
+/* bytes read at once, more than typed between two frames */
+#define TERM_INPUT 64
+
+/* chip8 key of each character, in the order of the keys */
+static const char term_keys[] = "1234azerqsdfwxcv";
 
 struct window_s {
 	struct termios old_t;
 	struct termios new_t;
 
+	char status[64]; /* printed under the screen */
+
 	int w;
 	int h;
+
+	uint64_t hold; /* how long a typed key is held, in ns */
+	uint64_t released[16]; /* when each key is released, 0 if it is not held */
 };
 
+/* handle_event does not get the window */
+static struct window_s *term_window;
+
 window_t *create_window(int width, int height)
 {
-	struct window_s *window = malloc(sizeof(*window));
+	struct window_s *window = calloc(1, sizeof(*window));
+	const char *hold = getenv("CHIP8_KEY_HOLD");
 
 	window->w = width;
 	window->h = height;
+	window->status[0] = '\0';
+	window->hold = (hold != NULL ? strtoull(hold, NULL, 0) : TERM_DEFAULT_HOLD_MS) * 1000000ULL;
 
-	// print an empty screen
-	for (; height > 0; height--)
+	// print an empty screen and the status line
+	for (height++; height > 0; height--)
 		printf("\n");
 
 	// save the current state of the terminal to restore it later
@@ -40,6 +67,7 @@ window_t *create_window(int width, int height)
 	// apply the new settings
 	tcsetattr(STDIN_FILENO, TCSANOW, &(window->new_t));
 
+	term_window = window;
 	return window;
 }
 
@@ -50,22 +78,23 @@ void destroy_window(window_t *window)
 	// restore the old settings
 	tcsetattr(STDIN_FILENO, TCSANOW, &(win->old_t));
 
+	term_window = NULL;
 	free(window);
 }
 
 void window_clear(window_t *window)
 {
 	struct window_s *win = window;
-	for (unsigned char h = 0; h < win->h; h++)
-		printf("\e[A\e[K");
-	printf("\e[%dB", win->h);
+	for (int h = 0; h <= win->h; h++)
+		printf("\033[A\033[K");
+	printf("\033[%dB", win->h + 1);
 }
 
 void update_window(window_t *window, const unsigned char *gfx)
 {
 	struct window_s *win = window;
 
-	printf("\e[%dA", win->h);
+	printf("\033[%dA", win->h + 1);
 	for (int y = 0; y < win->h; y++)
 	{
 		for (int x = 0; x < win->w; x++)
@@ -77,82 +106,80 @@ void update_window(window_t *window, const unsigned char *gfx)
 		}
 		printf("\n");
 	}
+	printf("%s\033[K\n", win->status);
+}
+
+void window_status(window_t *window, const char *status)
+{
+	struct window_s *win = window;
+
+	snprintf(win->status, sizeof(win->status), "%s", status);
+}
+
+void window_sound(window_t *window, int on)
+{
+	(void)window;
+	// the terminal can only ring the bell
+	if (on)
+		printf("\a");
+}
+
+void window_suspend(window_t *window)
+{
+	struct window_s *win = window;
 
+	fflush(stdout);
+	// typed lines, echoed and read blocking
+	tcsetattr(STDIN_FILENO, TCSANOW, &(win->old_t));
+}
+
+void window_resume(window_t *window)
+{
+	struct window_s *win = window;
+
+	tcsetattr(STDIN_FILENO, TCSANOW, &(win->new_t));
+	// the screen is drawn again below what was printed
+	for (int h = 0; h <= win->h; h++)
+		printf("\n");
 }
 
 int handle_event(unsigned char *keyboard)
 {
-	// clear the keyboard before adding the new input
-	memset(keyboard, 0, 16);
+	struct window_s *win = term_window;
+	char input[TERM_INPUT];
+	uint64_t now = pacer_now();
+	int events = 0;
+	ssize_t n;
+
+	// everything typed since the last call, VMIN = 0: never blocks
+	n = read(STDIN_FILENO, input, sizeof(input));
+	for (ssize_t i = 0; i < n; i++)
+	{
+		// strchr finds the final nul, and only the letters have a lower case
+		const char *key = input[i] != '\0' ? strchr(term_keys, tolower((unsigned char)input[i])) : NULL;
 
-	switch (getchar())
+		switch (input[i])
+		{
+			// C^c
+			case 3:
+			// C^z
+			case 26:
+				events |= WINDOW_EVENT_QUIT;
+				break;
+			case '\t':
+				events ^= WINDOW_EVENT_TURBO; // typed twice, nothing changes
+				break;
+			default:
+				if (key != NULL)
+					win->released[key - term_keys] = now + win->hold;
+		}
+	}
+
+	for (int k = 0; k < 16; k++)
 	{
-		// C^c
-		case 3:
-		// C^c
-		case 26:
-			return 1;
-		case '1':
-			keyboard[0] = 1;
-			break;
-		case '2':
-			keyboard[1] = 1;
-			break;
-		case '3':
-			keyboard[2] = 1;
-			break;
-		case '4':
-			keyboard[3] = 1;
-			break;
-		case 'a':
-		case 'A':
-			keyboard[4] = 1;
-			break;
-		case 'z':
-		case 'Z':
-			keyboard[5] = 1;
-			break;
-		case 'e':
-		case 'E':
-			keyboard[6] = 1;
-			break;
-		case 'r':
-		case 'R':
-			keyboard[7] = 1;
-			break;
-		case 'q':
-		case 'Q':
-			keyboard[8] = 1;
-			break;
-		case 's':
-		case 'S':
-			keyboard[9] = 1;
-			break;
-		case 'd':
-		case 'D':
-			keyboard[10] = 1;
-			break;
-		case 'f':
-		case 'F':
-			keyboard[11] = 1;
-			break;
-		case 'w':
-		case 'W':
-			keyboard[12] = 1;
-			break;
-		case 'x':
-		case 'X':
-			keyboard[13] = 1;
-			break;
-		case 'c':
-		case 'C':
-			keyboard[14] = 1;
-			break;
-		case 'v':
-		case 'V':
-			keyboard[15] = 1;
-			break;
+		if (win->released[k] != 0 && win->released[k] <= now)
+			win->released[k] = 0;
+		keyboard[k] = win->released[k] != 0;
 	}
-	return 0;
+	return events;
 }
-
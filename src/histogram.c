@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "histogram.h"
+
+void histogram_reset(histogram_t *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+	hist->min = UINT64_MAX;
+}
+
+static unsigned histogram_bucket(uint64_t value)
+{
+	unsigned log;
+
+	if (value < HISTOGRAM_SUB_BUCKETS)
+		return (unsigned)value;
+
+	// the HISTOGRAM_SUB_BITS bits after the highest one select the sub bucket
+	log = 63u - (unsigned)__builtin_clzll(value);
+	return (log - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS
+		+ (unsigned)(value >> (log - HISTOGRAM_SUB_BITS)) - HISTOGRAM_SUB_BUCKETS;
+}
+
+/* Largest value stored in a bucket */
+static uint64_t histogram_bucket_max(unsigned bucket)
+{
+	unsigned log = bucket / HISTOGRAM_SUB_BUCKETS;
+	uint64_t sub = bucket % HISTOGRAM_SUB_BUCKETS;
+
+	if (log == 0)
+		return sub;
+	log += HISTOGRAM_SUB_BITS - 1;
+	return ((HISTOGRAM_SUB_BUCKETS + sub + 1) << (log - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+void histogram_add(histogram_t *hist, uint64_t value)
+{
+	hist->count++;
+	hist->sum += value;
+	if (value < hist->min)
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+	hist->buckets[histogram_bucket(value)]++;
+}
+
+uint64_t histogram_percentile(const histogram_t *hist, double percent)
+{
+	uint64_t rank = (uint64_t)((double)hist->count * percent / 100.0);
+	uint64_t seen = 0;
+
+	if (hist->count == 0)
+		return 0;
+	for (unsigned i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += hist->buckets[i];
+		if (seen > rank)
+		{
+			uint64_t max = histogram_bucket_max(i);
+			return max < hist->max ? max : hist->max;
+		}
+	}
+	return hist->max;
+}
+
+void histogram_print(const histogram_t *hist, FILE *file, const char *name)
+{
+	if (hist->count == 0)
+	{
+		fprintf(file, "%-12s no value\n", name);
+		return;
+	}
+
+	fprintf(file, "%-12s n=%-8llu min=%.3fms mean=%.3fms p50=%.3fms p99=%.3fms "
+			"p99.9=%.3fms max=%.3fms\n", name,
+			(unsigned long long)hist->count,
+			(double)hist->min / 1e6,
+			(double)hist->sum / (double)hist->count / 1e6,
+			(double)histogram_percentile(hist, 50) / 1e6,
+			(double)histogram_percentile(hist, 99) / 1e6,
+			(double)histogram_percentile(hist, 99.9) / 1e6,
+			(double)hist->max / 1e6);
+}
+
+void histogram_export(const histogram_t *hist, FILE *file, const char *name)
+{
+	for (unsigned i = 0; i < HISTOGRAM_BUCKETS; i++)
+		if (hist->buckets[i] != 0)
+			fprintf(file, "%s %llu %llu\n", name,
+					(unsigned long long)histogram_bucket_max(i),
+					(unsigned long long)hist->buckets[i]);
+}
@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "input_script.h"
+#include "window.h"
+
+int input_script_open(input_script_t *script, const char *path)
+{
+	script->file = fopen(path, "r");
+	if (script->file == NULL)
+		return -1;
+	script->line = 0;
+	script->pending = 0;
+	memset(script->tapped, 0, sizeof(script->tapped));
+	return 0;
+}
+
+/* Read the next event, return 0 at the end of the script, -1 if invalid */
+static int input_script_read(input_script_t *script)
+{
+	char line[128];
+
+	while (fgets(line, sizeof(line), script->file) != NULL)
+	{
+		char key[4] = "";
+		int n;
+
+		script->line++;
+		n = sscanf(line, "%lu %15s %3s", &script->frame, script->action, key);
+		if (line[strspn(line, " \t")] == '#' || n == EOF)
+			continue;
+		if (n < 2)
+			return -1;
+
+		script->key = -1;
+		if (n == 3)
+		{
+			char *end;
+			long value = strtol(key, &end, 16);
+
+			if (*end != '\0' || value < 0 || value > 0xF)
+				return -1;
+			script->key = (int)value;
+		}
+		script->pending = 1;
+		return 1;
+	}
+	return 0;
+}
+
+int input_script_step(input_script_t *script, unsigned long frame, unsigned char *keys)
+{
+	int events = 0;
+
+	for (int k = 0; k < 16; k++)
+		if (script->tapped[k])
+		{
+			keys[k] = 0;
+			script->tapped[k] = 0;
+		}
+
+	while (1)
+	{
+		if (!script->pending)
+		{
+			int ret = input_script_read(script);
+
+			if (ret < 0)
+				goto invalid;
+			if (ret == 0)
+				break; // the end of the script
+		}
+		if (script->frame > frame)
+			break;
+		script->pending = 0;
+
+		const char *action = script->action;
+		int key = script->key;
+
+		if (strcmp(action, "turbo") == 0)
+			events |= WINDOW_EVENT_TURBO;
+		else if (strcmp(action, "quit") == 0)
+			events |= WINDOW_EVENT_QUIT;
+		else if (key < 0)
+			goto invalid;
+		else if (strcmp(action, "press") == 0)
+			keys[key] = 1;
+		else if (strcmp(action, "release") == 0)
+			keys[key] = 0;
+		else if (strcmp(action, "tap") == 0)
+		{
+			keys[key] = 1;
+			script->tapped[key] = 1;
+		}
+		else
+			goto invalid;
+	}
+	return events;
+
+invalid:
+	fprintf(stderr, "Invalid input script at line %lu\n", script->line);
+	return -1;
+}
+
+void input_script_close(input_script_t *script)
+{
+	fclose(script->file);
+}
@@ -0,0 +1,106 @@
+#include <string.h>
+
+#include "latency.h"
+#include "pacer.h"
+
+#define LATENCY_SLOT(latency, tag) (&(latency)->pending[(tag) % LATENCY_PENDING])
+
+void latency_init(latency_t *latency)
+{
+	memset(latency, 0, sizeof(*latency));
+	histogram_reset(&latency->input_read);
+	histogram_reset(&latency->read_draw);
+	histogram_reset(&latency->draw_present);
+	histogram_reset(&latency->total);
+}
+
+void latency_input(latency_t *latency, chip8_t *chip8)
+{
+	uint64_t now;
+
+	if (memcmp(latency->keys, chip8->key, sizeof(latency->keys)) == 0)
+		return;
+
+	now = pacer_now();
+	for (unsigned k = 0; k < 16; k++)
+	{
+		if (chip8->key[k] == latency->keys[k])
+			continue;
+		latency->keys[k] = chip8->key[k];
+		chip8->key_tag[k] = ++latency->tag;
+
+		// the slot is reused, forget the change it held
+		if (latency->tag - latency->presented > LATENCY_PENDING)
+		{
+			latency->lost++;
+			latency->presented++;
+			if (latency->drawn < latency->presented)
+				latency->drawn = latency->presented;
+			if (latency->read < latency->presented)
+				latency->read = latency->presented;
+		}
+		LATENCY_SLOT(latency, latency->tag)->input = now;
+	}
+}
+
+void latency_emulated(latency_t *latency, const chip8_t *chip8)
+{
+	// the chip8 only holds tags given by latency_input
+	uint32_t read = chip8->read_tag < latency->tag ? chip8->read_tag : latency->tag;
+	uint32_t drawn = chip8->draw_tag < latency->tag ? chip8->draw_tag : latency->tag;
+	uint64_t now;
+
+	if (read == latency->read && drawn == latency->drawn)
+		return;
+
+	now = pacer_now();
+	// the forgotten tags are skipped: at most LATENCY_PENDING are left
+	for (uint32_t tag = latency->read > latency->presented ? latency->read : latency->presented; tag < read;)
+		LATENCY_SLOT(latency, ++tag)->read = now;
+	if (read > latency->read)
+		latency->read = read;
+	for (uint32_t tag = latency->drawn > latency->presented ? latency->drawn : latency->presented; tag < drawn;)
+		LATENCY_SLOT(latency, ++tag)->draw = now;
+	if (drawn > latency->drawn)
+		latency->drawn = drawn;
+}
+
+void latency_presented(latency_t *latency)
+{
+	uint64_t now;
+
+	if (latency->drawn == latency->presented)
+		return;
+
+	now = pacer_now();
+	for (uint32_t tag = latency->presented; tag < latency->drawn;)
+	{
+		const latency_pending_t *slot = LATENCY_SLOT(latency, ++tag);
+
+		histogram_add(&latency->input_read, slot->read - slot->input);
+		histogram_add(&latency->read_draw, slot->draw - slot->read);
+		histogram_add(&latency->draw_present, now - slot->draw);
+		histogram_add(&latency->total, now - slot->input);
+	}
+	latency->presented = latency->drawn;
+}
+
+void latency_report(const latency_t *latency, FILE *file, const char *backend)
+{
+	fprintf(file, "input latency (%s): %u key changes, %llu shown, %llu lost\n",
+			backend, latency->tag, (unsigned long long)latency->total.count,
+			(unsigned long long)latency->lost);
+	histogram_print(&latency->input_read, file, "input->read");
+	histogram_print(&latency->read_draw, file, "read->draw");
+	histogram_print(&latency->draw_present, file, "draw->present");
+	histogram_print(&latency->total, file, "input->screen");
+}
+
+void latency_export(const latency_t *latency, FILE *file, const char *backend)
+{
+	fprintf(file, "# input latency of the %s backend\n", backend);
+	histogram_export(&latency->input_read, file, "input_read");
+	histogram_export(&latency->read_draw, file, "read_draw");
+	histogram_export(&latency->draw_present, file, "draw_present");
+	histogram_export(&latency->total, file, "total");
+}
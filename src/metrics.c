@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "metrics.h"
+
+/* a reader gives up when the sequence stays odd that long */
+#define METRICS_RETRIES 1000
+
+#define METRICS_STORE(dst, src, field) \
+	__atomic_store_n(&(dst)->field, (src)->field, __ATOMIC_RELAXED)
+#define METRICS_LOAD(dst, src, field) \
+	((dst)->field = __atomic_load_n(&(src)->field, __ATOMIC_RELAXED))
+
+static void metrics_name(char *name, size_t size, unsigned pid)
+{
+	snprintf(name, size, "/" METRICS_PREFIX "%u", pid);
+}
+
+metrics_page_t *metrics_open(const char *game, const char *backend)
+{
+	char name[64];
+	metrics_page_t *page;
+	int fd;
+
+	metrics_name(name, sizeof(name), (unsigned)getpid());
+	// a page left by a dead process with the same pid is replaced
+	fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, sizeof(*page)) < 0)
+	{
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+	page = mmap(NULL, sizeof(*page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED)
+	{
+		shm_unlink(name);
+		return NULL;
+	}
+
+	page->version = METRICS_VERSION;
+	page->pid = (uint32_t)getpid();
+	strncpy(page->game, game, sizeof(page->game) - 1);
+	strncpy(page->backend, backend, sizeof(page->backend) - 1);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(page->magic, METRICS_MAGIC, sizeof(page->magic));
+	return page;
+}
+
+void metrics_publish(metrics_page_t *page, const metrics_counters_t *counters)
+{
+	uint32_t seq;
+
+	if (page == NULL)
+		return;
+
+	// only this process writes, the sequence is odd during the copy
+	seq = page->seq;
+	__atomic_store_n(&page->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	METRICS_STORE(&page->counters, counters, start);
+	METRICS_STORE(&page->counters, counters, now);
+	METRICS_STORE(&page->counters, counters, cycles);
+	METRICS_STORE(&page->counters, counters, frames);
+	METRICS_STORE(&page->counters, counters, presented);
+	METRICS_STORE(&page->counters, counters, dropped);
+	METRICS_STORE(&page->counters, counters, vm_ns);
+	METRICS_STORE(&page->counters, counters, update_ns);
+	METRICS_STORE(&page->counters, counters, event_ns);
+	METRICS_STORE(&page->counters, counters, speed);
+	METRICS_STORE(&page->counters, counters, flags);
+	__atomic_store_n(&page->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void metrics_close(metrics_page_t *page)
+{
+	char name[64];
+
+	if (page == NULL)
+		return;
+	metrics_name(name, sizeof(name), page->pid);
+	munmap(page, sizeof(*page));
+	shm_unlink(name);
+}
+
+const metrics_page_t *metrics_map(const char *name)
+{
+	char path[64];
+	struct stat st;
+	metrics_page_t *page;
+	int fd;
+
+	snprintf(path, sizeof(path), "/%s", name);
+	fd = shm_open(path, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*page))
+	{
+		close(fd);
+		return NULL;
+	}
+	page = mmap(NULL, sizeof(*page), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED)
+		return NULL;
+
+	if (memcmp(page->magic, METRICS_MAGIC, sizeof(page->magic)) != 0)
+	{
+		munmap(page, sizeof(*page));
+		return NULL;
+	}
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (page->version != METRICS_VERSION)
+	{
+		munmap(page, sizeof(*page));
+		return NULL;
+	}
+	return page;
+}
+
+void metrics_unmap(const metrics_page_t *page)
+{
+	munmap((void *)page, sizeof(*page));
+}
+
+int metrics_read(const metrics_page_t *page, metrics_counters_t *counters)
+{
+	for (unsigned i = 0; i < METRICS_RETRIES; i++)
+	{
+		uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+
+		if (seq & 1)
+		{
+			// the writer may have been preempted in the middle of its copy
+			sched_yield();
+			continue;
+		}
+		METRICS_LOAD(counters, &page->counters, start);
+		METRICS_LOAD(counters, &page->counters, now);
+		METRICS_LOAD(counters, &page->counters, cycles);
+		METRICS_LOAD(counters, &page->counters, frames);
+		METRICS_LOAD(counters, &page->counters, presented);
+		METRICS_LOAD(counters, &page->counters, dropped);
+		METRICS_LOAD(counters, &page->counters, vm_ns);
+		METRICS_LOAD(counters, &page->counters, update_ns);
+		METRICS_LOAD(counters, &page->counters, event_ns);
+		METRICS_LOAD(counters, &page->counters, speed);
+		METRICS_LOAD(counters, &page->counters, flags);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq)
+			return 0;
+	}
+	return -1;
+}
@@ -0,0 +1,170 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "netproto.h"
+#include "rle.h"
+
+void netproto_write_header(unsigned char *buf, const netproto_header_t *hdr)
+{
+	buf[0] = hdr->type;
+	buf[1] = hdr->flags;
+	buf[2] = (unsigned char)(hdr->length >> 8);
+	buf[3] = (unsigned char)hdr->length;
+	buf[4] = (unsigned char)(hdr->seq >> 24);
+	buf[5] = (unsigned char)(hdr->seq >> 16);
+	buf[6] = (unsigned char)(hdr->seq >> 8);
+	buf[7] = (unsigned char)hdr->seq;
+}
+
+size_t netproto_read_header(const unsigned char *buf, size_t len, netproto_header_t *hdr)
+{
+	if (len < NETPROTO_HEADER_SIZE)
+		return 0;
+
+	hdr->type = buf[0];
+	hdr->flags = buf[1];
+	hdr->length = (uint16_t)(buf[2] << 8 | buf[3]);
+	hdr->seq = (uint32_t)buf[4] << 24 | (uint32_t)buf[5] << 16
+		| (uint32_t)buf[6] << 8 | buf[7];
+	if (len < NETPROTO_HEADER_SIZE + (size_t)hdr->length)
+		return 0;
+	return NETPROTO_HEADER_SIZE + (size_t)hdr->length;
+}
+
+size_t netproto_encode_frame(const unsigned char *prev, const unsigned char *cur,
+		int width, int height, unsigned char *out)
+{
+	size_t len = 0;
+
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned char *row = cur + y * width;
+
+		if (prev != NULL && memcmp(row, prev + y * width, (size_t)width) == 0)
+			continue;
+		out[len++] = (unsigned char)y;
+		len += rle_encode(row, (size_t)width, out + len);
+	}
+	return len;
+}
+
+int netproto_decode_frame(const unsigned char *payload, size_t len,
+		unsigned char *gfx, int width, int height)
+{
+	size_t pos = 0;
+
+	while (pos < len)
+	{
+		int y = payload[pos++];
+		size_t used;
+
+		if (y >= height)
+			return -1;
+		used = rle_decode(payload + pos, len - pos, gfx + y * width, (size_t)width);
+		if (used == 0)
+			return -1;
+		pos += used;
+	}
+	return 0;
+}
+
+/* Open a socket on addr, listening on it when server is set */
+static int netproto_open(const char *addr, int server)
+{
+	int fd;
+
+	if (strncmp(addr, "unix:", 5) == 0)
+	{
+		struct sockaddr_un sun = { .sun_family = AF_UNIX };
+
+		if (strlen(addr + 5) >= sizeof(sun.sun_path))
+			return -1;
+		strcpy(sun.sun_path, addr + 5);
+
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0)
+			return -1;
+		if (server)
+		{
+			unlink(sun.sun_path); // left by a previous session
+			if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) == 0 && listen(fd, 16) == 0)
+				return fd;
+		}
+		else if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == 0)
+			return fd;
+		close(fd);
+		return -1;
+	}
+
+	if (strncmp(addr, "tcp:", 4) != 0)
+		return -1;
+
+	// tcp:PORT or tcp:HOST:PORT, HOST is * for all the interfaces
+	char host[256] = "";
+	const char *node;
+	const char *port = strrchr(addr + 4, ':');
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+	};
+	struct addrinfo *res, *ai;
+
+	if (port == NULL)
+		port = addr + 4;
+	else
+	{
+		size_t len = (size_t)(port - (addr + 4));
+
+		if (len >= sizeof(host))
+			return -1;
+		memcpy(host, addr + 4, len);
+		host[len] = '\0';
+		port++;
+	}
+	// the viewers can press keys and stop the emulator: exposed only on request
+	node = host[0] != '\0' ? host : "localhost";
+	if (server && strcmp(host, "*") == 0)
+	{
+		hints.ai_flags = AI_PASSIVE;
+		node = NULL;
+	}
+	if (getaddrinfo(node, port, &hints, &res) != 0)
+		return -1;
+
+	fd = -1;
+	for (ai = res; ai != NULL; ai = ai->ai_next)
+	{
+		int one = 1;
+
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (server)
+		{
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+			if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 16) == 0)
+				break;
+		}
+		else if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+int netproto_listen(const char *addr)
+{
+	return netproto_open(addr, 1);
+}
+
+int netproto_connect(const char *addr)
+{
+	return netproto_open(addr, 0);
+}
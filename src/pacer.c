@@ -0,0 +1,121 @@
+#include <errno.h>
+#include <time.h>
+
+#include "pacer.h"
+
+/* initial spin, before any oversleep has been measured */
+#define PACER_INITIAL_SPIN_NS 200000ULL
+/* the spin is kept above the oversleep of most of the sleeps */
+#define PACER_SPIN_MARGIN_NS 50000ULL
+
+uint64_t pacer_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+static void pacer_sleep_until(uint64_t deadline)
+{
+	struct timespec ts = {
+		.tv_sec = (time_t)(deadline / NSEC_PER_SEC),
+		.tv_nsec = (long)(deadline % NSEC_PER_SEC),
+	};
+
+	// the deadline is absolute: sleep again when interrupted by a signal,
+	// any other error is not going away, the caller spins instead
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+void pacer_init(pacer_t *pacer, unsigned rate, pacer_policy_t policy)
+{
+	pacer->period = NSEC_PER_SEC / rate;
+	pacer->spin = PACER_INITIAL_SPIN_NS;
+	pacer->policy = policy;
+	pacer->frames = 0;
+	pacer->missed = 0;
+	pacer->dropped = 0;
+	histogram_reset(&pacer->frame_time);
+	histogram_reset(&pacer->oversleep);
+	histogram_reset(&pacer->late);
+	pacer_reset(pacer);
+}
+
+void pacer_reset(pacer_t *pacer)
+{
+	pacer->last = pacer_now();
+	pacer->deadline = pacer->last + pacer->period;
+}
+
+/*
+ * Follow the oversleep of clock_nanosleep: jump up to a bad wake up at once,
+ * come back down slowly (1/16 per frame) when the system is quiet again.
+ */
+static void pacer_adapt_spin(pacer_t *pacer, uint64_t oversleep)
+{
+	uint64_t target = oversleep + PACER_SPIN_MARGIN_NS;
+
+	if (target > pacer->spin)
+		pacer->spin = target;
+	else
+		pacer->spin -= (pacer->spin - target) / 16;
+	if (pacer->spin > PACER_MAX_SPIN_NS)
+		pacer->spin = PACER_MAX_SPIN_NS;
+}
+
+unsigned pacer_wait(pacer_t *pacer)
+{
+	uint64_t now = pacer_now();
+	unsigned frames = 1;
+
+	pacer->frames++;
+	if (now >= pacer->deadline)
+	{
+		// the deadline is over: no sleep, decide what to do of the lost time
+		uint64_t late = now - pacer->deadline;
+		uint64_t behind = late / pacer->period;
+
+		pacer->missed++;
+		histogram_add(&pacer->late, late);
+		// a long stall is only partly caught up, the rest is dropped
+		if (pacer->policy == PACER_CATCH_UP)
+			frames += (unsigned)(behind < PACER_MAX_CATCH_UP ? behind : PACER_MAX_CATCH_UP);
+		pacer->dropped += behind - (frames - 1);
+		// stay on the same grid of deadlines, so the lateness does not drift
+		pacer->deadline += (behind + 1) * pacer->period;
+	}
+	else
+	{
+		if (pacer->deadline - now > pacer->spin)
+		{
+			uint64_t wake = pacer->deadline - pacer->spin;
+
+			pacer_sleep_until(wake);
+			now = pacer_now();
+			histogram_add(&pacer->oversleep, now - wake);
+			pacer_adapt_spin(pacer, now - wake);
+		}
+		while (now < pacer->deadline)
+			now = pacer_now();
+		pacer->deadline += pacer->period;
+	}
+
+	histogram_add(&pacer->frame_time, now - pacer->last);
+	pacer->last = now;
+	return frames;
+}
+
+void pacer_report(const pacer_t *pacer, FILE *file)
+{
+	fprintf(file, "frames: %llu, missed deadlines: %llu, dropped frames: %llu, "
+			"spin: %.3fms\n",
+			(unsigned long long)pacer->frames,
+			(unsigned long long)pacer->missed,
+			(unsigned long long)pacer->dropped,
+			(double)pacer->spin / 1e6);
+	histogram_print(&pacer->frame_time, file, "frame time");
+	histogram_print(&pacer->oversleep, file, "oversleep");
+	histogram_print(&pacer->late, file, "late");
+}
@@ -0,0 +1,25 @@
+#include <stdlib.h>
+
+#include "ring.h"
+
+int ring_init(ring_t *ring, size_t elem_size, size_t count)
+{
+	if (count == 0 || (count & (count - 1)) != 0)
+		return -1;
+
+	ring->buf = malloc(elem_size * count);
+	if (ring->buf == NULL)
+		return -1;
+
+	ring->head = 0;
+	ring->tail = 0;
+	ring->mask = (uint32_t)(count - 1);
+	ring->elem_size = (uint32_t)elem_size;
+	return 0;
+}
+
+void ring_destroy(ring_t *ring)
+{
+	free(ring->buf);
+	ring->buf = NULL;
+}
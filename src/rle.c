@@ -0,0 +1,107 @@
+#include <string.h>
+
+#include "rle.h"
+
+size_t rle_encode(const unsigned char *pixels, size_t n, unsigned char *out)
+{
+	size_t len = 0;
+
+	for (size_t i = 0; i < n;)
+	{
+		unsigned char value = pixels[i] != 0;
+		size_t run = 1;
+
+		while (i + run < n && run < RLE_MAX_RUN && (pixels[i + run] != 0) == value)
+			run++;
+		out[len++] = (unsigned char)(value << 7 | (run - 1));
+		i += run;
+	}
+	return len;
+}
+
+size_t rle_decode(const unsigned char *in, size_t len, unsigned char *pixels, size_t n)
+{
+	size_t used = 0;
+
+	for (size_t i = 0; i < n; used++)
+	{
+		if (used == len)
+			return 0; // truncated
+		size_t run = (in[used] & 0x7Fu) + 1u;
+		if (run > n - i)
+			return 0; // overflows the pixels
+		for (; run > 0; run--)
+			pixels[i++] = in[used] >> 7;
+	}
+	return used;
+}
+
+size_t rle_encode_bytes(const unsigned char *in, size_t n, unsigned char *out)
+{
+	size_t len = 0;
+	size_t literal = 0; // start of the pending literal bytes
+
+	for (size_t i = 0; i < n;)
+	{
+		size_t run = 1;
+
+		while (i + run < n && run < 130 && in[i + run] == in[i])
+			run++;
+		if (run >= 3)
+		{
+			for (; literal < i; literal += 128)
+			{
+				size_t count = i - literal < 128 ? i - literal : 128;
+
+				out[len++] = (unsigned char)(count - 1);
+				memcpy(out + len, in + literal, count);
+				len += count;
+			}
+			out[len++] = (unsigned char)(run + 125);
+			out[len++] = in[i];
+			literal = i + run;
+		}
+		i += run;
+	}
+	for (; literal < n; literal += 128)
+	{
+		size_t count = n - literal < 128 ? n - literal : 128;
+
+		out[len++] = (unsigned char)(count - 1);
+		memcpy(out + len, in + literal, count);
+		len += count;
+	}
+	return len;
+}
+
+size_t rle_decode_bytes(const unsigned char *in, size_t len, unsigned char *out, size_t n)
+{
+	size_t used = 0;
+
+	for (size_t i = 0; i < n;)
+	{
+		if (used == len)
+			return 0; // truncated
+		unsigned char c = in[used++];
+		if (c < 128)
+		{
+			size_t count = c + 1u;
+
+			if (count > n - i || count > len - used)
+				return 0;
+			memcpy(out + i, in + used, count);
+			used += count;
+			i += count;
+		}
+		else
+		{
+			size_t count = c - 125u;
+
+			if (count > n - i || used == len)
+				return 0;
+			memset(out + i, in[used++], count);
+			i += count;
+		}
+	}
+	return used;
+}
@@ -0,0 +1,233 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rompack.h"
+#include "fnv.h"
+
+/* offsets of the fields of an index record */
+#define ENTRY_HASH    ROMPACK_NAME
+#define ENTRY_OFFSET  (ENTRY_HASH + 8)
+#define ENTRY_SIZE    (ENTRY_OFFSET + 4)
+#define ENTRY_PROFILE (ENTRY_SIZE + 2)
+#define ENTRY_KEYS    (ENTRY_PROFILE + 2)
+
+static const unsigned char rompack_identity[16] = {
+	0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7,
+	0x8, 0x9, 0xA, 0xB, 0xC, 0xD, 0xE, 0xF,
+};
+
+static uint64_t rompack_hash(const unsigned char *rom, size_t size)
+{
+	return fnv_bytes(FNV_OFFSET, rom, size);
+}
+
+static uint64_t read_be(const unsigned char *bytes, unsigned size)
+{
+	uint64_t value = 0;
+
+	for (unsigned i = 0; i < size; i++)
+		value = value << 8 | bytes[i];
+	return value;
+}
+
+static void write_be(unsigned char *bytes, uint64_t value, unsigned size)
+{
+	for (unsigned i = size; i-- > 0; value >>= 8)
+		bytes[i] = (unsigned char)value;
+}
+
+static const unsigned char *rompack_record(const rompack_t *pack, uint32_t index)
+{
+	return pack->base + ROMPACK_HEADER_SIZE + (size_t)index * ROMPACK_ENTRY_SIZE;
+}
+
+/* Check a record of the index, and that the names are sorted */
+static int rompack_check(const rompack_t *pack, uint32_t index)
+{
+	const unsigned char *record = rompack_record(pack, index);
+	uint64_t offset = read_be(record + ENTRY_OFFSET, 4);
+	uint64_t size = read_be(record + ENTRY_SIZE, 2);
+
+	if (memchr(record, '\0', ROMPACK_NAME) == NULL
+			|| (index > 0 && strcmp((const char *)rompack_record(pack, index - 1),
+					(const char *)record) >= 0))
+		return -1;
+	if (offset > pack->size || size > pack->size - offset || size > CHIP8_ROM_MAX)
+		return -1;
+	if (record[ENTRY_PROFILE] >= CHIP8_PROFILE_COUNT)
+		return -1;
+	for (unsigned k = 0; k < 16; k++)
+		if (record[ENTRY_KEYS + k] > 0xF)
+			return -1;
+	return 0;
+}
+
+int rompack_open(rompack_t *pack, const char *path)
+{
+	struct stat st;
+	void *base;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	if (st.st_size < ROMPACK_HEADER_SIZE)
+	{
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return -1;
+
+	pack->base = base;
+	pack->size = (size_t)st.st_size;
+	pack->count = (uint32_t)read_be(pack->base + 8, 4);
+	if (memcmp(pack->base, ROMPACK_MAGIC, 4) != 0 || pack->base[4] != ROMPACK_VERSION
+			|| pack->count > (pack->size - ROMPACK_HEADER_SIZE) / ROMPACK_ENTRY_SIZE)
+		goto invalid;
+	for (uint32_t i = 0; i < pack->count; i++)
+		if (rompack_check(pack, i) < 0)
+			goto invalid;
+	// the index is read at once, the games one by one
+	madvise(base, ROMPACK_HEADER_SIZE + (size_t)pack->count * ROMPACK_ENTRY_SIZE, MADV_WILLNEED);
+	return 0;
+
+invalid:
+	rompack_close(pack);
+	errno = EINVAL;
+	return -1;
+}
+
+void rompack_close(rompack_t *pack)
+{
+	if (pack->base != NULL)
+		munmap((void *)pack->base, pack->size);
+	pack->base = NULL;
+	pack->size = 0;
+	pack->count = 0;
+}
+
+void rompack_entry(const rompack_t *pack, uint32_t index, rompack_entry_t *entry)
+{
+	const unsigned char *record = rompack_record(pack, index);
+
+	entry->name = (const char *)record;
+	entry->hash = read_be(record + ENTRY_HASH, 8);
+	entry->rom = pack->base + read_be(record + ENTRY_OFFSET, 4);
+	entry->size = (size_t)read_be(record + ENTRY_SIZE, 2);
+	entry->profile = record[ENTRY_PROFILE];
+	entry->keys = record + ENTRY_KEYS;
+}
+
+int rompack_find(const rompack_t *pack, const char *name, rompack_entry_t *entry)
+{
+	uint32_t low = 0, high = pack->count;
+
+	while (low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		int cmp = strcmp(name, (const char *)rompack_record(pack, middle));
+
+		if (cmp == 0)
+		{
+			rompack_entry(pack, middle, entry);
+			return 0;
+		}
+		if (cmp < 0)
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	return -1;
+}
+
+int rompack_load(chip8_t *chip8, const rompack_entry_t *entry)
+{
+	if (chip8_set_profile(chip8, entry->profile) < 0)
+		return -1;
+	return chip8_load_rom(chip8, entry->rom, entry->size);
+}
+
+void rompack_map_keys(const rompack_entry_t *entry, const unsigned char *host, unsigned char *key)
+{
+	memset(key, 0, 16);
+	for (unsigned k = 0; k < 16; k++)
+		if (host[k])
+			key[entry->keys[k]] = 1;
+}
+
+int rompack_verify(const rompack_entry_t *entry)
+{
+	return rompack_hash(entry->rom, entry->size) == entry->hash ? 0 : -1;
+}
+
+int rompack_write(FILE *file, const rompack_entry_t *entries, uint32_t count)
+{
+	unsigned char header[ROMPACK_HEADER_SIZE] = { 0 };
+	uint64_t offset = ROMPACK_HEADER_SIZE + (uint64_t)count * ROMPACK_ENTRY_SIZE;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const rompack_entry_t *entry = &entries[i];
+
+		if (strlen(entry->name) >= ROMPACK_NAME
+				|| (i > 0 && strcmp(entries[i - 1].name, entry->name) >= 0)
+				|| entry->size > CHIP8_ROM_MAX
+				|| entry->profile < 0 || entry->profile >= CHIP8_PROFILE_COUNT)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		for (unsigned k = 0; entry->keys != NULL && k < 16; k++)
+			if (entry->keys[k] > 0xF)
+			{
+				errno = EINVAL;
+				return -1;
+			}
+		offset += entry->size;
+	}
+	if (offset > UINT32_MAX)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	memcpy(header, ROMPACK_MAGIC, 4);
+	header[4] = ROMPACK_VERSION;
+	write_be(header + 8, count, 4);
+	if (fwrite(header, sizeof(header), 1, file) != 1)
+		return -1;
+
+	offset = ROMPACK_HEADER_SIZE + (uint64_t)count * ROMPACK_ENTRY_SIZE;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const rompack_entry_t *entry = &entries[i];
+		unsigned char record[ROMPACK_ENTRY_SIZE] = { 0 };
+
+		memcpy(record, entry->name, strlen(entry->name));
+		write_be(record + ENTRY_HASH, rompack_hash(entry->rom, entry->size), 8);
+		write_be(record + ENTRY_OFFSET, offset, 4);
+		write_be(record + ENTRY_SIZE, entry->size, 2);
+		record[ENTRY_PROFILE] = (unsigned char)entry->profile;
+		memcpy(record + ENTRY_KEYS, entry->keys != NULL ? entry->keys : rompack_identity, 16);
+		if (fwrite(record, sizeof(record), 1, file) != 1)
+			return -1;
+		offset += entry->size;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+		if (entries[i].size > 0 && fwrite(entries[i].rom, entries[i].size, 1, file) != 1)
+			return -1;
+	return 0;
+}
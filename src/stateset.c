@@ -0,0 +1,49 @@
+#include <stdlib.h>
+
+#include "stateset.h"
+
+int stateset_init(stateset_t *set, unsigned bits)
+{
+	if (bits == 0 || bits >= 8 * sizeof(size_t))
+		return -1;
+	set->slots = calloc((size_t)1 << bits, sizeof(*set->slots));
+	if (set->slots == NULL)
+		return -1;
+	set->mask = ((size_t)1 << bits) - 1;
+	set->count = 0;
+	return 0;
+}
+
+void stateset_destroy(stateset_t *set)
+{
+	free(set->slots);
+	set->slots = NULL;
+}
+
+int stateset_insert(stateset_t *set, uint64_t hash)
+{
+	// 0 marks the empty slots, it shares its slot with 1
+	if (hash == 0)
+		hash = 1;
+
+	for (size_t i = (size_t)hash & set->mask; ; i = (i + 1) & set->mask)
+	{
+		uint64_t slot = __atomic_load_n(&set->slots[i], __ATOMIC_RELAXED);
+
+		if (slot == 0)
+		{
+			// keep a quarter of the slots empty so the probes stay short
+			if (stateset_count(set) >= set->mask - set->mask / 4)
+				return -1;
+			if (__atomic_compare_exchange_n(&set->slots[i], &slot, hash, 0,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				__atomic_add_fetch(&set->count, 1, __ATOMIC_RELAXED);
+				return 1;
+			}
+			// another thread took the slot, slot is what it wrote
+		}
+		if (slot == hash)
+			return 0;
+	}
+}
@@ -0,0 +1,158 @@
+#include <stddef.h>
+
+#include "timerwheel.h"
+
+#define TIMERWHEEL_MASK (TIMERWHEEL_SLOTS - 1)
+
+void timerwheel_init(timerwheel_t *wheel, uint64_t now)
+{
+	wheel->now = now;
+	for (unsigned l = 0; l < TIMERWHEEL_LEVELS; l++)
+	{
+		wheel->count[l] = 0;
+		for (unsigned i = 0; i < TIMERWHEEL_SLOTS; i++)
+			wheel->slots[l][i] = NULL;
+	}
+}
+
+void timerwheel_timer_init(wheel_timer_t *timer, void (*expire)(void *data), void *data)
+{
+	timer->next = NULL;
+	timer->pprev = NULL;
+	timer->expires = 0;
+	timer->level = 0;
+	timer->expire = expire;
+	timer->data = data;
+}
+
+/* Put a timer in the slot of its level, the closest levels are the finest */
+static void timerwheel_insert(timerwheel_t *wheel, wheel_timer_t *timer)
+{
+	uint64_t delta = timer->expires - wheel->now;
+	unsigned level = 0;
+	wheel_timer_t **slot;
+
+	while (level < TIMERWHEEL_LEVELS - 1 && delta >> (TIMERWHEEL_BITS * (level + 1)) != 0)
+		level++;
+	slot = &wheel->slots[level][(timer->expires >> (TIMERWHEEL_BITS * level)) & TIMERWHEEL_MASK];
+
+	timer->level = level;
+	timer->next = *slot;
+	if (*slot != NULL)
+		(*slot)->pprev = &timer->next;
+	timer->pprev = slot;
+	*slot = timer;
+	wheel->count[level]++;
+}
+
+static void timerwheel_unlink(timerwheel_t *wheel, wheel_timer_t *timer)
+{
+	*timer->pprev = timer->next;
+	if (timer->next != NULL)
+		timer->next->pprev = timer->pprev;
+	timer->next = NULL;
+	timer->pprev = NULL;
+	wheel->count[timer->level]--;
+}
+
+void timerwheel_add(timerwheel_t *wheel, wheel_timer_t *timer, uint64_t expires)
+{
+	if (timerwheel_pending(timer))
+		timerwheel_unlink(wheel, timer);
+	if (expires <= wheel->now)
+		expires = wheel->now + 1;
+	else if (expires - wheel->now > TIMERWHEEL_MAX_DELAY)
+		expires = wheel->now + TIMERWHEEL_MAX_DELAY;
+	timer->expires = expires;
+	timerwheel_insert(wheel, timer);
+}
+
+void timerwheel_del(timerwheel_t *wheel, wheel_timer_t *timer)
+{
+	if (timerwheel_pending(timer))
+		timerwheel_unlink(wheel, timer);
+}
+
+/* Move the timers of a slot to the levels below, their turn is coming */
+static void timerwheel_cascade(timerwheel_t *wheel, unsigned level, unsigned index)
+{
+	wheel_timer_t *timer = wheel->slots[level][index];
+
+	wheel->slots[level][index] = NULL;
+	while (timer != NULL)
+	{
+		wheel_timer_t *next = timer->next;
+
+		wheel->count[level]--;
+		timerwheel_insert(wheel, timer);
+		timer = next;
+	}
+}
+
+unsigned timerwheel_advance(timerwheel_t *wheel, uint64_t now)
+{
+	unsigned fired = 0;
+
+	while (wheel->now < now)
+	{
+		unsigned level = 0;
+		uint64_t tick;
+
+		// nothing can fire before the turn of the first level holding timers
+		while (level < TIMERWHEEL_LEVELS && wheel->count[level] == 0)
+			level++;
+		if (level == TIMERWHEEL_LEVELS)
+		{
+			wheel->now = now;
+			break;
+		}
+		if (level > 0)
+		{
+			uint64_t skip = wheel->now | ((1ULL << (TIMERWHEEL_BITS * level)) - 1);
+
+			wheel->now = skip < now ? skip : now;
+			if (wheel->now == now)
+				break;
+		}
+
+		tick = ++wheel->now;
+		for (level = 1; level < TIMERWHEEL_LEVELS; level++)
+		{
+			unsigned shift = TIMERWHEEL_BITS * level;
+
+			// a turn of the level below is over
+			if ((tick & ((1ULL << shift) - 1)) != 0)
+				break;
+			timerwheel_cascade(wheel, level, (unsigned)(tick >> shift) & TIMERWHEEL_MASK);
+		}
+
+		// the callbacks may add timers, never in this slot since they are
+		// at least one tick after this one
+		wheel_timer_t **slot = &wheel->slots[0][tick & TIMERWHEEL_MASK];
+		while (*slot != NULL)
+		{
+			wheel_timer_t *timer = *slot;
+
+			timerwheel_unlink(wheel, timer);
+			timer->expire(timer->data);
+			fired++;
+		}
+	}
+	return fired;
+}
+
+uint64_t timerwheel_next(const timerwheel_t *wheel)
+{
+	// the timers of the other levels come down at the end of the turn
+	uint64_t turn = TIMERWHEEL_SLOTS - (wheel->now & TIMERWHEEL_MASK);
+	unsigned far = 0;
+
+	for (unsigned l = 1; l < TIMERWHEEL_LEVELS; l++)
+		far += wheel->count[l];
+
+	if (wheel->count[0] > 0)
+		for (uint64_t delta = 1; delta <= TIMERWHEEL_SLOTS; delta++)
+			if (wheel->slots[0][(wheel->now + delta) & TIMERWHEEL_MASK] != NULL)
+				return far > 0 && turn < delta ? turn : delta;
+	return far > 0 ? turn : UINT64_MAX;
+}
@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#include "trace.h"
+
+/* how long the writer sleeps when the queue is empty */
+#define TRACE_IDLE_NS 1000000
+
+/* Write the queued entries, the only thread doing I/O */
+static void *trace_writer(void *arg)
+{
+	trace_t *trace = arg;
+	const struct timespec idle = { .tv_sec = 0, .tv_nsec = TRACE_IDLE_NS };
+
+	while (1)
+	{
+		uint32_t count;
+		void *entries = ring_peek_many(&trace->queue, &count);
+
+		if (count == 0)
+		{
+			// the stop flag is read before the last check of the queue
+			if (__atomic_load_n(&trace->stop, __ATOMIC_ACQUIRE)
+					&& ring_count(&trace->queue) == 0)
+				break;
+			nanosleep(&idle, NULL);
+			continue;
+		}
+		if (fwrite(entries, sizeof(trace_entry_t), count, trace->file) != count)
+			trace->error = 1;
+		ring_release_many(&trace->queue, count);
+	}
+	return NULL;
+}
+
+trace_entry_t *trace_wait(trace_t *trace)
+{
+	trace_entry_t *entry;
+
+	trace->stalls++;
+	while ((entry = ring_reserve(&trace->queue)) == NULL)
+		sched_yield();
+	return entry;
+}
+
+int trace_start(chip8_t *chip8, const char *path)
+{
+	trace_t *trace = calloc(1, sizeof(*trace));
+	uint16_t byte_order = TRACE_BYTE_ORDER;
+	unsigned char header[TRACE_HEADER_SIZE];
+
+	if (trace == NULL)
+		return -1;
+
+	memcpy(header, TRACE_MAGIC, 4);
+	header[4] = TRACE_VERSION;
+	header[5] = chip8->profile;
+	memcpy(header + 6, &byte_order, sizeof(byte_order));
+
+	trace->file = fopen(path, "wb");
+	if (trace->file == NULL)
+		goto err_free;
+	if (fwrite(header, sizeof(header), 1, trace->file) != 1)
+		goto err_close;
+	if (ring_init(&trace->queue, sizeof(trace_entry_t), TRACE_QUEUE) < 0)
+		goto err_close;
+	if (pthread_create(&trace->writer, NULL, trace_writer, trace) != 0)
+		goto err_ring;
+
+	chip8->trace = trace;
+	return 0;
+
+err_ring:
+	ring_destroy(&trace->queue);
+err_close:
+	fclose(trace->file);
+err_free:
+	free(trace);
+	return -1;
+}
+
+int trace_stop(chip8_t *chip8)
+{
+	trace_t *trace = chip8->trace;
+	int error;
+
+	if (trace == NULL)
+		return 0;
+	chip8->trace = NULL;
+
+	__atomic_store_n(&trace->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(trace->writer, NULL);
+
+	error = trace->error;
+	if (fclose(trace->file) != 0)
+		error = 1;
+	ring_destroy(&trace->queue);
+	free(trace);
+	return error ? -1 : 0;
+}
@@ -1,9 +1,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
 
-#include "window.h"
 #include "vm.h"
+#include "vm_decode.h"
+#include "debug.h"
+#include "trace.h"
+#include "fnv.h"
 
 const unsigned char chip8_fontset[] =
 {
@@ -25,516 +29,361 @@ const unsigned char chip8_fontset[] =
   0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+/* XOR of the hashes of the cells [first, first + size) */
+static uint64_t chip8_cells_hash(const unsigned char *cells, size_t size, unsigned first)
+{
+	uint64_t hash = 0;
+
+	for (size_t i = 0; i < size; i++)
+		hash ^= chip8_cell_hash(first + (unsigned)i, cells[i]);
+	return hash;
+}
+
+/* Combine the hash of the registers with the one of the cells */
+static uint64_t chip8_hash_state(const chip8_t *chip8, uint64_t cells)
+{
+	uint64_t hash = FNV_OFFSET;
+
+	hash = fnv_bytes(hash, chip8->V, sizeof(chip8->V));
+	hash = fnv_bytes(hash, &chip8->I, sizeof(chip8->I));
+	hash = fnv_bytes(hash, &chip8->pc, sizeof(chip8->pc));
+	hash = fnv_bytes(hash, &chip8->sp, sizeof(chip8->sp));
+	hash = fnv_bytes(hash, chip8->stack, sizeof(chip8->stack));
+	hash = fnv_bytes(hash, &chip8->delay_timer, sizeof(chip8->delay_timer));
+	hash = fnv_bytes(hash, &chip8->sound_timer, sizeof(chip8->sound_timer));
+	hash = fnv_bytes(hash, &chip8->halted, sizeof(chip8->halted));
+	hash = fnv_bytes(hash, &chip8->random, sizeof(chip8->random));
+	return fnv_bytes(hash, &cells, sizeof(cells));
+}
+
+/* Static pages shared by all the chip8, never freed nor written */
+static chip8_page_t chip8_zero_page;
+static chip8_page_t chip8_font_page;
+static uint64_t chip8_font_hash;
+static pthread_once_t chip8_pages_once = PTHREAD_ONCE_INIT;
+
+static void chip8_pages_init(void)
+{
+	memcpy(chip8_font_page.bytes, chip8_fontset, sizeof(chip8_fontset));
+	chip8_font_hash = chip8_cells_hash(chip8_font_page.bytes, sizeof(chip8_font_page.bytes), 0);
+}
+
+static void chip8_page_acquire(chip8_page_t *page)
+{
+	if (__atomic_load_n(&page->refs, __ATOMIC_RELAXED) != 0)
+		__atomic_add_fetch(&page->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void chip8_page_release(chip8_page_t *page)
+{
+	if (__atomic_load_n(&page->refs, __ATOMIC_RELAXED) != 0 && __atomic_sub_fetch(&page->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		free(page);
+}
+
+/* Hash of the whole memory, the zero pages hash to 0 */
+static uint64_t chip8_memory_hash(const chip8_t *chip8)
+{
+	uint64_t hash = 0;
+
+	for (unsigned i = 0; i < CHIP8_PAGE_COUNT; i++)
+		if (chip8->pages[i] != &chip8_zero_page)
+			hash ^= chip8_cells_hash(chip8->pages[i]->bytes, CHIP8_PAGE_SIZE, i * CHIP8_PAGE_SIZE);
+	return hash;
+}
+
+int chip8_page_unshare(chip8_t *chip8, unsigned index)
+{
+	chip8_page_t *page = malloc(sizeof(*page));
+
+	if (page == NULL)
+		return -1;
+	page->refs = 1;
+	memcpy(page->bytes, chip8->pages[index]->bytes, sizeof(page->bytes));
+	chip8_page_release(chip8->pages[index]);
+	chip8->pages[index] = page;
+	return 0;
+}
+
 chip8_t *chip8_init()
 {
 	chip8_t *chip8 = malloc(sizeof(*chip8));
 	if (chip8 == NULL)
 		return NULL;
 
+	if (ring_init(&chip8->events, sizeof(chip8_event_t), CHIP8_EVENT_QUEUE))
+	{
+		free(chip8);
+		return NULL;
+	}
+
 	/* initialize state */
 	chip8->pc = 0x200;
 	chip8->opcode = 0;
 	chip8->I = 0;
 	chip8->sp = 0;
+	chip8->profile = CHIP8_PROFILE_DEFAULT;
+	chip8->halted = 0;
+	chip8->engine = CHIP8_ENGINE_FAST;
+	chip8->random = CHIP8_RANDOM_SEED;
+	chip8->debug = NULL;
+	chip8->trace = NULL;
+	chip8->window = NULL;
 
 	/* initialize timers */
 	chip8->delay_timer = 0;
 	chip8->sound_timer = 0;
 
-	/* clear everything*/
-	memset(chip8->memory, 0, sizeof(chip8->memory));
+	/* clear everything, the memory is all shared pages */
+	pthread_once(&chip8_pages_once, chip8_pages_init);
+	for (unsigned i = 0; i < CHIP8_PAGE_COUNT; i++)
+		chip8->pages[i] = &chip8_zero_page;
 	memset(chip8->V, 0, sizeof(chip8->V));
 	memset(chip8->stack, 0, sizeof(chip8->stack));
 	memset(chip8->gfx, 0, sizeof(chip8->gfx));
 	memset(chip8->key, 0, sizeof(chip8->key));
+	memset(chip8->key_tag, 0, sizeof(chip8->key_tag));
+	chip8->read_tag = 0;
+	chip8->draw_tag = 0;
+	memset(chip8->decoded, INSN_NONE, sizeof(chip8->decoded));
 
 	/* load fontset into memory */
-	for(size_t i = 0; i < sizeof(chip8_fontset); ++i)
-		chip8->memory[i] = chip8_fontset[i];
+	chip8->pages[0] = &chip8_font_page;
+	chip8->memory_hash = chip8_font_hash;
+	chip8->gfx_hash = 0;
 
 	return chip8;
 }
 
-void chip8_free(chip8_t *chip8)
-{
-	if (chip8 != NULL)
-		free(chip8);
-}
-
-int chip8_load_game(chip8_t *chip8, FILE *fd)
+void chip8_copy(chip8_t *dst, const chip8_t *src)
 {
-	// beginning of the game data
-	unsigned char *game_buf = chip8->memory + 0x200; 
-	size_t max_len = 0xEA0 - 0x200;
+	ring_t events = dst->events;
+	struct chip8_debug_s *debug = dst->debug;
+	struct trace_s *trace = dst->trace;
+	window_t *window = dst->window;
 
-	if (chip8 == NULL || fd == NULL)
-		return -1;
+	for (unsigned i = 0; i < CHIP8_PAGE_COUNT; i++)
+	{
+		chip8_page_acquire(src->pages[i]);
+		chip8_page_release(dst->pages[i]);
+	}
+	*dst = *src;
 
-	fread(game_buf, max_len, 1, fd);
-	if (ferror(fd))
-		return -1;
-	if (!feof(fd))
-		return -1;
-	return 0;
+	dst->events = events;
+	ring_reset(&dst->events);
+	dst->debug = debug;
+	dst->trace = trace;
+	dst->window = window;
 }
 
-static void chip8_handle_opcode(chip8_t *chip8);
-
-int chip8_emulate_cycle(chip8_t *chip8)
+chip8_t *chip8_clone(const chip8_t *chip8)
 {
-	chip8_handle_opcode(chip8);
-
-	// Update timers
-	if(chip8->delay_timer > 0)
-		chip8->delay_timer--;
+	chip8_t *clone = chip8_init();
 
-	if(chip8->sound_timer > 0)
+	if (clone != NULL)
 	{
-		if(chip8->sound_timer == 1)
-			printf("\a");
-		chip8->sound_timer--;
+		clone->window = chip8->window;
+		chip8_copy(clone, chip8);
 	}
-	return 0;
+	return clone;
 }
 
-static void chip8_opcode_0NNN(chip8_t *chip8);
-static void chip8_opcode_00E0(chip8_t *chip8);
-static void chip8_opcode_00EE(chip8_t *chip8);
-static void chip8_opcode_1NNN(chip8_t *chip8);
-static void chip8_opcode_2NNN(chip8_t *chip8);
-static void chip8_opcode_3XNN(chip8_t *chip8);
-static void chip8_opcode_4XNN(chip8_t *chip8);
-static void chip8_opcode_5XY0(chip8_t *chip8);
-static void chip8_opcode_6XNN(chip8_t *chip8);
-static void chip8_opcode_7XNN(chip8_t *chip8);
-static void chip8_opcode_8XY0(chip8_t *chip8);
-static void chip8_opcode_8XY1(chip8_t *chip8);
-static void chip8_opcode_8XY2(chip8_t *chip8);
-static void chip8_opcode_8XY3(chip8_t *chip8);
-static void chip8_opcode_8XY4(chip8_t *chip8);
-static void chip8_opcode_8XY5(chip8_t *chip8);
-static void chip8_opcode_8XY6(chip8_t *chip8);
-static void chip8_opcode_8XY7(chip8_t *chip8);
-static void chip8_opcode_8XYE(chip8_t *chip8);
-static void chip8_opcode_9XY0(chip8_t *chip8);
-static void chip8_opcode_ANNN(chip8_t *chip8);
-static void chip8_opcode_BNNN(chip8_t *chip8);
-static void chip8_opcode_CXNN(chip8_t *chip8);
-static void chip8_opcode_DXYN(chip8_t *chip8);
-static void chip8_opcode_EX9E(chip8_t *chip8);
-static void chip8_opcode_EXA1(chip8_t *chip8);
-static void chip8_opcode_FX07(chip8_t *chip8);
-static void chip8_opcode_FX0A(chip8_t *chip8);
-static void chip8_opcode_FX15(chip8_t *chip8);
-static void chip8_opcode_FX18(chip8_t *chip8);
-static void chip8_opcode_FX1E(chip8_t *chip8);
-static void chip8_opcode_FX29(chip8_t *chip8);
-static void chip8_opcode_FX33(chip8_t *chip8);
-static void chip8_opcode_FX55(chip8_t *chip8);
-static void chip8_opcode_FX65(chip8_t *chip8);
-
-static void chip8_handle_opcode(chip8_t *chip8)
+void chip8_free(chip8_t *chip8)
 {
-	uint16_t opcode;
-
-	// get the current opcode
-	chip8->opcode = (uint16_t) (chip8->memory[chip8->pc] << 8 | chip8->memory[chip8->pc + 1]);
-	opcode = chip8->opcode;
-
-	if (opcode == 0x00EE)
-		chip8_opcode_00EE(chip8);
-	else if (opcode == 0x00E0)
-		chip8_opcode_00E0(chip8);
-	else if ((opcode & 0xF000) == 0x0000)
-		chip8_opcode_0NNN(chip8);
-	else if ((opcode & 0xF000) == 0x1000)
-		chip8_opcode_1NNN(chip8);
-	else if ((opcode & 0xF000) == 0x2000)
-		chip8_opcode_2NNN(chip8);
-	else if ((opcode & 0xF000) == 0x3000)
-		chip8_opcode_3XNN(chip8);
-	else if ((opcode & 0xF000) == 0x4000)
-		chip8_opcode_4XNN(chip8);
-	else if ((opcode & 0xF00F) == 0x5000)
-		chip8_opcode_5XY0(chip8);
-	else if ((opcode & 0xF000) == 0x6000)
-		chip8_opcode_6XNN(chip8);
-	else if ((opcode & 0xF000) == 0x7000)
-		chip8_opcode_7XNN(chip8);
-	else if ((opcode & 0xF00F) == 0x8000)
-		chip8_opcode_8XY0(chip8);
-	else if ((opcode & 0xF00F) == 0x8001)
-		chip8_opcode_8XY1(chip8);
-	else if ((opcode & 0xF00F) == 0x8002)
-		chip8_opcode_8XY2(chip8);
-	else if ((opcode & 0xF00F) == 0x8003)
-		chip8_opcode_8XY3(chip8);
-	else if ((opcode & 0xF00F) == 0x8004)
-		chip8_opcode_8XY4(chip8);
-	else if ((opcode & 0xF00F) == 0x8005)
-		chip8_opcode_8XY5(chip8);
-	else if ((opcode & 0xF00F) == 0x8006)
-		chip8_opcode_8XY6(chip8);
-	else if ((opcode & 0xF00F) == 0x8007)
-		chip8_opcode_8XY7(chip8);
-	else if ((opcode & 0xF00F) == 0x800E)
-		chip8_opcode_8XYE(chip8);
-	else if ((opcode & 0xF00F) == 0x9000)
-		chip8_opcode_9XY0(chip8);
-	else if ((opcode & 0xF000) == 0xA000)
-		chip8_opcode_ANNN(chip8);
-	else if ((opcode & 0xF000) == 0xB000)
-		chip8_opcode_BNNN(chip8);
-	else if ((opcode & 0xF000) == 0xC000)
-		chip8_opcode_CXNN(chip8);
-	else if ((opcode & 0xF000) == 0xD000)
-		chip8_opcode_DXYN(chip8);
-	else if ((opcode & 0xF0FF) == 0xE09E)
-		chip8_opcode_EX9E(chip8);
-	else if ((opcode & 0xF0FF) == 0xE0A1)
-		chip8_opcode_EXA1(chip8);
-	else if ((opcode & 0xF0FF) == 0xF007)
-		chip8_opcode_FX07(chip8);
-	else if ((opcode & 0xF0FF) == 0xF00A)
-		chip8_opcode_FX0A(chip8);
-	else if ((opcode & 0xF0FF) == 0xF015)
-		chip8_opcode_FX15(chip8);
-	else if ((opcode & 0xF0FF) == 0xF018)
-		chip8_opcode_FX18(chip8);
-	else if ((opcode & 0xF0FF) == 0xF01E)
-		chip8_opcode_FX1E(chip8);
-	else if ((opcode & 0xF0FF) == 0xF029)
-		chip8_opcode_FX29(chip8);
-	else if ((opcode & 0xF0FF) == 0xF033)
-		chip8_opcode_FX33(chip8);
-	else if ((opcode & 0xF0FF) == 0xF055)
-		chip8_opcode_FX55(chip8);
-	else if ((opcode & 0xF0FF) == 0xF065)
-		chip8_opcode_FX65(chip8);
-	else
+	if (chip8 != NULL)
 	{
-		printf("Unknown opcode: 0x%.4X\n", opcode);
-		exit(1);
+		ring_destroy(&chip8->events);
+		chip8_debug_detach(chip8);
+		trace_stop(chip8);
+		for (unsigned i = 0; i < CHIP8_PAGE_COUNT; i++)
+			chip8_page_release(chip8->pages[i]);
+		free(chip8);
 	}
 }
 
-/* Decode the instruction */
-#define OP ((chip8->opcode & 0xF000) >> 12)
-#define OP_NNN (chip8->opcode & 0x0FFF)
-#define OP_NN (chip8->opcode & 0x00FF)
-#define OP_N (chip8->opcode & 0x000F)
-#define OP_X ((chip8->opcode & 0x0F00) >> 8)
-#define OP_Y ((chip8->opcode & 0x00F0) >> 4)
-
-/* Clears the screen. */
-static void chip8_opcode_00E0(chip8_t *chip8)
+int chip8_load_rom(chip8_t *chip8, const unsigned char *rom, size_t size)
 {
-	memset(chip8->gfx, 0, sizeof(chip8->gfx));
+	if (chip8 == NULL || size > CHIP8_ROM_MAX)
+		return -1;
 
-	window_clear(chip8->window);
-	chip8->pc += 2;
+	// page by page, only the hashes of the bytes replaced change
+	for (size_t done = 0; done < size;)
+	{
+		unsigned addr = CHIP8_ROM_START + (unsigned)done;
+		unsigned index = addr >> CHIP8_PAGE_BITS;
+		unsigned offset = addr & (CHIP8_PAGE_SIZE - 1);
+		size_t len = CHIP8_PAGE_SIZE - offset < size - done ? CHIP8_PAGE_SIZE - offset : size - done;
+		unsigned char *bytes;
+
+		if (chip8->pages[index] != &chip8_zero_page)
+			chip8->memory_hash ^= chip8_cells_hash(chip8->pages[index]->bytes + offset, len, addr);
+		if (__atomic_load_n(&chip8->pages[index]->refs, __ATOMIC_ACQUIRE) != 1
+				&& chip8_page_unshare(chip8, index) < 0)
+		{
+			chip8->memory_hash = chip8_memory_hash(chip8);
+			return -1;
+		}
+		bytes = chip8->pages[index]->bytes + offset;
+		memcpy(bytes, rom + done, len);
+		chip8->memory_hash ^= chip8_cells_hash(bytes, len, addr);
+		done += len;
+	}
+	memset(chip8->decoded, INSN_NONE, sizeof(chip8->decoded));
+	return 0;
 }
 
-/* Returns from a subroutine. */
-static void chip8_opcode_00EE(chip8_t *chip8)
+int chip8_load_game(chip8_t *chip8, FILE *fd)
 {
-	chip8->sp--;
-	chip8->pc = chip8->stack[chip8->sp];
-	chip8->pc += 2;
-}
+	// beginning of the game data
+	unsigned char game_buf[CHIP8_ROM_MAX];
+	size_t len;
 
-/* Calls RCA 1802 program at address NNN. Not necessary for most ROMs. */
-static void chip8_opcode_0NNN(chip8_t *chip8)
-{
-	chip8->pc += 2;
-}
+	if (chip8 == NULL || fd == NULL)
+		return -1;
 
-/* Jumps to address NNN. */
-static void chip8_opcode_1NNN(chip8_t *chip8)
-{
-	chip8->pc = OP_NNN;
+	len = fread(game_buf, 1, sizeof(game_buf), fd);
+	if (chip8_load_rom(chip8, game_buf, len) < 0)
+		return -1;
+	if (ferror(fd))
+		return -1;
+	if (!feof(fd))
+		return -1;
+	return 0;
 }
 
-/* Calls subroutine at NNN. */
-static void chip8_opcode_2NNN(chip8_t *chip8)
-{
-	// Store current address in stack
-	chip8->stack[chip8->sp] = chip8->pc;
-	chip8->sp++; // Increment stack pointer
-	// Set the program counter to the address at NNN
-	chip8->pc = OP_NNN;
-}
 
-/* Skips the next instruction if VX equals NN. (Usually the next instruction is a jump to skip a code block) */
-static void chip8_opcode_3XNN(chip8_t *chip8)
-{
-	if(chip8->V[OP_X] == OP_NN)
-		chip8->pc += 2;
-	chip8->pc += 2;
-}
+/* One interpreter per profile, with the quirks resolved at compile time */
+#define CHIP8_PROFILE CHIP8_PROFILE_DEFAULT
+#define CHIP8_NAME(name) chip8_default_##name
+#include "vm_interp.h"
+#undef CHIP8_PROFILE
+#undef CHIP8_NAME
 
-/* Skips the next instruction if VX doesn't equal NN. (Usually the next instruction is a jump to skip a code block) */
-static void chip8_opcode_4XNN(chip8_t *chip8)
-{
-	if(chip8->V[OP_X] != OP_NN)
-		chip8->pc += 2;
-	chip8->pc += 2;
-}
+#define CHIP8_PROFILE CHIP8_PROFILE_VIP
+#define CHIP8_NAME(name) chip8_vip_##name
+#include "vm_interp.h"
+#undef CHIP8_PROFILE
+#undef CHIP8_NAME
 
-/* Skips the next instruction if VX equals VY. (Usually the next instruction is a jump to skip a code block) */
-static void chip8_opcode_5XY0(chip8_t *chip8)
-{
-	if(chip8->V[OP_X] == chip8->V[OP_Y])
-		chip8->pc += 2;
-	chip8->pc += 2;
-}
+#define CHIP8_PROFILE CHIP8_PROFILE_SCHIP
+#define CHIP8_NAME(name) chip8_schip_##name
+#include "vm_interp.h"
+#undef CHIP8_PROFILE
+#undef CHIP8_NAME
 
-/* Sets VX to NN. */
-static void chip8_opcode_6XNN(chip8_t *chip8)
-{
-	chip8->V[OP_X] = OP_NN;
-	chip8->pc += 2;
-}
+static const chip8_run_t chip8_interpreters[CHIP8_PROFILE_COUNT] = {
+	[CHIP8_PROFILE_DEFAULT] = chip8_default_run,
+	[CHIP8_PROFILE_VIP] = chip8_vip_run,
+	[CHIP8_PROFILE_SCHIP] = chip8_schip_run,
+};
 
-/* Adds NN to VX. (Carry flag is not changed) */
-static void chip8_opcode_7XNN(chip8_t *chip8)
-{
-	chip8->V[OP_X] += OP_NN;
-	chip8->pc += 2;
-}
+static const char *const chip8_profile_names[CHIP8_PROFILE_COUNT] = CHIP8_PROFILE_NAMES;
+static const char *const chip8_engine_names[CHIP8_ENGINE_COUNT] = CHIP8_ENGINE_NAMES;
 
-/* Sets VX to the value of VY. */
-static void chip8_opcode_8XY0(chip8_t *chip8)
+int chip8_set_profile(chip8_t *chip8, int profile)
 {
-	chip8->V[OP_X] = chip8->V[OP_Y];
-	chip8->pc += 2;
+	if (profile < 0 || profile >= CHIP8_PROFILE_COUNT)
+		return -1;
+	chip8->profile = (unsigned char)profile;
+	return 0;
 }
 
-/* Sets VX to VX or VY. (Bitwise OR operation) */
-static void chip8_opcode_8XY1(chip8_t *chip8)
+int chip8_profile_by_name(const char *name)
 {
-	chip8->V[OP_X] |= chip8->V[OP_Y];
-	chip8->pc += 2;
+	for (int i = 0; i < CHIP8_PROFILE_COUNT; i++)
+		if (strcmp(chip8_profile_names[i], name) == 0)
+			return i;
+	return -1;
 }
 
-/* Sets VX to VX and VY. (Bitwise AND operation) */
-static void chip8_opcode_8XY2(chip8_t *chip8)
+int chip8_set_engine(chip8_t *chip8, int engine)
 {
-	chip8->V[OP_X] &= chip8->V[OP_Y];
-	chip8->pc += 2;
+	if (engine < 0 || engine >= CHIP8_ENGINE_COUNT)
+		return -1;
+	chip8->engine = (unsigned char)engine;
+	return 0;
 }
 
-/* Sets VX to VX xor VY. */
-static void chip8_opcode_8XY3(chip8_t *chip8)
+int chip8_engine_by_name(const char *name)
 {
-	chip8->V[OP_X] ^= chip8->V[OP_Y];
-	chip8->pc += 2;
+	for (int i = 0; i < CHIP8_ENGINE_COUNT; i++)
+		if (strcmp(chip8_engine_names[i], name) == 0)
+			return i;
+	return -1;
 }
 
-/* Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't. */
-static void chip8_opcode_8XY4(chip8_t *chip8)
+void chip8_seed(chip8_t *chip8, uint32_t seed)
 {
-	unsigned short sum = chip8->V[OP_X] + chip8->V[OP_Y];
-
-	if(sum > 0xFF) chip8->V[0xF] = 1;
-	else chip8->V[0xF] = 0;
-
-	chip8->V[OP_X] = (unsigned char)sum;
-	chip8->pc += 2;
+	chip8->random = seed != 0 ? seed : CHIP8_RANDOM_SEED;
 }
 
-/* VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't. */
-static void chip8_opcode_8XY5(chip8_t *chip8)
+uint64_t chip8_state_hash(const chip8_t *chip8)
 {
-	if(chip8->V[OP_Y] > chip8->V[OP_X])
-		chip8->V[0xF] = 0; // there is a borrow
-	else
-		chip8->V[0xF] = 1;
-	chip8->V[OP_X] -= chip8->V[OP_Y];
-	chip8->pc += 2;
+	return chip8_hash_state(chip8, chip8->memory_hash ^ chip8->gfx_hash);
 }
 
-/* Stores the least significant bit of VX in VF and then shifts VX to the right by 1. */
-static void chip8_opcode_8XY6(chip8_t *chip8)
+uint64_t chip8_state_hash_full(const chip8_t *chip8)
 {
-	chip8->V[0xF] = chip8->V[OP_X] & 0x1;
-	chip8->V[OP_X] >>= 1;
-	chip8->pc += 2;
+	return chip8_hash_state(chip8,
+			chip8_memory_hash(chip8)
+			^ chip8_cells_hash(chip8->gfx, sizeof(chip8->gfx), CHIP8_GFX_CELL(0)));
 }
 
-/* Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't. */
-static void chip8_opcode_8XY7(chip8_t *chip8)
+static void chip8_run(chip8_t *chip8, unsigned budget)
 {
-	if(chip8->V[OP_X] > chip8->V[OP_Y])
-		chip8->V[0xF] = 0;
+	// the instrumented copies run the reference engine, and while a debugger
+	// or a trace is attached
+	if (chip8->engine == CHIP8_ENGINE_REFERENCE
+			|| chip8->debug != NULL || chip8->trace != NULL)
+		chip8_debug_interpreters[chip8->profile](chip8, budget);
 	else
-		chip8->V[0xF] = 1;
-
-	chip8->V[OP_X] = chip8->V[OP_Y] - chip8->V[OP_X];
-	chip8->pc += 2;
+		chip8_interpreters[chip8->profile](chip8, budget);
 }
 
-/* Stores the most significant bit of VX in VF and then shifts VX to the left by 1. */
-static void chip8_opcode_8XYE(chip8_t *chip8)
-{
-	chip8->V[0xF] = chip8->V[OP_X] >> 7;
-	chip8->V[OP_X] <<= 1;
-	chip8->pc += 2;
-}
-
-/* Skips the next instruction if VX doesn't equal VY. (Usually the next instruction is a jump to skip a code block) */
-static void chip8_opcode_9XY0(chip8_t *chip8)
-{
-	if(chip8->V[OP_X] != chip8->V[OP_Y])
-		chip8->pc += 2;
-	chip8->pc += 2;
-}
-
-// Sets I to the address NNN
-static void chip8_opcode_ANNN(chip8_t *chip8)
-{
-	chip8->I = OP_NNN;
-	chip8->pc += 2;
-}
-
-/* Jumps to the address NNN plus V0. */
-static void chip8_opcode_BNNN(chip8_t *chip8)
-{
-	chip8->pc = OP_NNN + chip8->V[0];
-}
-
-/* Sets VX to the result of a bitwise and operation on a random number (Typically: 0 to 255) and NN. */
-static void chip8_opcode_CXNN(chip8_t *chip8)
-{
-	chip8->V[OP_X] = (rand() % 0xFF) & OP_NN;
-	chip8->pc += 2;
-}
-
-/* Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels. Each row of 8 pixels is read as bit-coded starting from memory location I; I value doesn’t change after the execution of this instruction. As described above, VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that doesn’t happen */
-static void chip8_opcode_DXYN(chip8_t *chip8)
+int chip8_emulate_cycle(chip8_t *chip8)
 {
-	unsigned char X = chip8->V[OP_X];
-	unsigned char Y = chip8->V[OP_Y];
-	uint16_t height = OP_N;
-	uint16_t pixel;
-
-	chip8->V[0xF] = 0;
-	for (unsigned char s_y = 0; s_y < height; s_y++)
-	{
-		pixel = chip8->memory[chip8->I + s_y];
-		for(unsigned char s_x = 0; s_x < 8; s_x++)
-		{
-			if((pixel & (0x80 >> s_x)) != 0)
-			{
-				size_t pos = (X + s_x + ((Y + s_y) * 64)) % 2048;
-				if(chip8->gfx[pos] == 1)
-					chip8->V[0xF] = 1;
-				chip8->gfx[pos] = ~chip8->gfx[pos] ;
-			}
-		}
-	}
-	chip8->pc += 2;
+	chip8_run(chip8, 1);
+	return chip8->halted ? -1 : 0;
 }
 
-/* Skips the next instruction if the key stored in VX is pressed. (Usually the next instruction is a jump to skip a code block) */
-static void chip8_opcode_EX9E(chip8_t *chip8)
+int chip8_emulate_frame(chip8_t *chip8)
 {
-	if(chip8->key[chip8->V[OP_X]] != 0)
-		chip8->pc += 2;
-	chip8->pc += 2;
+	chip8_run(chip8, CHIP8_CYCLES_PER_FRAME);
+	return chip8->halted ? -1 : 0;
 }
 
-/* Skips the next instruction if the key stored in VX isn't pressed. (Usually the next instruction is a jump to skip a code block) */
-static void chip8_opcode_EXA1(chip8_t *chip8)
+int chip8_emulate_cycles(chip8_t *chip8, unsigned count)
 {
-	if(chip8->key[chip8->V[OP_X]] == 0)
-		chip8->pc += 2;
-	chip8->pc += 2;
+	chip8_run(chip8, count);
+	return chip8->halted ? -1 : 0;
 }
 
-/* Sets VX to the value of the delay timer. */
-static void chip8_opcode_FX07(chip8_t *chip8)
+int chip8_poll_event(chip8_t *chip8, chip8_event_t *event)
 {
-	chip8->V[OP_X] = chip8->delay_timer;
-	chip8->pc += 2;
+	return ring_pop(&chip8->events, event);
 }
 
-/* A key press is awaited, and then stored in VX. (Blocking Operation. All instruction halted until next key event) */
-static void chip8_opcode_FX0A(chip8_t *chip8)
+const char *chip8_event_name(int type)
 {
-	char key_pressed = 0;
-
-	for(unsigned char i = 0; i < 16; i++)
+	switch (type)
 	{
-		if(chip8->key[i] != 0)
-		{
-			chip8->V[OP_X] = i;
-			key_pressed = 1;
-		}
+		case CHIP8_EVENT_SOUND_START:
+			return "Sound start";
+		case CHIP8_EVENT_SOUND_STOP:
+			return "Sound stop";
+		case CHIP8_EVENT_UNKNOWN_OPCODE:
+			return "Unknown opcode";
+		case CHIP8_EVENT_STACK_OVERFLOW:
+			return "Stack overflow";
+		case CHIP8_EVENT_STACK_UNDERFLOW:
+			return "Stack underflow";
+		case CHIP8_EVENT_PC_OVERFLOW:
+			return "Program counter overflow";
+		case CHIP8_EVENT_ADDRESS_OVERFLOW:
+			return "Address overflow";
+		case CHIP8_EVENT_OUT_OF_MEMORY:
+			return "Out of memory";
+		case CHIP8_EVENT_HALTED:
+			return "Halted";
 	}
-
-	// If we didn't received a keypress, skip this cycle and try again.
-	if(key_pressed == 0)
-		return;
-
-	chip8->pc += 2;
-}
-
-/* Sets the delay timer to VX. */
-static void chip8_opcode_FX15(chip8_t *chip8)
-{
-	chip8->delay_timer = chip8->V[OP_X];
-	chip8->pc += 2;
-}
-
-/* Sets the sound timer to VX. */
-static void chip8_opcode_FX18(chip8_t *chip8)
-{
-	chip8->sound_timer = chip8->V[OP_X];
-	chip8->pc += 2;
-}
-
-/* Adds VX to I. */
-static void chip8_opcode_FX1E(chip8_t *chip8)
-{
-	unsigned short sum = chip8->I + chip8->V[0xF];
-	if(sum > 0xFFF) chip8->V[0xF] = 1;
-	else chip8->V[0xF] = 0;
-
-	chip8->I += chip8->V[OP_X];
-	chip8->pc += 2;
-}
-
-/* Sets I to the location of the sprite for the character in VX. Characters 0-F (in hexadecimal) are represented by a 4x5 font. */
-static void chip8_opcode_FX29(chip8_t *chip8)
-{
-	chip8->I = chip8->V[OP_X] * 0x5;
-	chip8->pc += 2;
-}
-
-/* Stores the binary-coded decimal representation of VX, with the most significant of three digits at the address in I, the middle digit at I plus 1, and the least significant digit at I plus 2. (In other words, take the decimal representation of VX, place the hundreds digit in memory at location in I, the tens digit at location I+1, and the ones digit at location I+2.) */
-static void chip8_opcode_FX33(chip8_t *chip8)
-{
-	chip8->memory[chip8->I]     = chip8->V[OP_X] / 100;
-	chip8->memory[chip8->I + 1] = (chip8->V[OP_X] / 10) % 10;
-	chip8->memory[chip8->I + 2] = chip8->V[OP_X] % 10;
-	chip8->pc += 2;
-}
-
-/* Stores V0 to VX (including VX) in memory starting at address I. The offset from I is increased by 1 for each value written, but I itself is left unmodified. */
-static void chip8_opcode_FX55(chip8_t *chip8)
-{
-	for (unsigned char i = 0; i <= OP_X; i++)
-		chip8->memory[chip8->I + i] = chip8->V[i];	
-
-	chip8->pc += 2;
-}
-
-/* Fills V0 to VX (including VX) with values from memory starting at address I. The offset from I is increased by 1 for each value written, but I itself is left unmodified. */
-static void chip8_opcode_FX65(chip8_t *chip8)
-{
-	for (unsigned char i = 0; i <= OP_X; i++)
-		chip8->V[i] = chip8->memory[chip8->I + i];
-
-	chip8->pc += 2;
+	return "Unknown event";
 }
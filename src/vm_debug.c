@@ -0,0 +1,41 @@
+/*
+ * Instrumented copies of the interpreters, used while a debugger is attached
+ * (see include/debug.h) or the execution is traced (see include/trace.h).
+ * Without any of them they are the reference engine, CHIP8_ENGINE_REFERENCE.
+ * They are built from the same template as the interpreters of src/vm.c,
+ * which stay free of any debugging code.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "vm.h"
+#include "vm_decode.h"
+#include "debug.h"
+#include "trace.h"
+
+#define CHIP8_INSTRUMENTED
+
+#define CHIP8_PROFILE CHIP8_PROFILE_DEFAULT
+#define CHIP8_NAME(name) chip8_debug_default_##name
+#include "vm_interp.h"
+#undef CHIP8_PROFILE
+#undef CHIP8_NAME
+
+#define CHIP8_PROFILE CHIP8_PROFILE_VIP
+#define CHIP8_NAME(name) chip8_debug_vip_##name
+#include "vm_interp.h"
+#undef CHIP8_PROFILE
+#undef CHIP8_NAME
+
+#define CHIP8_PROFILE CHIP8_PROFILE_SCHIP
+#define CHIP8_NAME(name) chip8_debug_schip_##name
+#include "vm_interp.h"
+#undef CHIP8_PROFILE
+#undef CHIP8_NAME
+
+const chip8_run_t chip8_debug_interpreters[CHIP8_PROFILE_COUNT] = {
+	[CHIP8_PROFILE_DEFAULT] = chip8_debug_default_run,
+	[CHIP8_PROFILE_VIP] = chip8_debug_vip_run,
+	[CHIP8_PROFILE_SCHIP] = chip8_debug_schip_run,
+};
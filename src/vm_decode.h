@@ -0,0 +1,208 @@
+#ifndef _VM_DECODE_H_
+#define _VM_DECODE_H_
+
+/*
+ * Decoding of the instructions, shared by the interpreters of src/vm.c and
+ * the instrumented ones of src/vm_debug.c.
+ */
+
+#include "vm.h"
+
+/*
+ * Index of the instruction handlers in chip8_insns.
+ * The decoding of the instruction at each address is cached in
+ * chip8->decoded, and a few common sequences of instructions are fused into
+ * superinstructions executing all of them in one dispatch.
+ * Every address is decoded on its own, so jumping in the middle of a fused
+ * sequence just executes the tail of the sequence.
+ */
+enum chip8_insn {
+	INSN_NONE = 0, /* not decoded yet */
+	INSN_UNKNOWN,
+	INSN_0NNN, INSN_00E0, INSN_00EE, INSN_1NNN, INSN_2NNN, INSN_3XNN,
+	INSN_4XNN, INSN_5XY0, INSN_6XNN, INSN_7XNN, INSN_8XY0, INSN_8XY1,
+	INSN_8XY2, INSN_8XY3, INSN_8XY4, INSN_8XY5, INSN_8XY6, INSN_8XY7,
+	INSN_8XYE, INSN_9XY0, INSN_ANNN, INSN_BNNN, INSN_CXNN, INSN_DXYN,
+	INSN_EX9E, INSN_EXA1, INSN_FX07, INSN_FX0A, INSN_FX15, INSN_FX18,
+	INSN_FX1E, INSN_FX29, INSN_FX33, INSN_FX55, INSN_FX65,
+
+	/* superinstructions */
+	FUSED_ANNN_DXYN,
+	FUSED_6XNN_2,
+	FUSED_6XNN_3,
+	FUSED_6XNN_4,
+	FUSED_3XNN_1NNN,
+	FUSED_4XNN_1NNN,
+	FUSED_FX07_3XNN,
+	FUSED_FX07_4XNN,
+	FUSED_FX07_3XNN_1NNN,
+	FUSED_FX07_4XNN_1NNN,
+	FUSED_FX33_FX65,
+};
+
+static inline uint16_t chip8_fetch(const chip8_t *chip8, uint16_t pc)
+{
+	const unsigned char *bytes = chip8->pages[pc >> CHIP8_PAGE_BITS]->bytes;
+	unsigned offset = pc & (CHIP8_PAGE_SIZE - 1);
+
+	// the two bytes are in the same page, unless pc is odd and at its end
+	if (offset != CHIP8_PAGE_SIZE - 1)
+		return (uint16_t) (bytes[offset] << 8 | bytes[offset + 1]);
+	return (uint16_t) (bytes[offset] << 8 | chip8_read(chip8, pc + 1u));
+}
+
+/* Load the next instruction of a fused sequence */
+static inline void chip8_fetch_next(chip8_t *chip8)
+{
+	chip8->opcode = chip8_fetch(chip8, chip8->pc);
+}
+
+static inline enum chip8_insn chip8_decode_opcode(uint16_t opcode)
+{
+	if (opcode == 0x00EE)
+		return INSN_00EE;
+	else if (opcode == 0x00E0)
+		return INSN_00E0;
+	else if ((opcode & 0xF000) == 0x0000)
+		return INSN_0NNN;
+	else if ((opcode & 0xF000) == 0x1000)
+		return INSN_1NNN;
+	else if ((opcode & 0xF000) == 0x2000)
+		return INSN_2NNN;
+	else if ((opcode & 0xF000) == 0x3000)
+		return INSN_3XNN;
+	else if ((opcode & 0xF000) == 0x4000)
+		return INSN_4XNN;
+	else if ((opcode & 0xF00F) == 0x5000)
+		return INSN_5XY0;
+	else if ((opcode & 0xF000) == 0x6000)
+		return INSN_6XNN;
+	else if ((opcode & 0xF000) == 0x7000)
+		return INSN_7XNN;
+	else if ((opcode & 0xF00F) == 0x8000)
+		return INSN_8XY0;
+	else if ((opcode & 0xF00F) == 0x8001)
+		return INSN_8XY1;
+	else if ((opcode & 0xF00F) == 0x8002)
+		return INSN_8XY2;
+	else if ((opcode & 0xF00F) == 0x8003)
+		return INSN_8XY3;
+	else if ((opcode & 0xF00F) == 0x8004)
+		return INSN_8XY4;
+	else if ((opcode & 0xF00F) == 0x8005)
+		return INSN_8XY5;
+	else if ((opcode & 0xF00F) == 0x8006)
+		return INSN_8XY6;
+	else if ((opcode & 0xF00F) == 0x8007)
+		return INSN_8XY7;
+	else if ((opcode & 0xF00F) == 0x800E)
+		return INSN_8XYE;
+	else if ((opcode & 0xF00F) == 0x9000)
+		return INSN_9XY0;
+	else if ((opcode & 0xF000) == 0xA000)
+		return INSN_ANNN;
+	else if ((opcode & 0xF000) == 0xB000)
+		return INSN_BNNN;
+	else if ((opcode & 0xF000) == 0xC000)
+		return INSN_CXNN;
+	else if ((opcode & 0xF000) == 0xD000)
+		return INSN_DXYN;
+	else if ((opcode & 0xF0FF) == 0xE09E)
+		return INSN_EX9E;
+	else if ((opcode & 0xF0FF) == 0xE0A1)
+		return INSN_EXA1;
+	else if ((opcode & 0xF0FF) == 0xF007)
+		return INSN_FX07;
+	else if ((opcode & 0xF0FF) == 0xF00A)
+		return INSN_FX0A;
+	else if ((opcode & 0xF0FF) == 0xF015)
+		return INSN_FX15;
+	else if ((opcode & 0xF0FF) == 0xF018)
+		return INSN_FX18;
+	else if ((opcode & 0xF0FF) == 0xF01E)
+		return INSN_FX1E;
+	else if ((opcode & 0xF0FF) == 0xF029)
+		return INSN_FX29;
+	else if ((opcode & 0xF0FF) == 0xF033)
+		return INSN_FX33;
+	else if ((opcode & 0xF0FF) == 0xF055)
+		return INSN_FX55;
+	else if ((opcode & 0xF0FF) == 0xF065)
+		return INSN_FX65;
+	return INSN_UNKNOWN;
+}
+
+/* Decode the n-th instruction after pc, INSN_NONE if outside of the memory */
+static inline enum chip8_insn chip8_decode_next(const chip8_t *chip8, uint16_t pc, unsigned n)
+{
+	unsigned addr = pc + 2u * n;
+
+	if (addr + 1 >= CHIP8_MEMORY_SIZE)
+		return INSN_NONE;
+	return chip8_decode_opcode(chip8_fetch(chip8, (uint16_t)addr));
+}
+
+/* Decode the instruction at pc and try to fuse it with the following ones */
+static inline enum chip8_insn chip8_decode(chip8_t *chip8, uint16_t pc)
+{
+	enum chip8_insn insn = chip8_decode_opcode(chip8_fetch(chip8, pc));
+	enum chip8_insn next = chip8_decode_next(chip8, pc, 1);
+
+	switch (insn)
+	{
+		case INSN_ANNN:
+			if (next == INSN_DXYN)
+				insn = FUSED_ANNN_DXYN;
+			break;
+		case INSN_6XNN:
+			if (next != INSN_6XNN)
+				break;
+			insn = FUSED_6XNN_2;
+			if (chip8_decode_next(chip8, pc, 2) != INSN_6XNN)
+				break;
+			insn = FUSED_6XNN_3;
+			if (chip8_decode_next(chip8, pc, 3) == INSN_6XNN)
+				insn = FUSED_6XNN_4;
+			break;
+		case INSN_3XNN:
+			if (next == INSN_1NNN)
+				insn = FUSED_3XNN_1NNN;
+			break;
+		case INSN_4XNN:
+			if (next == INSN_1NNN)
+				insn = FUSED_4XNN_1NNN;
+			break;
+		case INSN_FX07:
+			// usually a wait loop: FX07 3X00 1NNN
+			if (next == INSN_3XNN)
+				insn = chip8_decode_next(chip8, pc, 2) == INSN_1NNN ?
+					FUSED_FX07_3XNN_1NNN : FUSED_FX07_3XNN;
+			else if (next == INSN_4XNN)
+				insn = chip8_decode_next(chip8, pc, 2) == INSN_1NNN ?
+					FUSED_FX07_4XNN_1NNN : FUSED_FX07_4XNN;
+			break;
+		case INSN_FX33:
+			if (next == INSN_FX65)
+				insn = FUSED_FX33_FX65;
+			break;
+		default:
+			break;
+	}
+
+	chip8->decoded[pc] = (unsigned char)insn;
+	return insn;
+}
+
+/*
+ * The handlers execute the instruction in chip8->opcode and return the number
+ * of instructions executed.
+ */
+typedef unsigned (*chip8_insn_handler_t)(chip8_t *chip8);
+
+/* Execute budget instructions, or less if the chip8 halts */
+typedef void (*chip8_run_t)(chip8_t *chip8, unsigned budget);
+
+/* The instrumented interpreters of src/vm_debug.c, one per quirk profile */
+extern const chip8_run_t chip8_debug_interpreters[CHIP8_PROFILE_COUNT];
+
+#endif /* _VM_DECODE_H_ */
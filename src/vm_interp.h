@@ -0,0 +1,235 @@
+/*
+ * Interpreter specialized for one quirk profile.
+ * Included by src/vm.c once per profile with CHIP8_PROFILE and
+ * CHIP8_NAME(name) defined, see include/vm_ops.h.
+ * src/vm_debug.c includes it with CHIP8_INSTRUMENTED defined too, to build
+ * the reference interpreters, also used when a debugger is attached.
+ */
+
+#include "vm_ops.h"
+
+#define OPCODE(name) CHIP8_NAME(opcode_##name)
+
+#define INSN(name) \
+	static unsigned CHIP8_NAME(insn_##name)(chip8_t *chip8) \
+	{ \
+		OPCODE(name)(chip8); \
+		return 1; \
+	}
+
+INSN(0NNN) INSN(00E0) INSN(00EE) INSN(1NNN) INSN(2NNN) INSN(3XNN)
+INSN(4XNN) INSN(5XY0) INSN(6XNN) INSN(7XNN) INSN(8XY0) INSN(8XY1)
+INSN(8XY2) INSN(8XY3) INSN(8XY4) INSN(8XY5) INSN(8XY6) INSN(8XY7)
+INSN(8XYE) INSN(9XY0) INSN(ANNN) INSN(BNNN) INSN(CXNN) INSN(DXYN)
+INSN(EX9E) INSN(EXA1) INSN(FX07) INSN(FX0A) INSN(FX15) INSN(FX18)
+INSN(FX1E) INSN(FX29) INSN(FX33) INSN(FX55) INSN(FX65)
+
+static unsigned CHIP8_NAME(insn_UNKNOWN)(chip8_t *chip8)
+{
+	chip8_fault(chip8, CHIP8_EVENT_UNKNOWN_OPCODE);
+	return 0;
+}
+
+/* Sets I then draws a sprite: ANNN DXYN */
+static unsigned CHIP8_NAME(fused_ANNN_DXYN)(chip8_t *chip8)
+{
+	OPCODE(ANNN)(chip8);
+	chip8_fetch_next(chip8);
+	OPCODE(DXYN)(chip8);
+	return 2;
+}
+
+/* Sets several registers in a row: 6XNN 6XNN ... */
+static inline unsigned CHIP8_NAME(fused_6XNN)(chip8_t *chip8, unsigned count)
+{
+	OPCODE(6XNN)(chip8);
+	for (unsigned i = 1; i < count; i++)
+	{
+		chip8_fetch_next(chip8);
+		OPCODE(6XNN)(chip8);
+	}
+	return count;
+}
+
+static unsigned CHIP8_NAME(fused_6XNN_2)(chip8_t *chip8)
+{
+	return CHIP8_NAME(fused_6XNN)(chip8, 2);
+}
+
+static unsigned CHIP8_NAME(fused_6XNN_3)(chip8_t *chip8)
+{
+	return CHIP8_NAME(fused_6XNN)(chip8, 3);
+}
+
+static unsigned CHIP8_NAME(fused_6XNN_4)(chip8_t *chip8)
+{
+	return CHIP8_NAME(fused_6XNN)(chip8, 4);
+}
+
+/* Conditional jump: 3XNN 1NNN or 4XNN 1NNN */
+#define FUSED_SKIP_1NNN(skip) \
+	static unsigned CHIP8_NAME(fused_##skip##_1NNN)(chip8_t *chip8) \
+	{ \
+		uint16_t pc = chip8->pc; \
+		OPCODE(skip)(chip8); \
+		if (chip8->pc != pc + 2) \
+			return 1; /* the jump was skipped */ \
+		chip8_fetch_next(chip8); \
+		OPCODE(1NNN)(chip8); \
+		return 2; \
+	}
+
+FUSED_SKIP_1NNN(3XNN)
+FUSED_SKIP_1NNN(4XNN)
+
+/* Test the delay timer: FX07 3XNN or FX07 4XNN, optionally followed by 1NNN */
+#define FUSED_FX07_SKIP(skip) \
+	static unsigned CHIP8_NAME(fused_FX07_##skip)(chip8_t *chip8) \
+	{ \
+		OPCODE(FX07)(chip8); \
+		chip8_fetch_next(chip8); \
+		OPCODE(skip)(chip8); \
+		return 2; \
+	} \
+	static unsigned CHIP8_NAME(fused_FX07_##skip##_1NNN)(chip8_t *chip8) \
+	{ \
+		OPCODE(FX07)(chip8); \
+		chip8_fetch_next(chip8); \
+		return 1 + CHIP8_NAME(fused_##skip##_1NNN)(chip8); \
+	}
+
+FUSED_FX07_SKIP(3XNN)
+FUSED_FX07_SKIP(4XNN)
+
+/* Print a number: FX33 FX65 */
+static unsigned CHIP8_NAME(fused_FX33_FX65)(chip8_t *chip8)
+{
+	uint16_t pc = chip8->pc;
+
+	OPCODE(FX33)(chip8);
+	if (chip8->halted)
+		return 1;
+	if (chip8->decoded[pc] == INSN_NONE)
+		return 1; // FX33 overwrote the FX65, it must be decoded again
+	chip8_fetch_next(chip8);
+	OPCODE(FX65)(chip8);
+	return 2;
+}
+
+static const struct {
+	chip8_insn_handler_t handler;
+	unsigned char length; /* number of instructions, at most */
+} CHIP8_NAME(insns)[] = {
+#define INSN_ENTRY(name) [INSN_##name] = { CHIP8_NAME(insn_##name), 1 }
+	INSN_ENTRY(UNKNOWN),
+	INSN_ENTRY(0NNN), INSN_ENTRY(00E0), INSN_ENTRY(00EE), INSN_ENTRY(1NNN),
+	INSN_ENTRY(2NNN), INSN_ENTRY(3XNN), INSN_ENTRY(4XNN), INSN_ENTRY(5XY0),
+	INSN_ENTRY(6XNN), INSN_ENTRY(7XNN), INSN_ENTRY(8XY0), INSN_ENTRY(8XY1),
+	INSN_ENTRY(8XY2), INSN_ENTRY(8XY3), INSN_ENTRY(8XY4), INSN_ENTRY(8XY5),
+	INSN_ENTRY(8XY6), INSN_ENTRY(8XY7), INSN_ENTRY(8XYE), INSN_ENTRY(9XY0),
+	INSN_ENTRY(ANNN), INSN_ENTRY(BNNN), INSN_ENTRY(CXNN), INSN_ENTRY(DXYN),
+	INSN_ENTRY(EX9E), INSN_ENTRY(EXA1), INSN_ENTRY(FX07), INSN_ENTRY(FX0A),
+	INSN_ENTRY(FX15), INSN_ENTRY(FX18), INSN_ENTRY(FX1E), INSN_ENTRY(FX29),
+	INSN_ENTRY(FX33), INSN_ENTRY(FX55), INSN_ENTRY(FX65),
+#undef INSN_ENTRY
+	[FUSED_ANNN_DXYN]      = { CHIP8_NAME(fused_ANNN_DXYN), 2 },
+	[FUSED_6XNN_2]         = { CHIP8_NAME(fused_6XNN_2), 2 },
+	[FUSED_6XNN_3]         = { CHIP8_NAME(fused_6XNN_3), 3 },
+	[FUSED_6XNN_4]         = { CHIP8_NAME(fused_6XNN_4), 4 },
+	[FUSED_3XNN_1NNN]      = { CHIP8_NAME(fused_3XNN_1NNN), 2 },
+	[FUSED_4XNN_1NNN]      = { CHIP8_NAME(fused_4XNN_1NNN), 2 },
+	[FUSED_FX07_3XNN]      = { CHIP8_NAME(fused_FX07_3XNN), 2 },
+	[FUSED_FX07_4XNN]      = { CHIP8_NAME(fused_FX07_4XNN), 2 },
+	[FUSED_FX07_3XNN_1NNN] = { CHIP8_NAME(fused_FX07_3XNN_1NNN), 3 },
+	[FUSED_FX07_4XNN_1NNN] = { CHIP8_NAME(fused_FX07_4XNN_1NNN), 3 },
+	[FUSED_FX33_FX65]      = { CHIP8_NAME(fused_FX33_FX65), 2 },
+};
+
+#ifndef CHIP8_INSTRUMENTED
+/*
+ * Execute the instruction at pc, fused with the following ones if it does not
+ * exceed budget instructions.
+ * Return the number of instructions executed.
+ */
+static inline unsigned CHIP8_NAME(dispatch)(chip8_t *chip8, unsigned budget)
+{
+	uint16_t pc = chip8->pc;
+	enum chip8_insn insn;
+	unsigned count;
+
+	// the last instruction is at 0xFFE, do not read past the decoding cache
+	if (pc >= CHIP8_MEMORY_SIZE - 1)
+	{
+		chip8_fault(chip8, CHIP8_EVENT_PC_OVERFLOW);
+		return 0;
+	}
+
+	insn = chip8->decoded[pc];
+	if (insn == INSN_NONE)
+		insn = chip8_decode(chip8, pc);
+	chip8->opcode = chip8_fetch(chip8, pc);
+	if (CHIP8_NAME(insns)[insn].length > budget)
+		insn = chip8_decode_opcode(chip8->opcode);
+
+	count = CHIP8_NAME(insns)[insn].handler(chip8);
+
+	// the fused instructions never touch the timers, update them at the end
+	for (unsigned i = 0; i < count; i++)
+		chip8_timers_tick(chip8);
+	return count;
+}
+
+/* Execute budget instructions, or less if the chip8 halts */
+static void CHIP8_NAME(run)(chip8_t *chip8, unsigned budget)
+{
+	while (budget > 0 && !chip8->halted)
+		budget -= CHIP8_NAME(dispatch)(chip8, budget);
+}
+
+#else
+/*
+ * Instrumented interpreter: no decoding cache and no superinstructions, every
+ * instruction is executed on its own between the hooks of the debugger and
+ * of the trace.
+ * Execute budget instructions, or less if the chip8 halts or the debugger
+ * stops it.
+ */
+static void CHIP8_NAME(run)(chip8_t *chip8, unsigned budget)
+{
+	chip8_debug_t *debug = chip8->debug;
+	trace_t *trace = chip8->trace;
+
+	for (; budget > 0 && !chip8->halted; budget--)
+	{
+		uint16_t pc = chip8->pc;
+		unsigned char V[16];
+
+		// before the debugger, which indexes its breakpoints with pc
+		if (pc >= CHIP8_MEMORY_SIZE - 1)
+		{
+			chip8_fault(chip8, CHIP8_EVENT_PC_OVERFLOW);
+			break;
+		}
+		if (debug != NULL && chip8_debug_before(chip8))
+			break;
+		if (trace != NULL)
+			memcpy(V, chip8->V, sizeof(V));
+
+		chip8->opcode = chip8_fetch(chip8, pc);
+		// like in the fast interpreter, an instruction which is not executed
+		// (an unknown opcode) does not update the timers
+		if (CHIP8_NAME(insns)[chip8_decode_opcode(chip8->opcode)].handler(chip8) > 0)
+			chip8_timers_tick(chip8);
+
+		if (trace != NULL)
+			trace_record(trace, chip8, pc, V);
+		if (debug != NULL && chip8_debug_after(chip8))
+			break;
+	}
+}
+#endif /* CHIP8_INSTRUMENTED */
+
+#undef OPCODE
+#undef INSN
+#undef FUSED_SKIP_1NNN
+#undef FUSED_FX07_SKIP
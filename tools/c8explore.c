@@ -0,0 +1,465 @@
+/*
+ * Explore the key inputs of a ROM on all the cores, looking for the inputs
+ * crashing it (stack overflow, access past the end of the memory, unknown
+ * opcode, ...).
+ * Every state is run for a few frames once with no key held and once with
+ * each key held. The resulting states already seen (same chip8_state_hash)
+ * are dropped, the others are queued. The states which covered new
+ * instructions are explored first, then the shallowest ones.
+ * The inputs reaching each crash can be saved as scripts for the NULL
+ * backend (see include/input_script.h), to replay them with
+ *   make headless && CHIP8_INPUT=crash-0.txt ./bin/main -t rom
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "vm.h"
+#include "stateset.h"
+
+#define DEFAULT_STEP 4 /* frames between two key changes */
+#define DEFAULT_DEPTH 1000 /* key changes, at most */
+#define DEFAULT_SECONDS 10
+#define DEFAULT_SET_BITS 22
+#define DEFAULT_QUEUE 4096 /* ~7KB per queued state, the memory is shared */
+#define MAX_CRASHES 256
+#define NO_KEY 16 /* the branch where no key is held */
+#define BRANCHES 17
+
+/* A state waiting to be explored */
+typedef struct node_s {
+	chip8_t *state;
+	unsigned new_pcs; /* instructions first executed on the way to it */
+	unsigned depth; /* number of steps from the start */
+	unsigned char *path; /* key held during each step, or NO_KEY */
+} node_t;
+
+/* A distinct crash, the same event at the same address is reported once */
+typedef struct crash_s {
+	uint16_t type;
+	uint16_t pc;
+	uint16_t opcode;
+	unsigned long frame;
+} crash_t;
+
+/* Max-heap of the nodes, the best one is explored first */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	node_t **nodes;
+	size_t count;
+	size_t size;
+	unsigned active; /* threads exploring a node, they may queue more */
+	unsigned long dropped; /* nodes not queued because the queue was full */
+} queue = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static stateset_t seen;
+static unsigned char coverage[0x1000]; /* set for each executed address */
+static unsigned long explored; /* steps run */
+static int stop;
+
+static pthread_mutex_t crashes_lock = PTHREAD_MUTEX_INITIALIZER;
+static crash_t crashes[MAX_CRASHES];
+static unsigned ncrashes;
+
+static unsigned step_frames = DEFAULT_STEP;
+static unsigned max_depth = DEFAULT_DEPTH;
+static const char *output_dir = NULL;
+
+/* The node to explore first: the one which found more code, then the shallowest */
+static int node_before(const node_t *a, const node_t *b)
+{
+	if (a->new_pcs != b->new_pcs)
+		return a->new_pcs > b->new_pcs;
+	return a->depth < b->depth;
+}
+
+/* Queue a node, return -1 if the queue is full */
+static int queue_push(node_t *node)
+{
+	size_t i;
+
+	pthread_mutex_lock(&queue.lock);
+	if (queue.count == queue.size)
+	{
+		queue.dropped++;
+		pthread_mutex_unlock(&queue.lock);
+		return -1;
+	}
+	for (i = queue.count++; i > 0 && node_before(node, queue.nodes[(i - 1) / 2]); i = (i - 1) / 2)
+		queue.nodes[i] = queue.nodes[(i - 1) / 2];
+	queue.nodes[i] = node;
+	pthread_cond_signal(&queue.cond);
+	pthread_mutex_unlock(&queue.lock);
+	return 0;
+}
+
+/*
+ * Take the best node, wait if the other threads may still queue some
+ * Return NULL once everything was explored or the exploration is stopped.
+ */
+static node_t *queue_pop(void)
+{
+	node_t *node = NULL;
+
+	pthread_mutex_lock(&queue.lock);
+	while (queue.count == 0 && queue.active > 0 && !__atomic_load_n(&stop, __ATOMIC_RELAXED))
+		pthread_cond_wait(&queue.cond, &queue.lock);
+
+	if (queue.count > 0 && !__atomic_load_n(&stop, __ATOMIC_RELAXED))
+	{
+		node_t *last = queue.nodes[--queue.count];
+		size_t i = 0;
+
+		node = queue.nodes[0];
+		while (2 * i + 1 < queue.count)
+		{
+			size_t child = 2 * i + 1;
+
+			if (child + 1 < queue.count && node_before(queue.nodes[child + 1], queue.nodes[child]))
+				child++;
+			if (!node_before(queue.nodes[child], last))
+				break;
+			queue.nodes[i] = queue.nodes[child];
+			i = child;
+		}
+		queue.nodes[i] = last;
+		queue.active++;
+	}
+	else
+		pthread_cond_broadcast(&queue.cond); // wake up the others, they are done too
+	pthread_mutex_unlock(&queue.lock);
+	return node;
+}
+
+/* The node taken by queue_pop is explored */
+static void queue_done(void)
+{
+	pthread_mutex_lock(&queue.lock);
+	queue.active--;
+	if (queue.active == 0 && queue.count == 0)
+		pthread_cond_broadcast(&queue.cond);
+	pthread_mutex_unlock(&queue.lock);
+}
+
+static void node_free(node_t *node)
+{
+	chip8_free(node->state);
+	free(node->path);
+	free(node);
+}
+
+/* Write the keys leading to a crash in the format of include/input_script.h */
+static void write_script(unsigned index, const unsigned char *path, unsigned depth, unsigned long frames)
+{
+	char name[4096];
+	FILE *file;
+	unsigned held = NO_KEY;
+
+	snprintf(name, sizeof(name), "%s/crash-%u.txt", output_dir, index);
+	file = fopen(name, "w");
+	if (file == NULL)
+	{
+		perror(name);
+		return;
+	}
+	for (unsigned i = 0; i < depth; i++)
+	{
+		unsigned long frame = (unsigned long)i * step_frames;
+
+		if (path[i] == held)
+			continue;
+		if (held != NO_KEY)
+			fprintf(file, "%lu release %X\n", frame, held);
+		if (path[i] != NO_KEY)
+			fprintf(file, "%lu press %X\n", frame, path[i]);
+		held = path[i];
+	}
+	fprintf(file, "%lu quit\n", frames + 1);
+	fclose(file);
+}
+
+static void report_crash(const chip8_event_t *event, const unsigned char *path, unsigned depth)
+{
+	unsigned long frames = (unsigned long)depth * step_frames;
+	unsigned index;
+
+	pthread_mutex_lock(&crashes_lock);
+	for (index = 0; index < ncrashes; index++)
+		if (crashes[index].type == event->type && crashes[index].pc == event->pc)
+			break;
+	if (index < ncrashes || ncrashes == MAX_CRASHES)
+	{
+		pthread_mutex_unlock(&crashes_lock);
+		return;
+	}
+	crashes[index] = (crash_t){ event->type, event->pc, event->opcode, frames };
+	ncrashes++;
+
+	printf("%s at 0x%03X (opcode 0x%04X) within %lu frames\n",
+			chip8_event_name(event->type), event->pc, event->opcode, frames);
+	if (output_dir != NULL)
+		write_script(index, path, depth, frames);
+	pthread_mutex_unlock(&crashes_lock);
+}
+
+/*
+ * Run a step with one key held, record the coverage and the crashes
+ * Return the number of instructions executed for the first time.
+ */
+static unsigned run_step(chip8_t *chip8, unsigned char *seen_pcs, const unsigned char *path,
+		unsigned depth)
+{
+	unsigned new_pcs = 0;
+	chip8_event_t event;
+
+	for (unsigned n = step_frames * CHIP8_CYCLES_PER_FRAME; n > 0 && !chip8->halted; n--)
+	{
+		uint16_t pc = chip8->pc;
+
+		// check the coverage shared by all the threads only once per thread
+		if (pc < sizeof(coverage) && !seen_pcs[pc])
+		{
+			seen_pcs[pc] = 1;
+			if (!__atomic_exchange_n(&coverage[pc], 1, __ATOMIC_RELAXED))
+				new_pcs++;
+		}
+		chip8_emulate_cycle(chip8);
+	}
+
+	while (chip8_poll_event(chip8, &event) == 0)
+		if (event.type != CHIP8_EVENT_SOUND_START && event.type != CHIP8_EVENT_SOUND_STOP
+				&& event.type != CHIP8_EVENT_HALTED)
+			report_crash(&event, path, depth);
+	return new_pcs;
+}
+
+static void *explore(void *arg)
+{
+	chip8_t *chip8 = chip8_init();
+	unsigned char *seen_pcs = calloc(sizeof(coverage), 1);
+	node_t *node;
+
+	(void)arg;
+	if (chip8 == NULL || seen_pcs == NULL)
+	{
+		fprintf(stderr, "Out of memory\n");
+		exit(2);
+	}
+
+	while ((node = queue_pop()) != NULL)
+	{
+		unsigned char *path = malloc(node->depth + 1);
+
+		if (path == NULL)
+		{
+			fprintf(stderr, "Out of memory\n");
+			exit(2);
+		}
+		if (node->depth > 0)
+			memcpy(path, node->path, node->depth);
+
+		for (unsigned key = 0; key < BRANCHES && !__atomic_load_n(&stop, __ATOMIC_RELAXED); key++)
+		{
+			node_t *child;
+			unsigned new_pcs;
+
+			chip8_copy(chip8, node->state);
+			memset(chip8->key, 0, sizeof(chip8->key));
+			if (key != NO_KEY)
+				chip8->key[key] = 1;
+			path[node->depth] = (unsigned char)key;
+
+			new_pcs = run_step(chip8, seen_pcs, path, node->depth + 1);
+			__atomic_add_fetch(&explored, 1, __ATOMIC_RELAXED);
+			if (chip8->halted || node->depth + 1 >= max_depth
+					|| stateset_insert(&seen, chip8_state_hash(chip8)) != 1)
+				continue;
+
+			child = malloc(sizeof(*child));
+			if (child == NULL || (child->path = malloc(node->depth + 1)) == NULL
+					|| (child->state = chip8_clone(chip8)) == NULL)
+			{
+				fprintf(stderr, "Out of memory\n");
+				exit(2);
+			}
+			child->new_pcs = new_pcs;
+			child->depth = node->depth + 1;
+			memcpy(child->path, path, child->depth);
+			if (queue_push(child) < 0)
+				node_free(child);
+		}
+		free(path);
+		node_free(node);
+		queue_done();
+	}
+
+	free(seen_pcs);
+	chip8_free(chip8);
+	return NULL;
+}
+
+/* Print the covered ranges of addresses */
+static void print_coverage(void)
+{
+	unsigned covered = 0;
+
+	printf("covered:");
+	for (unsigned a = 0; a < sizeof(coverage); a++)
+	{
+		unsigned start = a;
+
+		if (!coverage[a])
+			continue;
+		while (a + 1 < sizeof(coverage) && (coverage[a + 1] || (a + 2 < sizeof(coverage) && coverage[a + 2])))
+			a++;
+		for (unsigned i = start; i <= a; i++)
+			covered += coverage[i];
+		printf(" %03X-%03X", start, a);
+	}
+	printf("\n%u instructions executed\n", covered);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-j threads] [-f frames] [-d depth] [-t seconds] [-m bits] [-Q size] [-q profile] [-o dir] rom\n", name);
+	fprintf(stderr, "\t-j: number of threads (default one per core)\n");
+	fprintf(stderr, "\t-f: frames between two key changes (default %d)\n", DEFAULT_STEP);
+	fprintf(stderr, "\t-d: maximal number of key changes (default %d)\n", DEFAULT_DEPTH);
+	fprintf(stderr, "\t-t: stop after this time (default %d s)\n", DEFAULT_SECONDS);
+	fprintf(stderr, "\t-m: remember 3/4 of 2^bits states (default %d)\n", DEFAULT_SET_BITS);
+	fprintf(stderr, "\t-Q: number of states waiting to be explored (default %d)\n", DEFAULT_QUEUE);
+	fprintf(stderr, "\t-q: quirk profile\n");
+	fprintf(stderr, "\t-o: write the keys leading to each crash in dir/crash-N.txt\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned long seconds = DEFAULT_SECONDS;
+	unsigned set_bits = DEFAULT_SET_BITS;
+	int profile = CHIP8_PROFILE_DEFAULT;
+	pthread_t *workers;
+	node_t *root;
+	FILE *rom;
+	struct timespec start, now;
+	int opt;
+
+	queue.size = DEFAULT_QUEUE;
+	while ((opt = getopt(argc, argv, "j:f:d:t:m:Q:q:o:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'j':
+				threads = strtol(optarg, NULL, 0);
+				break;
+			case 'f':
+				step_frames = (unsigned)strtoul(optarg, NULL, 0);
+				break;
+			case 'd':
+				max_depth = (unsigned)strtoul(optarg, NULL, 0);
+				break;
+			case 't':
+				seconds = strtoul(optarg, NULL, 0);
+				break;
+			case 'm':
+				set_bits = (unsigned)strtoul(optarg, NULL, 0);
+				break;
+			case 'Q':
+				queue.size = strtoul(optarg, NULL, 0);
+				break;
+			case 'q':
+				profile = chip8_profile_by_name(optarg);
+				if (profile < 0)
+					usage(argv[0]);
+				break;
+			case 'o':
+				output_dir = optarg;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind + 1 != argc || threads < 1 || step_frames == 0 || queue.size == 0)
+		usage(argv[0]);
+
+	if (stateset_init(&seen, set_bits) < 0)
+	{
+		fprintf(stderr, "Invalid number of states\n");
+		return 2;
+	}
+	queue.nodes = malloc(queue.size * sizeof(*queue.nodes));
+	workers = malloc((size_t)threads * sizeof(*workers));
+	root = calloc(1, sizeof(*root));
+	if (queue.nodes == NULL || workers == NULL || root == NULL)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 2;
+	}
+
+	// the first state, as main/main.c starts the game
+	{
+		chip8_t *chip8 = chip8_init();
+
+		rom = fopen(argv[optind], "rb");
+		if (chip8 == NULL || rom == NULL || chip8_load_game(chip8, rom) < 0)
+		{
+			perror("Failed to load the ROM: ");
+			return 2;
+		}
+		fclose(rom);
+		chip8_set_profile(chip8, profile);
+		root->state = chip8;
+		stateset_insert(&seen, chip8_state_hash(root->state));
+		queue_push(root);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < threads; i++)
+		if (pthread_create(&workers[i], NULL, explore, NULL) != 0)
+		{
+			perror("Failed to start a thread: ");
+			return 2;
+		}
+
+	// report the progress every second, until the end or the time limit
+	while (1)
+	{
+		int done;
+
+		sleep(1);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		pthread_mutex_lock(&queue.lock);
+		done = queue.count == 0 && queue.active == 0;
+		fprintf(stderr, "%lus: %lu steps, %zu states, %zu queued, %lu dropped\n",
+				(unsigned long)(now.tv_sec - start.tv_sec), __atomic_load_n(&explored, __ATOMIC_RELAXED),
+				stateset_count(&seen), queue.count, queue.dropped);
+		pthread_mutex_unlock(&queue.lock);
+		if (done || (unsigned long)(now.tv_sec - start.tv_sec) >= seconds)
+			break;
+	}
+
+	pthread_mutex_lock(&queue.lock);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+	pthread_cond_broadcast(&queue.cond);
+	pthread_mutex_unlock(&queue.lock);
+	for (long i = 0; i < threads; i++)
+		pthread_join(workers[i], NULL);
+
+	print_coverage();
+	printf("%u crashes, %lu steps, %zu distinct states\n", ncrashes, explored, stateset_count(&seen));
+
+	while (queue.count > 0)
+		node_free(queue.nodes[--queue.count]);
+	free(queue.nodes);
+	free(workers);
+	stateset_destroy(&seen);
+	return ncrashes != 0;
+}
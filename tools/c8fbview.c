@@ -0,0 +1,138 @@
+/*
+ * Reader of the frames published by main -F (see include/framebuf.h): draws
+ * them in the terminal, or records them with -r like main -r.
+ * The frames are used in place in the shared memory, the ones overwritten
+ * while they were used are counted as torn and skipped.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "framebuf.h"
+#include "capture.h"
+#include "pacer.h"
+#include "vm.h"
+
+/* check that the writer is still alive this often */
+#define WAIT_MS 500
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-q] [-n frames] [-r file] name\n", name);
+	fprintf(stderr, "\tname: the one given to main -F\n");
+	fprintf(stderr, "\t-q: do not draw the frames\n");
+	fprintf(stderr, "\t-n: stop after this number of frames\n");
+	fprintf(stderr, "\t-r: record the frames in file (see tools/c8replay)\n");
+	exit(1);
+}
+
+static void draw(const framebuf_page_t *page, const framebuf_frame_t *frame)
+{
+	printf("\033[H");
+	for (int y = 0; y < page->height; y++)
+	{
+		for (int x = 0; x < page->width; x++)
+			putchar(frame->pixels[x + y * page->width] ? 'X' : ' ');
+		putchar('\n');
+	}
+	printf("frame %llu, %.1f ms ago\033[K\n", (unsigned long long)frame->frame,
+			(double)(pacer_now() - frame->time) / 1e6);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	framebuf_page_t *page;
+	framebuf_frame_t frame = { 0 };
+	capture_t *capture = NULL;
+	const char *record = NULL;
+	unsigned long count = 0; // 0 -> until the writer leaves
+	unsigned long received = 0, missed = 0, torn = 0;
+	int quiet = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "qn:r:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'q':
+				quiet = 1;
+				break;
+			case 'n':
+				count = strtoul(optarg, NULL, 0);
+				break;
+			case 'r':
+				record = optarg;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind + 1 != argc)
+		usage(argv[0]);
+
+	page = framebuf_attach(argv[optind]);
+	if (page == NULL)
+	{
+		fprintf(stderr, "No frames published as %s\n", argv[optind]);
+		return 1;
+	}
+	if (record != NULL)
+	{
+		capture = capture_open(record, page->width, page->height, CHIP8_FRAME_RATE);
+		if (capture == NULL)
+		{
+			perror("Failed to record: ");
+			return 1;
+		}
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	if (!quiet)
+		printf("\033[2J");
+
+	while (!stop && (count == 0 || received < count))
+	{
+		uint32_t last = frame.seq;
+
+		if (framebuf_wait(page, last, WAIT_MS) < 0)
+		{
+			if (kill((pid_t)page->pid, 0) < 0 && errno == ESRCH)
+				break;
+			continue;
+		}
+		if (framebuf_acquire(page, &frame) < 0)
+		{
+			torn++;
+			continue;
+		}
+		if (last != 0)
+			missed += frame.seq - last - 1;
+
+		if (capture != NULL)
+			capture_frame(capture, frame.pixels);
+		if (!quiet)
+			draw(page, &frame);
+		// the writer went two frames ahead during the use of this one
+		if (!framebuf_valid(page, &frame))
+			torn++;
+		received++;
+	}
+
+	fprintf(stderr, "%lu frames, %lu missed, %lu torn\n", received, missed, torn);
+	if (capture != NULL && capture_close(capture) < 0)
+		perror("Failed to write the recording: ");
+	framebuf_detach(page);
+	return 0;
+}
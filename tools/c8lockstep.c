@@ -0,0 +1,468 @@
+/*
+ * Run a candidate execution engine in lockstep with the reference engine
+ * (see CHIP8_ENGINE_XXX in include/vm.h) and report the first cycle where
+ * they diverge.
+ * The states are compared with chip8_state_hash after each frame, with the
+ * events raised. On a divergence the frame is replayed from a snapshot one
+ * cycle more at a time to find the first diverging cycle, then the states
+ * are compared field by field.
+ * The incremental hashes of the memory and of the screen are checked against
+ * a full hash at the end of each run.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vm.h"
+#include "disasm.h"
+#include "input_script.h"
+#include "rompack.h"
+
+#define DEFAULT_FRAMES 600
+#define DEFAULT_RANDOM_ROMS 200
+#define MAX_DIFFS 8 /* memory and screen differences printed */
+/* without a script the keys change every KEY_PERIOD frames */
+#define KEY_PERIOD 15
+
+/* One of the two chip8 running in lockstep */
+typedef struct side_s {
+	chip8_t *chip8;
+	chip8_t *snapshot; /* at the beginning of the current frame */
+	chip8_event_t events[CHIP8_EVENT_QUEUE]; /* raised since the snapshot */
+	unsigned nevents;
+} side_t;
+
+static side_t reference, candidate;
+static int candidate_engine = CHIP8_ENGINE_FAST;
+static unsigned long frames = DEFAULT_FRAMES;
+static const char *script_path = NULL;
+
+static const char *const profile_names[CHIP8_PROFILE_COUNT] = CHIP8_PROFILE_NAMES;
+static const char *const engine_names[CHIP8_ENGINE_COUNT] = CHIP8_ENGINE_NAMES;
+
+static uint32_t xorshift(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/*
+ * Opcodes of the random ROMs: the bits of random are replaced by random
+ * values, and the jump targets stay in the ROM most of the time.
+ */
+static const struct {
+	uint16_t opcode;
+	uint16_t random;
+	int jump; /* NNN is an address */
+} templates[] = {
+	{ 0x00E0, 0x0000, 0 }, { 0x00EE, 0x0000, 0 }, { 0x1000, 0x0FFF, 1 },
+	{ 0x2000, 0x0FFF, 1 }, { 0x3000, 0x0FFF, 0 }, { 0x4000, 0x0FFF, 0 },
+	{ 0x5000, 0x0FF0, 0 }, { 0x6000, 0x0FFF, 0 }, { 0x7000, 0x0FFF, 0 },
+	{ 0x8000, 0x0FF0, 0 }, { 0x8001, 0x0FF0, 0 }, { 0x8002, 0x0FF0, 0 },
+	{ 0x8003, 0x0FF0, 0 }, { 0x8004, 0x0FF0, 0 }, { 0x8005, 0x0FF0, 0 },
+	{ 0x8006, 0x0FF0, 0 }, { 0x8007, 0x0FF0, 0 }, { 0x800E, 0x0FF0, 0 },
+	{ 0x9000, 0x0FF0, 0 }, { 0xA000, 0x0FFF, 1 }, { 0xB000, 0x0FFF, 1 },
+	{ 0xC000, 0x0FFF, 0 }, { 0xD000, 0x0FFF, 0 }, { 0xE09E, 0x0F00, 0 },
+	{ 0xE0A1, 0x0F00, 0 }, { 0xF007, 0x0F00, 0 }, { 0xF00A, 0x0F00, 0 },
+	{ 0xF015, 0x0F00, 0 }, { 0xF018, 0x0F00, 0 }, { 0xF01E, 0x0F00, 0 },
+	{ 0xF029, 0x0F00, 0 }, { 0xF033, 0x0F00, 0 }, { 0xF055, 0x0F00, 0 },
+	{ 0xF065, 0x0F00, 0 },
+};
+
+/* Generate a random stream of opcodes, return its size */
+static size_t random_rom(uint32_t seed, unsigned char *rom)
+{
+	uint32_t state = seed != 0 ? seed : 1;
+	size_t size = 2 * (128 + xorshift(&state) % 384);
+
+	for (size_t i = 0; i < size; i += 2)
+	{
+		uint32_t r = xorshift(&state);
+		size_t t = (r >> 8) % (sizeof(templates) / sizeof(templates[0]));
+		uint16_t opcode = (uint16_t)(templates[t].opcode | (xorshift(&state) & templates[t].random));
+
+		if ((r & 0x1F) == 0)
+			opcode = (uint16_t)xorshift(&state); // anything, unknown opcodes included
+		else if (templates[t].jump && (r & 0xE0) != 0)
+			opcode = (uint16_t)((opcode & 0xF000) | (0x200 + xorshift(&state) % size));
+		rom[i] = (unsigned char)(opcode >> 8);
+		rom[i + 1] = (unsigned char)opcode;
+	}
+	return size;
+}
+
+static int side_init(side_t *side, int engine, int profile, const unsigned char *rom, size_t size)
+{
+	chip8_free(side->chip8);
+	side->chip8 = chip8_init();
+	if (side->snapshot == NULL)
+		side->snapshot = chip8_init();
+	if (side->chip8 == NULL || side->snapshot == NULL)
+		return -1;
+	chip8_set_engine(side->chip8, engine);
+	chip8_set_profile(side->chip8, profile);
+	return chip8_load_rom(side->chip8, rom, size);
+}
+
+static void side_save(side_t *side)
+{
+	chip8_copy(side->snapshot, side->chip8);
+	side->nevents = 0;
+}
+
+/* Go back to the beginning of the frame */
+static void side_restore(side_t *side)
+{
+	chip8_copy(side->chip8, side->snapshot);
+	side->nevents = 0;
+}
+
+static void side_run(side_t *side, unsigned cycles)
+{
+	chip8_emulate_cycles(side->chip8, cycles);
+	while (side->nevents < CHIP8_EVENT_QUEUE
+			&& chip8_poll_event(side->chip8, &side->events[side->nevents]) == 0)
+		side->nevents++;
+}
+
+static int sides_differ(void)
+{
+	return chip8_state_hash(reference.chip8) != chip8_state_hash(candidate.chip8)
+		|| reference.nevents != candidate.nevents
+		|| memcmp(reference.events, candidate.events,
+				reference.nevents * sizeof(chip8_event_t)) != 0;
+}
+
+#define DIFF(name, a, b) \
+	do { \
+		if ((a) != (b)) \
+			printf("  %-14s reference 0x%X, candidate 0x%X\n", name, \
+					(unsigned)(a), (unsigned)(b)); \
+	} while (0)
+
+static void diff_bytes(const char *name, const unsigned char *a, const unsigned char *b, size_t size)
+{
+	unsigned count = 0;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		if (a[i] == b[i])
+			continue;
+		if (count++ < MAX_DIFFS)
+			printf("  %s[0x%03zX]%*s reference 0x%02X, candidate 0x%02X\n",
+					name, i, (int)(8 - strlen(name)), "", a[i], b[i]);
+	}
+	if (count > MAX_DIFFS)
+		printf("  ... %u bytes of %s differ\n", count, name);
+}
+
+static void diff_events(void)
+{
+	unsigned n = reference.nevents > candidate.nevents ? reference.nevents : candidate.nevents;
+
+	for (unsigned i = 0; i < n; i++)
+	{
+		const chip8_event_t *a = i < reference.nevents ? &reference.events[i] : NULL;
+		const chip8_event_t *b = i < candidate.nevents ? &candidate.events[i] : NULL;
+
+		if (a != NULL && b != NULL && memcmp(a, b, sizeof(*a)) == 0)
+			continue;
+		printf("  event %-8u reference %s, candidate %s\n", i,
+				a != NULL ? chip8_event_name(a->type) : "none",
+				b != NULL ? chip8_event_name(b->type) : "none");
+	}
+}
+
+/* Print everything which differs between the two chip8 */
+static void diff_states(const chip8_t *a, const chip8_t *b)
+{
+	static unsigned char memory_a[CHIP8_MEMORY_SIZE], memory_b[CHIP8_MEMORY_SIZE];
+	char name[16];
+
+	for (unsigned addr = 0; addr < CHIP8_MEMORY_SIZE; addr++)
+	{
+		memory_a[addr] = chip8_read(a, addr);
+		memory_b[addr] = chip8_read(b, addr);
+	}
+
+	DIFF("pc", a->pc, b->pc);
+	DIFF("I", a->I, b->I);
+	for (unsigned x = 0; x < 16; x++)
+	{
+		snprintf(name, sizeof(name), "V%X", x);
+		DIFF(name, a->V[x], b->V[x]);
+	}
+	DIFF("sp", a->sp, b->sp);
+	for (unsigned i = 0; i < 16; i++)
+	{
+		snprintf(name, sizeof(name), "stack[%u]", i);
+		DIFF(name, a->stack[i], b->stack[i]);
+	}
+	DIFF("delay_timer", a->delay_timer, b->delay_timer);
+	DIFF("sound_timer", a->sound_timer, b->sound_timer);
+	DIFF("halted", a->halted, b->halted);
+	DIFF("random", a->random, b->random);
+	diff_bytes("memory", memory_a, memory_b, sizeof(memory_a));
+	diff_bytes("gfx", a->gfx, b->gfx, sizeof(a->gfx));
+	diff_events();
+}
+
+/* The frame diverged, find the first diverging cycle and report it */
+static void report(unsigned long frame)
+{
+	unsigned cycle = 1;
+	uint16_t pc, opcode;
+	char text[32];
+
+	for (; cycle < CHIP8_CYCLES_PER_FRAME; cycle++)
+	{
+		side_restore(&reference);
+		side_restore(&candidate);
+		side_run(&reference, cycle);
+		side_run(&candidate, cycle);
+		if (sides_differ())
+			break;
+	}
+
+	// the instruction executed by the reference at the diverging cycle
+	side_restore(&reference);
+	side_run(&reference, cycle - 1);
+	pc = reference.chip8->pc;
+	opcode = (uint16_t)(chip8_read(reference.chip8, pc & 0xFFFu) << 8
+			| chip8_read(reference.chip8, (pc + 1u) & 0xFFF));
+	chip8_disassemble(opcode, text, sizeof(text));
+
+	side_restore(&reference);
+	side_restore(&candidate);
+	side_run(&reference, cycle);
+	side_run(&candidate, cycle);
+
+	printf("  first divergence at cycle %lu (frame %lu), after %03X %04X %s\n",
+			frame * CHIP8_CYCLES_PER_FRAME + cycle - 1, frame, pc, opcode, text);
+	diff_states(reference.chip8, candidate.chip8);
+}
+
+/*
+ * Run a ROM with both engines
+ * Return 1 if they diverged, 0 if they did not, -1 on error
+ */
+static int lockstep(const char *name, const unsigned char *rom, size_t size, int profile, uint32_t seed)
+{
+	input_script_t script;
+	uint32_t keys_state = seed != 0 ? seed : 1;
+	unsigned char keys[16] = { 0 };
+	int ret = 0;
+
+	if (side_init(&reference, CHIP8_ENGINE_REFERENCE, profile, rom, size) < 0
+			|| side_init(&candidate, candidate_engine, profile, rom, size) < 0)
+	{
+		fprintf(stderr, "%s: failed to load the ROM\n", name);
+		return -1;
+	}
+	if (script_path != NULL && input_script_open(&script, script_path) < 0)
+	{
+		perror("Failed to open the input script: ");
+		return -1;
+	}
+
+	for (unsigned long frame = 0; frame < frames; frame++)
+	{
+		if (script_path != NULL)
+		{
+			int events = input_script_step(&script, frame, keys);
+
+			if (events < 0)
+			{
+				fprintf(stderr, "%s:%lu: invalid input\n", script_path, script.line);
+				ret = -1;
+				break;
+			}
+			if (events & WINDOW_EVENT_QUIT)
+				break;
+		}
+		else if (frame % KEY_PERIOD == 0)
+		{
+			uint32_t r = xorshift(&keys_state);
+
+			for (unsigned k = 0; k < 16; k++)
+				keys[k] = (r >> k & 1) && (r >> (16 + k % 8) & 1); // 1 key in 4
+		}
+		memcpy(reference.chip8->key, keys, sizeof(keys));
+		memcpy(candidate.chip8->key, keys, sizeof(keys));
+
+		side_save(&reference);
+		side_save(&candidate);
+		side_run(&reference, CHIP8_CYCLES_PER_FRAME);
+		side_run(&candidate, CHIP8_CYCLES_PER_FRAME);
+		if (sides_differ())
+		{
+			printf("%s (%s): %s diverges from reference\n", name,
+					profile_names[profile], engine_names[candidate_engine]);
+			report(frame);
+			ret = 1;
+			break;
+		}
+		if (reference.chip8->halted)
+			break;
+	}
+
+	// a wrong update of the incremental hash is never undone, check it once
+	if (ret == 0 && (chip8_state_hash(reference.chip8) != chip8_state_hash_full(reference.chip8)
+				|| chip8_state_hash(candidate.chip8) != chip8_state_hash_full(candidate.chip8)))
+	{
+		printf("%s (%s): the incremental state hash is wrong\n", name, profile_names[profile]);
+		ret = 1;
+	}
+
+	if (script_path != NULL)
+		input_script_close(&script);
+	return ret;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-e engine] [-f frames] [-i script] [-q profile] [-r count] [-s seed] [-p pack] [rom]...\n", name);
+	fprintf(stderr, "\t-e: the engine compared with the reference one (default fast)\n");
+	fprintf(stderr, "\t-f: number of frames emulated per ROM (default %d)\n", DEFAULT_FRAMES);
+	fprintf(stderr, "\t-i: the keys pressed, see include/input_script.h (default random)\n");
+	fprintf(stderr, "\t-q: only this quirk profile (default all)\n");
+	fprintf(stderr, "\t-r: number of random ROMs (default %d without any ROM)\n", DEFAULT_RANDOM_ROMS);
+	fprintf(stderr, "\t-s: seed of the first random ROM, ROM n uses seed + n\n");
+	fprintf(stderr, "\t-p: also run all the games of a pack, see tools/c8pack\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	static unsigned char rom[CHIP8_ROM_MAX];
+	int profile = -1;
+	unsigned long randoms = 0;
+	int randoms_set = 0;
+	uint32_t seed = 1;
+	unsigned long runs = 0, diverged = 0;
+	const char *pack_path = NULL;
+	rompack_t pack = { 0 };
+	int opt;
+
+	while ((opt = getopt(argc, argv, "e:f:i:p:q:r:s:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'e':
+				candidate_engine = chip8_engine_by_name(optarg);
+				if (candidate_engine < 0)
+					usage(argv[0]);
+				break;
+			case 'f':
+				frames = strtoul(optarg, NULL, 0);
+				break;
+			case 'i':
+				script_path = optarg;
+				break;
+			case 'p':
+				pack_path = optarg;
+				break;
+			case 'q':
+				profile = chip8_profile_by_name(optarg);
+				if (profile < 0)
+					usage(argv[0]);
+				break;
+			case 'r':
+				randoms = strtoul(optarg, NULL, 0);
+				randoms_set = 1;
+				break;
+			case 's':
+				seed = (uint32_t)strtoul(optarg, NULL, 0);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind == argc && pack_path == NULL && !randoms_set)
+		randoms = DEFAULT_RANDOM_ROMS;
+	if (pack_path != NULL && rompack_open(&pack, pack_path) < 0)
+	{
+		perror(pack_path);
+		return 2;
+	}
+	// a corrupted game would be compared as if it was the real one
+	for (uint32_t i = 0; i < pack.count; i++)
+	{
+		rompack_entry_t game;
+
+		rompack_entry(&pack, i, &game);
+		if (rompack_verify(&game) < 0)
+		{
+			fprintf(stderr, "%s: game %s is corrupted\n", pack_path, game.name);
+			return 2;
+		}
+	}
+
+	for (int p = 0; p < CHIP8_PROFILE_COUNT; p++)
+	{
+		if (profile >= 0 && p != profile)
+			continue;
+
+		for (int i = optind; i < argc; i++)
+		{
+			FILE *file = fopen(argv[i], "rb");
+			size_t size;
+			int ret;
+
+			if (file == NULL)
+			{
+				perror(argv[i]);
+				return 2;
+			}
+			size = fread(rom, 1, sizeof(rom), file);
+			fclose(file);
+
+			ret = lockstep(argv[i], rom, size, p, seed);
+			if (ret < 0)
+				return 2;
+			diverged += (unsigned long)ret;
+			runs++;
+		}
+
+		// the games are read straight from the mapping of the pack
+		for (uint32_t i = 0; i < pack.count; i++)
+		{
+			rompack_entry_t game;
+			int ret;
+
+			rompack_entry(&pack, i, &game);
+			ret = lockstep(game.name, game.rom, game.size, p, seed);
+			if (ret < 0)
+				return 2;
+			diverged += (unsigned long)ret;
+			runs++;
+		}
+
+		for (unsigned long n = 0; n < randoms; n++)
+		{
+			uint32_t rom_seed = seed + (uint32_t)n;
+			char name[32];
+			int ret;
+
+			snprintf(name, sizeof(name), "random ROM -s %u", rom_seed);
+			ret = lockstep(name, rom, random_rom(rom_seed, rom), p, rom_seed);
+			if (ret < 0)
+				return 2;
+			diverged += (unsigned long)ret;
+			runs++;
+		}
+	}
+
+	rompack_close(&pack);
+	chip8_free(reference.chip8);
+	chip8_free(reference.snapshot);
+	chip8_free(candidate.chip8);
+	chip8_free(candidate.snapshot);
+	printf("%lu runs, %lu diverged\n", runs, diverged);
+	return diverged != 0;
+}
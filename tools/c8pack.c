@@ -0,0 +1,258 @@
+/*
+ * Build, list and extract the ROM packs of include/rompack.h.
+ * A game is named after its file, without the directory and the extension.
+ * Its quirk profile and key map are given after its path, e.g.
+ * games/blitz.c8:vip:123C456D789EA0BF, or by -q and -k for all the games.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rompack.h"
+
+/* A game read from its file, waiting to be packed */
+typedef struct game_s {
+	rompack_entry_t entry;
+	char name[ROMPACK_NAME];
+	unsigned char keys[16];
+	unsigned char rom[CHIP8_ROM_MAX];
+} game_t;
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-q profile] [-k keys] -o pack rom[:profile[:keys]]...\n", name);
+	fprintf(stderr, "       %s -l pack\n", name);
+	fprintf(stderr, "       %s -x game pack > rom\n", name);
+	fprintf(stderr, "\t-o: write the games in a new pack\n");
+	fprintf(stderr, "\t-q: quirk profile of the games: default, vip or schip\n");
+	fprintf(stderr, "\t-k: key map of the games, the chip8 key pressed by each of the 16\n"
+			"\t    keys of the host in hexadecimal (0123456789ABCDEF by default)\n");
+	fprintf(stderr, "\t-l: list the games of a pack and check their hashes\n");
+	fprintf(stderr, "\t-x: write a game of a pack to the standard output\n");
+	exit(1);
+}
+
+static int parse_keys(const char *text, unsigned char *keys)
+{
+	if (strlen(text) != 16)
+		return -1;
+	for (unsigned k = 0; k < 16; k++)
+	{
+		char digit[2] = { text[k], '\0' };
+		char *end;
+
+		keys[k] = (unsigned char)strtoul(digit, &end, 16);
+		if (*end != '\0' || end == digit)
+			return -1;
+	}
+	return 0;
+}
+
+/* Read a game given as path[:profile[:keys]] */
+static int read_game(game_t *game, char *arg, int profile, const unsigned char *keys)
+{
+	char *options = strchr(arg, ':');
+	const char *base;
+	size_t len;
+	FILE *file;
+
+	memcpy(game->keys, keys, sizeof(game->keys));
+	if (options != NULL)
+	{
+		char *map = strchr(options + 1, ':');
+
+		*options = '\0';
+		if (map != NULL)
+		{
+			*map = '\0';
+			if (parse_keys(map + 1, game->keys) < 0)
+			{
+				fprintf(stderr, "%s: invalid key map %s\n", arg, map + 1);
+				return -1;
+			}
+		}
+		if (options[1] != '\0' && (profile = chip8_profile_by_name(options + 1)) < 0)
+		{
+			fprintf(stderr, "%s: unknown profile %s\n", arg, options + 1);
+			return -1;
+		}
+	}
+
+	base = strrchr(arg, '/') != NULL ? strrchr(arg, '/') + 1 : arg;
+	len = strcspn(base, ".");
+	if (len == 0 || len >= ROMPACK_NAME)
+	{
+		fprintf(stderr, "%s: the name must have 1 to %d characters\n", arg, ROMPACK_NAME - 1);
+		return -1;
+	}
+	memcpy(game->name, base, len);
+	game->name[len] = '\0';
+
+	file = fopen(arg, "rb");
+	if (file == NULL)
+	{
+		perror(arg);
+		return -1;
+	}
+	game->entry.size = fread(game->rom, 1, sizeof(game->rom), file);
+	if (ferror(file) || fgetc(file) != EOF)
+	{
+		fprintf(stderr, "%s: more than %d bytes\n", arg, CHIP8_ROM_MAX);
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+
+	game->entry.profile = profile;
+	return 0;
+}
+
+static int compare_games(const void *a, const void *b)
+{
+	return strcmp(((const game_t *)a)->name, ((const game_t *)b)->name);
+}
+
+static int create_pack(const char *path, char **args, int count, int profile,
+		const unsigned char *keys)
+{
+	game_t *games = calloc((size_t)count, sizeof(*games));
+	rompack_entry_t *entries = calloc((size_t)count, sizeof(*entries));
+	FILE *file;
+	int ret = 1;
+
+	if (games == NULL || entries == NULL)
+	{
+		perror("Failed to allocate the games: ");
+		goto out;
+	}
+	for (int i = 0; i < count; i++)
+		if (read_game(&games[i], args[i], profile, keys) < 0)
+			goto out;
+	qsort(games, (size_t)count, sizeof(*games), compare_games);
+	for (int i = 0; i < count; i++)
+	{
+		if (i > 0 && strcmp(games[i - 1].name, games[i].name) == 0)
+		{
+			fprintf(stderr, "Two games are named %s\n", games[i].name);
+			goto out;
+		}
+		// qsort moved the games
+		entries[i] = games[i].entry;
+		entries[i].name = games[i].name;
+		entries[i].rom = games[i].rom;
+		entries[i].keys = games[i].keys;
+	}
+
+	file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		perror(path);
+		goto out;
+	}
+	if (rompack_write(file, entries, (uint32_t)count) < 0 || fclose(file) != 0)
+	{
+		perror(path);
+		unlink(path);
+		goto out;
+	}
+	ret = 0;
+
+out:
+	free(games);
+	free(entries);
+	return ret;
+}
+
+static int list_pack(const rompack_t *pack)
+{
+	static const char *const profile_names[CHIP8_PROFILE_COUNT] = CHIP8_PROFILE_NAMES;
+	unsigned long corrupted = 0;
+
+	for (uint32_t i = 0; i < pack->count; i++)
+	{
+		rompack_entry_t entry;
+		int ok;
+
+		rompack_entry(pack, i, &entry);
+		ok = rompack_verify(&entry) == 0;
+		corrupted += !ok;
+		printf("%-31s %5zu %-7s %016llx ", entry.name, entry.size,
+				profile_names[entry.profile], (unsigned long long)entry.hash);
+		for (unsigned k = 0; k < 16; k++)
+			printf("%X", entry.keys[k]);
+		printf("%s\n", ok ? "" : " CORRUPTED");
+	}
+	printf("%u games, %lu corrupted\n", pack->count, corrupted);
+	return corrupted != 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char keys[16] = {
+		0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7,
+		0x8, 0x9, 0xA, 0xB, 0xC, 0xD, 0xE, 0xF,
+	};
+	int profile = CHIP8_PROFILE_DEFAULT;
+	const char *output = NULL;
+	const char *extract = NULL;
+	int list = 0;
+	rompack_t pack;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "lo:q:k:x:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'l':
+				list = 1;
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 'q':
+				profile = chip8_profile_by_name(optarg);
+				if (profile < 0)
+					usage(argv[0]);
+				break;
+			case 'k':
+				if (parse_keys(optarg, keys) < 0)
+					usage(argv[0]);
+				break;
+			case 'x':
+				extract = optarg;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if (output != NULL)
+	{
+		if (list || extract != NULL || optind == argc)
+			usage(argv[0]);
+		return create_pack(output, argv + optind, argc - optind, profile, keys);
+	}
+	if ((list == (extract != NULL)) || optind + 1 != argc)
+		usage(argv[0]);
+
+	if (rompack_open(&pack, argv[optind]) < 0)
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+	if (list)
+		ret = list_pack(&pack);
+	else
+	{
+		rompack_entry_t entry;
+
+		ret = rompack_find(&pack, extract, &entry) < 0;
+		if (ret)
+			fprintf(stderr, "No game %s in %s\n", extract, argv[optind]);
+		else if (entry.size > 0 && fwrite(entry.rom, entry.size, 1, stdout) != 1)
+			ret = 1;
+	}
+	rompack_close(&pack);
+	return ret;
+}
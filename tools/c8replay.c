@@ -0,0 +1,290 @@
+/*
+ * Convert a recording made with main -r to images: one PPM file per frame,
+ * or a single animated GIF where the identical frames are merged.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "capture.h"
+
+#define GIF_MAX_CODES 4096
+
+/* LZW encoder of the GIF image data, with 2 bit symbols */
+struct gif_lzw_s {
+	FILE *out;
+	uint16_t child[GIF_MAX_CODES][2]; /* code of string + pixel, 0 if none */
+	unsigned next; /* next free code */
+	unsigned width; /* of the codes, in bits */
+	uint32_t acc; /* bits waiting to be written */
+	unsigned nbits;
+	unsigned char block[255]; /* data sub-block being filled */
+	unsigned len;
+};
+
+#define GIF_MIN_CODE_SIZE 2
+#define GIF_CLEAR (1u << GIF_MIN_CODE_SIZE)
+#define GIF_EOI (GIF_CLEAR + 1)
+
+static void gif_put_byte(struct gif_lzw_s *lzw, unsigned char byte)
+{
+	lzw->block[lzw->len++] = byte;
+	if (lzw->len == sizeof(lzw->block))
+	{
+		fputc((int)lzw->len, lzw->out);
+		fwrite(lzw->block, lzw->len, 1, lzw->out);
+		lzw->len = 0;
+	}
+}
+
+static void gif_put_code(struct gif_lzw_s *lzw, unsigned code)
+{
+	lzw->acc |= (uint32_t)code << lzw->nbits;
+	lzw->nbits += lzw->width;
+	for (; lzw->nbits >= 8; lzw->nbits -= 8)
+	{
+		gif_put_byte(lzw, (unsigned char)lzw->acc);
+		lzw->acc >>= 8;
+	}
+}
+
+static void gif_reset(struct gif_lzw_s *lzw)
+{
+	memset(lzw->child, 0, sizeof(lzw->child));
+	lzw->next = GIF_EOI + 1;
+	lzw->width = GIF_MIN_CODE_SIZE + 1;
+}
+
+static void gif_write_image(FILE *out, const unsigned char *pixels, size_t n)
+{
+	static struct gif_lzw_s lzw;
+	unsigned code;
+
+	lzw.out = out;
+	lzw.acc = 0;
+	lzw.nbits = 0;
+	lzw.len = 0;
+	gif_reset(&lzw);
+
+	fputc(GIF_MIN_CODE_SIZE, out);
+	gif_put_code(&lzw, GIF_CLEAR);
+	code = pixels[0];
+	for (size_t i = 1; i < n; i++)
+	{
+		unsigned pixel = pixels[i];
+
+		if (lzw.child[code][pixel] != 0)
+		{
+			code = lzw.child[code][pixel];
+			continue;
+		}
+		gif_put_code(&lzw, code);
+		if (lzw.next < GIF_MAX_CODES)
+		{
+			if (lzw.next == 1u << lzw.width)
+				lzw.width++;
+			lzw.child[code][pixel] = (uint16_t)lzw.next++;
+		}
+		else
+		{
+			gif_put_code(&lzw, GIF_CLEAR);
+			gif_reset(&lzw);
+		}
+		code = pixel;
+	}
+	gif_put_code(&lzw, code);
+	gif_put_code(&lzw, GIF_EOI);
+	if (lzw.nbits > 0)
+		gif_put_byte(&lzw, (unsigned char)lzw.acc);
+	if (lzw.len > 0)
+	{
+		fputc((int)lzw.len, out);
+		fwrite(lzw.block, lzw.len, 1, out);
+	}
+	fputc(0, out); // end of the image data
+}
+
+static void put_le16(FILE *out, unsigned value)
+{
+	fputc((int)(value & 0xFF), out);
+	fputc((int)(value >> 8), out);
+}
+
+static void gif_write_header(FILE *out, unsigned width, unsigned height)
+{
+	static const unsigned char palette[6] = { 0, 0, 0, 0xFF, 0xFF, 0xFF };
+
+	fwrite("GIF89a", 6, 1, out);
+	put_le16(out, width);
+	put_le16(out, height);
+	fputc(0x80, out); // global palette of 2 colors
+	fputc(0, out); // background color
+	fputc(0, out); // square pixels
+	fwrite(palette, sizeof(palette), 1, out);
+	// loop forever
+	fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 19, 1, out);
+}
+
+/* Write a frame shown during delay hundredths of second */
+static void gif_write_frame(FILE *out, const unsigned char *pixels,
+		unsigned width, unsigned height, unsigned delay)
+{
+	fwrite("\x21\xF9\x04\x00", 4, 1, out); // graphic control extension
+	put_le16(out, delay);
+	fputc(0, out);
+	fputc(0, out);
+
+	fputc(0x2C, out); // image descriptor
+	put_le16(out, 0);
+	put_le16(out, 0);
+	put_le16(out, width);
+	put_le16(out, height);
+	fputc(0, out);
+	gif_write_image(out, pixels, (size_t)width * height);
+}
+
+static void scale_frame(const unsigned char *gfx, unsigned width, unsigned height,
+		unsigned scale, unsigned char *out)
+{
+	for (unsigned y = 0; y < height * scale; y++)
+		for (unsigned x = 0; x < width * scale; x++)
+			*out++ = gfx[x / scale + y / scale * width];
+}
+
+static int write_ppm(const char *path, const unsigned char *pixels,
+		unsigned width, unsigned height)
+{
+	FILE *out = fopen(path, "wb");
+
+	if (out == NULL)
+		return -1;
+	fprintf(out, "P6\n%u %u\n255\n", width, height);
+	for (size_t i = 0; i < (size_t)width * height; i++)
+	{
+		unsigned char rgb = pixels[i] ? 0xFF : 0;
+
+		fputc(rgb, out);
+		fputc(rgb, out);
+		fputc(rgb, out);
+	}
+	return fclose(out);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-s scale] recording output\n", name);
+	fprintf(stderr, "\toutput: an animated GIF if it ends with .gif, otherwise\n"
+			"\t        the prefix of one PPM file per frame\n");
+	fprintf(stderr, "\t-s: size of a chip8 pixel in the images (4 by default)\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	capture_reader_t reader;
+	unsigned scale = 4;
+	unsigned char gfx[CAPTURE_MAX_PIXELS];
+	unsigned char *image, *pending;
+	uint32_t frame, pending_frame = 0;
+	unsigned long frames = 0, images = 0;
+	double shown = 0; // time in the GIF at the beginning of the pending frame
+	FILE *gif = NULL;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "s:")) != -1)
+	{
+		switch (opt)
+		{
+			case 's':
+				scale = (unsigned)strtoul(optarg, NULL, 0);
+				if (scale == 0 || scale > 64)
+					usage(argv[0]);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind + 2 != argc)
+		usage(argv[0]);
+
+	if (capture_reader_open(&reader, argv[optind]) < 0)
+	{
+		fprintf(stderr, "Invalid recording: %s\n", argv[optind]);
+		return 1;
+	}
+
+	const char *output = argv[optind + 1];
+	size_t len = strlen(output);
+	unsigned width = (unsigned)reader.width * scale;
+	unsigned height = (unsigned)reader.height * scale;
+	double rate = reader.rate ? reader.rate : 60;
+
+	image = malloc((size_t)width * height);
+	pending = malloc((size_t)width * height);
+	if (len > 4 && strcmp(output + len - 4, ".gif") == 0)
+	{
+		gif = fopen(output, "wb");
+		if (gif == NULL)
+		{
+			perror("Failed to open the output: ");
+			return 1;
+		}
+		gif_write_header(gif, width, height);
+	}
+
+	while ((ret = capture_reader_next(&reader, gfx, &frame)) > 0)
+	{
+		scale_frame(gfx, (unsigned)reader.width, (unsigned)reader.height, scale, image);
+		frames++;
+
+		if (gif == NULL)
+		{
+			char path[4096];
+
+			snprintf(path, sizeof(path), "%s_%06u.ppm", output, frame);
+			if (write_ppm(path, image, width, height) != 0)
+			{
+				perror("Failed to write a frame: ");
+				return 1;
+			}
+			images++;
+			continue;
+		}
+
+		// the pending frame is shown until the pixels change
+		if (frames > 1 && memcmp(image, pending, (size_t)width * height) == 0)
+			continue;
+		if (frames > 1)
+		{
+			// round on the whole animation, the GIF delays are in 1/100 s
+			double end = (frame - pending_frame) / rate * 100 + shown;
+			unsigned delay = (unsigned)(end + 0.5) - (unsigned)(shown + 0.5);
+
+			gif_write_frame(gif, pending, width, height, delay);
+			shown = end;
+			images++;
+		}
+		memcpy(pending, image, (size_t)width * height);
+		pending_frame = frame;
+	}
+	if (ret < 0)
+		fprintf(stderr, "Invalid record after frame %u\n", frame);
+
+	if (gif != NULL)
+	{
+		if (frames > 0)
+		{
+			gif_write_frame(gif, pending, width, height, (unsigned)(100 / rate + 0.5));
+			images++;
+		}
+		fputc(0x3B, gif);
+		fclose(gif);
+	}
+
+	fprintf(stderr, "%lu frames, %lu images\n", frames, images);
+	capture_reader_close(&reader);
+	free(image);
+	free(pending);
+	return ret < 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * Show the live counters of all the running emulators, like top: each
+ * emulator publishes them in a shared memory page (see include/metrics.h),
+ * the rates are computed between two refreshes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "metrics.h"
+#include "pacer.h"
+
+/* the screen is refreshed every DEFAULT_DELAY seconds */
+#define DEFAULT_DELAY 1.0
+
+/* An emulator seen at the previous refreshes */
+typedef struct instance_s {
+	char name[64]; /* of the page */
+	const metrics_page_t *page;
+	metrics_counters_t prev; /* at the previous refresh */
+	metrics_counters_t cur;
+	int seen; /* still there at this refresh */
+	struct instance_s *next;
+} instance_t;
+
+static instance_t *instances;
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b] [-d seconds] [-n count]\n", name);
+	fprintf(stderr, "\t-b: batch mode, print the refreshes one after the other\n");
+	fprintf(stderr, "\t-d: delay between two refreshes (%.1f)\n", DEFAULT_DELAY);
+	fprintf(stderr, "\t-n: stop after this number of refreshes\n");
+	exit(1);
+}
+
+static instance_t *instance_find(const char *name)
+{
+	for (instance_t *instance = instances; instance != NULL; instance = instance->next)
+		if (strcmp(instance->name, name) == 0)
+			return instance;
+	return NULL;
+}
+
+/* Read the pages of METRICS_DIR, map the new ones and forget the dead ones */
+static void scan(void)
+{
+	DIR *dir = opendir(METRICS_DIR);
+	struct dirent *entry;
+	instance_t **link;
+
+	for (instance_t *instance = instances; instance != NULL; instance = instance->next)
+		instance->seen = 0;
+
+	while (dir != NULL && (entry = readdir(dir)) != NULL)
+	{
+		instance_t *instance;
+
+		if (strncmp(entry->d_name, METRICS_PREFIX, strlen(METRICS_PREFIX)) != 0
+				|| strlen(entry->d_name) >= sizeof(instance->name))
+			continue;
+		instance = instance_find(entry->d_name);
+		if (instance == NULL)
+		{
+			const metrics_page_t *page = metrics_map(entry->d_name);
+
+			if (page == NULL)
+				continue;
+			instance = calloc(1, sizeof(*instance));
+			if (instance == NULL)
+			{
+				metrics_unmap(page);
+				continue;
+			}
+			strcpy(instance->name, entry->d_name);
+			instance->page = page;
+			instance->next = instances;
+			instances = instance;
+		}
+		// the page of a crashed emulator stays, but not the emulator
+		if (kill((pid_t)instance->page->pid, 0) < 0 && errno == ESRCH)
+			continue;
+		instance->prev = instance->cur;
+		if (metrics_read(instance->page, &instance->cur) == 0)
+		{
+			instance->seen = 1;
+			if (instance->prev.now == 0)
+			{
+				// first refresh, the rates are averaged since the start
+				instance->prev.start = instance->cur.start;
+				instance->prev.now = instance->cur.start;
+			}
+		}
+	}
+	if (dir != NULL)
+		closedir(dir);
+
+	for (link = &instances; *link != NULL;)
+	{
+		instance_t *instance = *link;
+
+		if (instance->seen)
+		{
+			link = &instance->next;
+			continue;
+		}
+		*link = instance->next;
+		metrics_unmap(instance->page);
+		free(instance);
+	}
+}
+
+static double rate(uint64_t cur, uint64_t prev, uint64_t ns)
+{
+	return ns > 0 ? (double)(cur - prev) * NSEC_PER_SEC / (double)ns : 0;
+}
+
+static double percent(uint64_t cur, uint64_t prev, uint64_t ns)
+{
+	return ns > 0 ? (double)(cur - prev) * 100 / (double)ns : 0;
+}
+
+static void show(int batch)
+{
+	unsigned count = 0;
+	double total = 0;
+
+	for (instance_t *instance = instances; instance != NULL; instance = instance->next)
+	{
+		count++;
+		total += rate(instance->cur.cycles, instance->prev.cycles,
+				instance->cur.now - instance->prev.now);
+	}
+
+	if (!batch)
+		printf("\033[H\033[2J");
+	printf("%u emulators, %.0f instructions/s\n\n", count, total);
+	printf("%7s %-20s %-8s %6s %10s %7s %7s %7s %5s %5s %5s %s\n", "PID", "GAME", "BACKEND",
+			"SPEED", "INSN/S", "FRAME/S", "DRAW/S", "DROP/S", "VM%", "DRAW%", "KEYS%", "STATE");
+	for (instance_t *instance = instances; instance != NULL; instance = instance->next)
+	{
+		const metrics_counters_t *cur = &instance->cur, *prev = &instance->prev;
+		uint64_t ns = cur->now - prev->now;
+
+		printf("%7u %-20.20s %-8.8s %6.2f %10.0f %7.1f %7.1f %7.1f %5.1f %5.1f %5.1f %s\n",
+				instance->page->pid, instance->page->game, instance->page->backend,
+				cur->speed / 1000.0, rate(cur->cycles, prev->cycles, ns),
+				rate(cur->frames, prev->frames, ns), rate(cur->presented, prev->presented, ns),
+				rate(cur->dropped, prev->dropped, ns), percent(cur->vm_ns, prev->vm_ns, ns),
+				percent(cur->update_ns, prev->update_ns, ns),
+				percent(cur->event_ns, prev->event_ns, ns),
+				cur->flags & METRICS_DEBUG ? "debug" : cur->flags & METRICS_HALTED ? "halted"
+				: cur->flags & METRICS_TURBO ? "turbo" : "running");
+	}
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	double delay = DEFAULT_DELAY;
+	unsigned long count = 0; // 0 -> forever
+	int batch = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "bd:n:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'b':
+				batch = 1;
+				break;
+			case 'd':
+				delay = strtod(optarg, NULL);
+				if (delay <= 0)
+					usage(argv[0]);
+				break;
+			case 'n':
+				count = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+
+	for (unsigned long n = 0; count == 0 || n < count; n++)
+	{
+		if (n > 0)
+		{
+			usleep((useconds_t)(delay * 1e6));
+			if (batch)
+				printf("\n");
+		}
+		scan();
+		show(batch);
+	}
+
+	while (instances != NULL)
+	{
+		instance_t *next = instances->next;
+
+		metrics_unmap(instances->page);
+		free(instances);
+		instances = next;
+	}
+	return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * Print the instructions of a trace made with main -T, filtered by address,
+ * opcode or cycle.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "disasm.h"
+
+#define MAX_PATTERNS 16
+#define CHUNK 4096
+
+/* An instruction of the trace, with the values of all the changed registers */
+struct record_s {
+	uint64_t cycle;
+	uint16_t pc;
+	uint16_t opcode;
+	uint16_t I;
+	uint16_t changed;
+	uint8_t values[16];
+};
+
+struct reader_s {
+	FILE *file;
+	trace_entry_t buf[CHUNK];
+	size_t len;
+	size_t pos;
+	uint64_t epoch; /* the cycles are stored modulo 2^32 */
+	uint32_t last;
+};
+
+static const trace_entry_t *next_entry(struct reader_s *reader)
+{
+	if (reader->pos == reader->len)
+	{
+		reader->len = fread(reader->buf, sizeof(trace_entry_t), CHUNK, reader->file);
+		reader->pos = 0;
+		if (reader->len == 0)
+			return NULL;
+	}
+	return &reader->buf[reader->pos++];
+}
+
+/* Read the next instruction, return 0 at the end of the trace */
+static int next_record(struct reader_s *reader, struct record_s *record)
+{
+	const trace_entry_t *entry = next_entry(reader);
+	unsigned n = 0;
+
+	if (entry == NULL)
+		return 0;
+
+	if (entry->insn.cycle < reader->last)
+		reader->epoch += 1ULL << 32;
+	reader->last = entry->insn.cycle;
+	record->cycle = reader->epoch | entry->insn.cycle;
+	record->pc = (uint16_t)(entry->insn.pc & ~TRACE_CONTINUED);
+	record->opcode = entry->insn.opcode;
+	record->I = entry->insn.I;
+	record->changed = entry->insn.changed;
+	memcpy(record->values, entry->insn.values, sizeof(entry->insn.values));
+	n = sizeof(entry->insn.values);
+
+	if (entry->insn.pc & TRACE_CONTINUED)
+	{
+		entry = next_entry(reader);
+		if (entry == NULL)
+			return 0; // truncated
+		memcpy(record->values + n, entry->more.values, sizeof(entry->more.values));
+	}
+	return 1;
+}
+
+static void print_record(const struct record_s *record)
+{
+	char text[32];
+	unsigned n = 0;
+
+	chip8_disassemble(record->opcode, text, sizeof(text));
+	printf("%12llu  %03X  %04X  %-18s I=%03X", (unsigned long long)record->cycle,
+			record->pc, record->opcode, text, record->I);
+	for (unsigned x = 0; x < 16; x++)
+		if (record->changed >> x & 1)
+			printf(" V%X=%02X", x, record->values[n++]);
+	printf("\n");
+}
+
+/* Parse "START" or "START-END" */
+static int parse_range(const char *arg, int base, unsigned long long *start,
+		unsigned long long *end)
+{
+	char *next;
+
+	*start = strtoull(arg, &next, base);
+	if (next == arg)
+		return -1;
+	if (*next == '\0')
+	{
+		*end = *start;
+		return 0;
+	}
+	if (*next != '-')
+		return -1;
+	*end = strtoull(next + 1, &next, base);
+	return *next == '\0' && *end >= *start ? 0 : -1;
+}
+
+/* Parse an opcode where the non hexadecimal digits are wildcards, e.g. 8XY4 */
+static int parse_pattern(const char *arg, uint16_t *value, uint16_t *mask)
+{
+	if (strlen(arg) != 4)
+		return -1;
+	*value = 0;
+	*mask = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		unsigned shift = (unsigned)(12 - 4 * i);
+		char c = arg[i];
+
+		if (!isxdigit((unsigned char)c) || (i > 0 && strchr("XYN", c) != NULL))
+			continue;
+		*value = (uint16_t)(*value | (unsigned)strtoul((char[]){ c, '\0' }, NULL, 16) << shift);
+		*mask = (uint16_t)(*mask | 0xFu << shift);
+	}
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-p start[-end]] [-o opcode]... [-c first[-last]] [-t n] trace\n", name);
+	fprintf(stderr, "\t-p: only the instructions at these addresses (hexadecimal)\n");
+	fprintf(stderr, "\t-o: only these instructions, X Y N and the other letters\n"
+			"\t    after the first one are wildcards, e.g. -o 8XY4 -o DXYN\n");
+	fprintf(stderr, "\t-c: only the instructions executed during these cycles\n");
+	fprintf(stderr, "\t-t: only print the last n matching instructions\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	static struct reader_s reader;
+	unsigned long long pc_start = 0, pc_end = 0xFFF;
+	unsigned long long cycle_start = 0, cycle_end = UINT64_MAX;
+	uint16_t values[MAX_PATTERNS], masks[MAX_PATTERNS];
+	unsigned patterns = 0;
+	unsigned long tail = 0;
+	struct record_s record, *last = NULL;
+	unsigned long long total = 0, matched = 0;
+	unsigned char header[TRACE_HEADER_SIZE];
+	uint16_t byte_order = TRACE_BYTE_ORDER;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:o:c:t:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'p':
+				if (parse_range(optarg, 16, &pc_start, &pc_end) < 0)
+					usage(argv[0]);
+				break;
+			case 'o':
+				if (patterns == MAX_PATTERNS
+						|| parse_pattern(optarg, &values[patterns], &masks[patterns]) < 0)
+					usage(argv[0]);
+				patterns++;
+				break;
+			case 'c':
+				if (parse_range(optarg, 10, &cycle_start, &cycle_end) < 0)
+					usage(argv[0]);
+				break;
+			case 't':
+				tail = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind + 1 != argc)
+		usage(argv[0]);
+
+	reader.file = fopen(argv[optind], "rb");
+	if (reader.file == NULL)
+	{
+		perror("Failed to open the trace: ");
+		return 1;
+	}
+	if (fread(header, sizeof(header), 1, reader.file) != 1
+			|| memcmp(header, TRACE_MAGIC, 4) != 0 || header[4] != TRACE_VERSION)
+	{
+		fprintf(stderr, "Invalid trace: %s\n", argv[optind]);
+		return 1;
+	}
+	if (memcmp(header + 6, &byte_order, sizeof(byte_order)) != 0)
+	{
+		fprintf(stderr, "The trace was written by a host of another byte order\n");
+		return 1;
+	}
+
+	if (tail > 0)
+		last = malloc(tail * sizeof(*last));
+
+	while (next_record(&reader, &record))
+	{
+		int match = patterns == 0;
+
+		total++;
+		if (record.pc < pc_start || record.pc > pc_end
+				|| record.cycle < cycle_start || record.cycle > cycle_end)
+			continue;
+		for (unsigned i = 0; i < patterns && !match; i++)
+			match = (record.opcode & masks[i]) == values[i];
+		if (!match)
+			continue;
+
+		if (last != NULL)
+			last[matched % tail] = record;
+		else
+			print_record(&record);
+		matched++;
+	}
+
+	if (last != NULL)
+	{
+		unsigned long long first = matched > tail ? matched - tail : 0;
+
+		for (unsigned long long i = first; i < matched; i++)
+			print_record(&last[i % tail]);
+		free(last);
+	}
+
+	fprintf(stderr, "%llu instructions, %llu matching\n", total, matched);
+	fclose(reader.file);
+	return 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * Terminal viewer of the NET backend: draws the streamed screen and sends
+ * the keys back, with the keyboard layout of the TERM backend.
+ * A terminal does not report the key releases, so a key is released
+ * NETVIEW_HOLD_MS after it was typed.
+ * With -c or -s it is a client of the multi-session server (server/).
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/socket.h>
+
+#include "netproto.h"
+#include "pacer.h"
+#include "vm.h"
+
+#define NETVIEW_HOLD_MS 100
+#define NETVIEW_MAX_W 64
+#define NETVIEW_MAX_H 32
+
+static const char netview_keys[] = "1234azerqsdfwxcv";
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-c game_file [-q profile] | -s session] [address]\n", name);
+	fprintf(stderr, "\taddress: unix:PATH, tcp:PORT or tcp:HOST:PORT,\n"
+			"\t         $CHIP8_NET or %s by default\n", NETPROTO_DEFAULT_ADDR);
+	fprintf(stderr, "\t-c: start the game in a new session of the server\n");
+	fprintf(stderr, "\t-q: quirk profile of the game: default, vip or schip\n");
+	fprintf(stderr, "\t-s: join a session of the server\n");
+	fprintf(stderr, "\ttab toggles the turbo mode, ^Z stops the emulator (or the session),\n"
+			"\t^C quits\n");
+	exit(1);
+}
+
+static void send_message(int fd, uint8_t type, uint32_t seq,
+		const unsigned char *payload, uint16_t len)
+{
+	unsigned char buf[NETPROTO_HEADER_SIZE + 1 + CHIP8_MEMORY_SIZE];
+	netproto_header_t hdr = { .type = type, .length = len, .seq = seq };
+
+	netproto_write_header(buf, &hdr);
+	memcpy(buf + NETPROTO_HEADER_SIZE, payload, len);
+	send(fd, buf, NETPROTO_HEADER_SIZE + len, MSG_NOSIGNAL);
+}
+
+static void send_key(int fd, int key, int pressed)
+{
+	unsigned char payload[2] = { (unsigned char)key, (unsigned char)pressed };
+
+	send_message(fd, NETPROTO_KEY, 0, payload, sizeof(payload));
+}
+
+static void draw(const unsigned char *gfx, int w, int h, const char *status)
+{
+	printf("\033[H");
+	for (int y = 0; y < h; y++)
+	{
+		for (int x = 0; x < w; x++)
+			putchar(gfx[x + y * w] ? 'X' : ' ');
+		putchar('\n');
+	}
+	printf("%s\033[K\n", status);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	const char *addr = getenv("CHIP8_NET");
+	unsigned char input[NETPROTO_HEADER_SIZE + 0x10000];
+	size_t input_len = 0;
+	unsigned char gfx[NETVIEW_MAX_W * NETVIEW_MAX_H] = { 0 };
+	int w = 0, h = 0;
+	char status[128] = "";
+	char error[128] = "";
+	uint64_t released[16] = { 0 }; // when the held keys are released, 0 if not held
+	uint32_t seq = 0;
+	unsigned long frames = 0, skipped = 0;
+	struct termios old_t, new_t;
+	const char *game = NULL;
+	int profile = CHIP8_PROFILE_DEFAULT;
+	long session = -1;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "c:q:s:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'c':
+				game = optarg;
+				break;
+			case 'q':
+				profile = chip8_profile_by_name(optarg);
+				if (profile < 0)
+					usage(argv[0]);
+				break;
+			case 's':
+				session = strtol(optarg, NULL, 0);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind + 1 < argc || (game != NULL && session >= 0))
+		usage(argv[0]);
+	if (optind + 1 == argc)
+		addr = argv[optind];
+	if (addr == NULL)
+		addr = NETPROTO_DEFAULT_ADDR;
+
+	fd = netproto_connect(addr);
+	if (fd < 0)
+	{
+		perror("Failed to connect: ");
+		return 1;
+	}
+
+	if (game != NULL)
+	{
+		unsigned char rom[1 + CHIP8_MEMORY_SIZE];
+		FILE *file = fopen(game, "rb");
+		size_t len;
+
+		if (file == NULL)
+		{
+			perror("Failed to open file: ");
+			return 1;
+		}
+		rom[0] = (unsigned char)profile;
+		len = fread(rom + 1, 1, sizeof(rom) - 1, file);
+		fclose(file);
+		send_message(fd, NETPROTO_CREATE, 0, rom, (uint16_t)(1 + len));
+	}
+	else if (session >= 0)
+		send_message(fd, NETPROTO_ATTACH, (uint32_t)session, NULL, 0);
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	tcgetattr(STDIN_FILENO, &old_t);
+	new_t = old_t;
+	// ^C and ^Z are read as keys
+	new_t.c_lflag &= (tcflag_t)~(ICANON | ECHO | ISIG);
+	tcsetattr(STDIN_FILENO, TCSANOW, &new_t);
+	printf("\033[2J");
+
+	while (!stop)
+	{
+		struct pollfd fds[2] = {
+			{ .fd = fd, .events = POLLIN },
+			{ .fd = STDIN_FILENO, .events = POLLIN },
+		};
+		uint64_t now = pacer_now();
+
+		for (int k = 0; k < 16; k++)
+			if (released[k] != 0 && released[k] <= now)
+			{
+				send_key(fd, k, 0);
+				released[k] = 0;
+			}
+
+		if (poll(fds, 2, 10) <= 0)
+			continue;
+
+		if (fds[1].revents & POLLIN)
+		{
+			char c;
+
+			if (read(STDIN_FILENO, &c, 1) == 1)
+			{
+				const char *key = c ? strchr(netview_keys, c | 0x20) : NULL;
+
+				if (c == 3)
+					stop = 1;
+				else if (c == '\t')
+					send_message(fd, NETPROTO_TURBO, 0, NULL, 0);
+				else if (c == 26)
+					send_message(fd, NETPROTO_QUIT, 0, NULL, 0);
+				else if (key != NULL)
+				{
+					int k = (int)(key - netview_keys);
+
+					if (released[k] == 0)
+						send_key(fd, k, 1);
+					released[k] = now + NETVIEW_HOLD_MS * 1000000ULL;
+				}
+			}
+		}
+
+		if (!(fds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+			continue;
+
+		ssize_t n = recv(fd, input + input_len, sizeof(input) - input_len, 0);
+		if (n <= 0)
+			break; // the emulator is gone
+		input_len += (size_t)n;
+
+		netproto_header_t hdr;
+		size_t len;
+		int redraw = 0;
+
+		while ((len = netproto_read_header(input, input_len, &hdr)) > 0)
+		{
+			const unsigned char *payload = input + NETPROTO_HEADER_SIZE;
+
+			switch (hdr.type)
+			{
+				case NETPROTO_HELLO:
+					if (hdr.length < 3 || payload[0] != NETPROTO_VERSION
+							|| payload[1] > NETVIEW_MAX_W || payload[2] > NETVIEW_MAX_H)
+					{
+						fprintf(stderr, "Unsupported server\n");
+						stop = 1;
+						break;
+					}
+					w = payload[1];
+					h = payload[2];
+					break;
+				case NETPROTO_FRAME:
+					// the server skips the deltas of a late viewer, then sends a key frame
+					if (frames > 0)
+						skipped += hdr.seq - seq - 1;
+					seq = hdr.seq;
+					frames++;
+					if (netproto_decode_frame(payload, hdr.length, gfx, w, h) < 0)
+					{
+						fprintf(stderr, "Invalid frame %u\n", hdr.seq);
+						stop = 1;
+					}
+					redraw = 1;
+					break;
+				case NETPROTO_STATUS:
+					snprintf(status, sizeof(status), "%.*s", (int)hdr.length, payload);
+					redraw = 1;
+					break;
+				case NETPROTO_SOUND:
+					if (hdr.length > 0 && payload[0])
+						putchar('\a');
+					break;
+				case NETPROTO_SESSION:
+					snprintf(status, sizeof(status), "session %u", hdr.seq);
+					redraw = 1;
+					break;
+				case NETPROTO_ERROR:
+					snprintf(error, sizeof(error), "%.*s", (int)hdr.length, payload);
+					stop = 1;
+					break;
+			}
+			input_len -= len;
+			memmove(input, input + len, input_len);
+		}
+
+		if (redraw)
+		{
+			char line[192];
+
+			snprintf(line, sizeof(line), "%s | frame %u, %lu skipped", status, seq, skipped);
+			draw(gfx, w, h, line);
+		}
+	}
+
+	tcsetattr(STDIN_FILENO, TCSANOW, &old_t);
+	close(fd);
+	if (error[0] != '\0')
+	{
+		fprintf(stderr, "Server error: %s\n", error);
+		return 1;
+	}
+	return 0;
+}